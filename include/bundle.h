@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2011-2013 Luc Verhaegen <libv@skynet.be>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Shader bundle file layout, as written by mali_compile -b and mmapped
+ * by limare.
+ *
+ * header
+ * entries[count], sorted by name hash.
+ * string table, holding the zero terminated program names.
+ * MBS streams, each 0x10 aligned.
+ *
+ * All offsets are relative to the start of the file.
+ */
+#ifndef LIMA_BUNDLE_H
+#define LIMA_BUNDLE_H 1
+
+#include "fnv.h"
+
+#define LIMA_BUNDLE_MAGIC   0x4C444E42 /* BNDL */
+#define LIMA_BUNDLE_VERSION 1
+
+struct lima_bundle_header { /* 0x10 */
+	unsigned int magic; /* 0x00 */
+	unsigned int version; /* 0x04 */
+	int count; /* 0x08: number of programs */
+	int size; /* 0x0C: total file size */
+};
+
+struct lima_bundle_entry { /* 0x28 */
+	unsigned int hash; /* 0x00 */
+	int name_offset; /* 0x04 */
+
+	int vertex_offset; /* 0x08: MBS stream */
+	int vertex_size; /* 0x0C */
+	int fragment_offset; /* 0x10: MBS stream */
+	int fragment_size; /* 0x14 */
+
+	/* as parsed by the writer, checked against the program on load */
+	int vertex_shader_size; /* 0x18: DBIN size */
+	int vertex_attribute_prefetch; /* 0x1C */
+	int fragment_shader_size; /* 0x20: DBIN size */
+	int fragment_first_instruction_size; /* 0x24 */
+};
+
+/* shared between the bundle writer and reader. */
+static inline unsigned int
+lima_bundle_hash(const char *name)
+{
+	return lima_fnv_hash_string(LIMA_FNV_OFFSET, name);
+}
+
+#endif /* LIMA_BUNDLE_H */
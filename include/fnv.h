@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2011-2013 Luc Verhaegen <libv@skynet.be>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * FNV-1a, the one hash used throughout: bundle lookups, program variants,
+ * render state sharing and the client attribute cache. Bytewise, so any
+ * data can be hashed, whatever its alignment. lima_fnv_hash_words() is the
+ * faster variant for large buffers.
+ */
+#ifndef LIMA_FNV_H
+#define LIMA_FNV_H 1
+
+#define LIMA_FNV_OFFSET 0x811C9DC5
+#define LIMA_FNV_PRIME 0x01000193
+
+/* Pass LIMA_FNV_OFFSET as hash to start, or a previous result to continue. */
+static inline unsigned int
+lima_fnv_hash(unsigned int hash, const void *data, int size)
+{
+	const unsigned char *bytes = data;
+	int i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= LIMA_FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/*
+ * FNV-1a over 32 bit words when data is aligned, the tail and unaligned
+ * data bytewise. The rotate carries the high bits of each word down, plain
+ * word wise FNV would never let them reach the low bits of the hash.
+ * Results differ from lima_fnv_hash().
+ */
+static inline unsigned int
+lima_fnv_hash_words(unsigned int hash, const void *data, int size)
+{
+	const unsigned int *words = data;
+	int i, count = 0;
+
+	if (!((unsigned long) data & 3)) {
+		count = size / 4;
+
+		for (i = 0; i < count; i++) {
+			hash = ((hash << 5) | (hash >> 27)) ^ words[i];
+			hash *= LIMA_FNV_PRIME;
+		}
+	}
+
+	return lima_fnv_hash(hash, (const unsigned char *) data + 4 * count,
+			     size - 4 * count);
+}
+
+static inline unsigned int
+lima_fnv_hash_string(unsigned int hash, const char *string)
+{
+	while (*string) {
+		hash ^= (unsigned char) *string++;
+		hash *= LIMA_FNV_PRIME;
+	}
+
+	return hash;
+}
+
+#endif /* LIMA_FNV_H */
@@ -99,6 +99,9 @@ typedef enum
     _MALI_UK_GET_GP_NUMBER_OF_CORES_R3P0  = _MALI_UK_GET_NUMBER_OF_CORES_R3P0,
     _MALI_UK_GET_GP_CORE_VERSION_R3P0     = _MALI_UK_GET_CORE_VERSION_R3P0,
 
+    _MALI_UK_GP_SUSPEND_RESPONSE_R2P1     = 4, /**< _mali_ukk_gp_suspend_response() */
+    _MALI_UK_GP_SUSPEND_RESPONSE_R3P0     = 3,
+
 
 	/** Profiling functions */
 
@@ -162,6 +165,8 @@ typedef enum
 #define MALI_IOC_GP2_CORE_VERSION_GET_R2P1	    _IOR (MALI_IOC_GP_BASE, _MALI_UK_GET_GP_CORE_VERSION_R2P1, _mali_uk_get_gp_core_version_s *)
 #define MALI_IOC_GP2_NUMBER_OF_CORES_GET_R3P0 _IOR (MALI_IOC_GP_BASE, _MALI_UK_GET_GP_NUMBER_OF_CORES_R3P0, _mali_uk_get_gp_number_of_cores_s *)
 #define MALI_IOC_GP2_CORE_VERSION_GET_R3P0    _IOR (MALI_IOC_GP_BASE, _MALI_UK_GET_GP_CORE_VERSION_R3P0, _mali_uk_get_gp_core_version_s *)
+#define MALI_IOC_GP2_SUSPEND_RESPONSE_R2P1    _IOW (MALI_IOC_GP_BASE, _MALI_UK_GP_SUSPEND_RESPONSE_R2P1, _mali_uk_gp_suspend_response_s *)
+#define MALI_IOC_GP2_SUSPEND_RESPONSE_R3P0    _IOW (MALI_IOC_GP_BASE, _MALI_UK_GP_SUSPEND_RESPONSE_R3P0, _mali_uk_gp_suspend_response_s *)
 
 #define MALI_IOC_PROFILING_START            _IOWR(MALI_IOC_PROFILING_BASE, _MALI_UK_PROFILING_START, _mali_uk_profiling_start_s *)
 #define MALI_IOC_PROFILING_ADD_EVENT        _IOWR(MALI_IOC_PROFILING_BASE, _MALI_UK_PROFILING_ADD_EVENT, _mali_uk_profiling_add_event_s*)
@@ -580,6 +585,36 @@ typedef struct
 	u32 cookie;                          /**< [out] identifier for the core in kernel space on which the job stalled */
 } _mali_uk_gp_job_suspended_s;
 
+/** @brief Arguments for _mali_ukk_gp_suspend_response()
+ *
+ * When _mali_wait_for_notification() receives notification that a
+ * Vertex Processor job was suspended, you need to send a response to indicate
+ * what needs to happen with this job. You can either abort or resume the job.
+ *
+ * - set @c code to indicate response code. This is either @c _MALIGP_JOB_ABORT or
+ * @c _MALIGP_JOB_RESUME_WITH_NEW_HEAP to indicate you will provide a new heap
+ * for the job that will resolve the out of memory condition for the job.
+ * - copy the @c cookie value from the @c _mali_uk_gp_job_suspended_s notification data
+ * to the @c cookie field.
+ * - set @c arguments[0] and @c arguments[1] to zero if you abort the job. If
+ * you resume it, @c argument[0] should specify the Mali start address for the new heap
+ * and @c argument[1] the Mali end address of the heap.
+ *
+ */
+typedef enum _maligp_job_suspended_response_code
+{
+	_MALIGP_JOB_ABORT,                  /**< Abort the Vertex Processor job */
+	_MALIGP_JOB_RESUME_WITH_NEW_HEAP    /**< Resume the Vertex Processor job with a new heap */
+} _maligp_job_suspended_response_code;
+
+typedef struct
+{
+    void *ctx;                      /**< [in,out] user-kernel context (trashed on output) */
+	u32 cookie;                     /**< [in] cookie from the _mali_uk_gp_job_suspended_s notification data */
+	_maligp_job_suspended_response_code code; /**< [in] abort or resume response code, see \ref _maligp_job_suspended_response_code */
+	u32 arguments[2];               /**< [in] 0 when aborting a job. When resuming a job, the Mali start and end address for a new heap to resume the job with */
+} _mali_uk_gp_suspend_response_s;
+
 /** @} */ /* end group _mali_uk_gp */
 
 /** @defgroup _mali_uk_pp U/K Fragment Processor
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2011-2013 Luc Verhaegen <libv@skynet.be>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Static cost analysis of compiled GP (vertex) and PP (fragment) shader
+ * binaries. Only the instruction framing and the unit usage bits get
+ * decoded, which is enough to compare variants and catch regressions.
+ *
+ * Both units issue one instruction per cycle. The cycle estimates add a
+ * cost for every operation that waits on memory or the pipeline, using the
+ * LIMA_*_COST weights below. These are rough figures for ranking variants
+ * against each other, not measured latencies; the many threads in flight
+ * hide most of the real latency.
+ */
+#ifndef LIMA_SHADER_STATS_H
+#define LIMA_SHADER_STATS_H 1
+
+struct lima_vertex_shader_stats {
+	int instructions;
+	int cycles; /* per vertex, estimated */
+	int attribute_prefetch; /* attribute registers loaded per vertex */
+	int varying_stores;
+	int temporary_stores;
+	int branches;
+};
+
+struct lima_fragment_shader_stats {
+	int instructions;
+	int cycles; /* per fragment, estimated */
+	int varying_fetches;
+	int texture_fetches;
+	int uniform_fetches;
+	int temporary_writes;
+	int branches;
+	int syncs;
+};
+
+/*
+ * GP instructions are 4 dwords wide and always carry all units. The store
+ * unit sits in the 3rd and 4th dword:
+ *
+ * dword 2, bit 3: store0 is a temporary store.
+ * dword 2, bit 4: store1 is a temporary store.
+ * dword 2, bit 5: branch.
+ * dword 2, bits 7-18: store sources x, y, z, w, 3 bits each, 7 is unused.
+ * dword 2, bit 30: store0 writes a varying.
+ * dword 3, bit 3: store1 writes a varying.
+ */
+#define LIMA_VS_STORE_SOURCE_NONE 0x07
+
+#define LIMA_VS_ATTRIBUTE_COST 1 /* load, per prefetched attribute */
+#define LIMA_VS_TEMPORARY_COST 2 /* store and the later reload */
+#define LIMA_VS_BRANCH_COST 2 /* pipeline refill */
+
+static inline void
+lima_vertex_shader_stats(const unsigned int *shader, int size,
+			 int attribute_prefetch,
+			 struct lima_vertex_shader_stats *stats)
+{
+	int i;
+
+	stats->instructions = size / 16;
+	stats->attribute_prefetch = attribute_prefetch;
+	stats->varying_stores = 0;
+	stats->temporary_stores = 0;
+	stats->branches = 0;
+
+	for (i = 0; i < stats->instructions; i++) {
+		const unsigned int *instruction = &shader[4 * i];
+		int store0 = 0, store1 = 0;
+
+		if (((instruction[2] >> 7) & 0x07) !=
+		    LIMA_VS_STORE_SOURCE_NONE)
+			store0 = 1;
+		if (((instruction[2] >> 10) & 0x07) !=
+		    LIMA_VS_STORE_SOURCE_NONE)
+			store0 = 1;
+		if (((instruction[2] >> 13) & 0x07) !=
+		    LIMA_VS_STORE_SOURCE_NONE)
+			store1 = 1;
+		if (((instruction[2] >> 16) & 0x07) !=
+		    LIMA_VS_STORE_SOURCE_NONE)
+			store1 = 1;
+
+		if (store0) {
+			if (instruction[2] & 0x40000000)
+				stats->varying_stores++;
+			else if (instruction[2] & 0x08)
+				stats->temporary_stores++;
+		}
+
+		if (store1) {
+			if (instruction[3] & 0x08)
+				stats->varying_stores++;
+			else if (instruction[2] & 0x10)
+				stats->temporary_stores++;
+		}
+
+		if (instruction[2] & 0x20)
+			stats->branches++;
+	}
+
+	stats->cycles = stats->instructions +
+		LIMA_VS_ATTRIBUTE_COST * stats->attribute_prefetch +
+		LIMA_VS_TEMPORARY_COST * stats->temporary_stores +
+		LIMA_VS_BRANCH_COST * stats->branches;
+}
+
+/*
+ * PP instructions are variable length. The first dword is the control
+ * word:
+ *
+ * bits 0-4: instruction size in dwords.
+ * bit 5: stop.
+ * bit 6: sync.
+ * bits 7-18: which units are present.
+ */
+#define LIMA_PP_CONTROL_SIZE(x)  ((x) & 0x1F)
+#define LIMA_PP_CONTROL_STOP     0x00000020
+#define LIMA_PP_CONTROL_SYNC     0x00000040
+#define LIMA_PP_FIELD_VARYING    0x00000080
+#define LIMA_PP_FIELD_SAMPLER    0x00000100
+#define LIMA_PP_FIELD_UNIFORM    0x00000200
+#define LIMA_PP_FIELD_TEMP_WRITE 0x00008000
+#define LIMA_PP_FIELD_BRANCH     0x00010000
+
+#define LIMA_PP_VARYING_COST 1 /* varying load */
+#define LIMA_PP_TEXTURE_COST 4 /* texture fetch and filtering */
+#define LIMA_PP_UNIFORM_COST 1 /* uniform load */
+#define LIMA_PP_SYNC_COST 2 /* waits for outstanding loads */
+#define LIMA_PP_BRANCH_COST 2 /* pipeline refill */
+
+static inline void
+lima_fragment_shader_stats(const unsigned int *shader, int size,
+			   struct lima_fragment_shader_stats *stats)
+{
+	int offset = 0;
+
+	size /= 4;
+
+	stats->instructions = 0;
+	stats->varying_fetches = 0;
+	stats->texture_fetches = 0;
+	stats->uniform_fetches = 0;
+	stats->temporary_writes = 0;
+	stats->branches = 0;
+	stats->syncs = 0;
+
+	while (offset < size) {
+		unsigned int control = shader[offset];
+
+		if (!LIMA_PP_CONTROL_SIZE(control))
+			break;
+
+		stats->instructions++;
+
+		if (control & LIMA_PP_CONTROL_SYNC)
+			stats->syncs++;
+		if (control & LIMA_PP_FIELD_VARYING)
+			stats->varying_fetches++;
+		if (control & LIMA_PP_FIELD_SAMPLER)
+			stats->texture_fetches++;
+		if (control & LIMA_PP_FIELD_UNIFORM)
+			stats->uniform_fetches++;
+		if (control & LIMA_PP_FIELD_TEMP_WRITE)
+			stats->temporary_writes++;
+		if (control & LIMA_PP_FIELD_BRANCH)
+			stats->branches++;
+
+		if (control & LIMA_PP_CONTROL_STOP)
+			break;
+
+		offset += LIMA_PP_CONTROL_SIZE(control);
+	}
+
+	stats->cycles = stats->instructions +
+		LIMA_PP_VARYING_COST * stats->varying_fetches +
+		LIMA_PP_TEXTURE_COST * stats->texture_fetches +
+		LIMA_PP_UNIFORM_COST * stats->uniform_fetches +
+		LIMA_PP_SYNC_COST * stats->syncs +
+		LIMA_PP_BRANCH_COST * stats->branches;
+}
+
+#endif /* LIMA_SHADER_STATS_H */
@@ -50,58 +50,341 @@
 #include "texture.h"
 #include "program.h"
 
-int
-vs_command_queue_create(struct limare_frame *frame, int size)
+/*
+ * Command queues are built from chunks of frame memory. When a chunk runs
+ * out, a fresh one gets allocated and the old one jumps to it through a
+ * CONTINUE command. The last slot of every chunk is therefore kept free.
+ */
+static int
+command_chunk_create(struct limare_frame *frame, int size,
+		     struct lima_cmd **address, int *physical)
 {
 	size = ALIGN(size, 0x40);
 
-	if ((frame->mem_size - frame->mem_used) < size) {
+	if ((frame->mem_size - frame->mem_used) < size)
+		return -1;
+
+	*address = frame->mem_address + frame->mem_used;
+	*physical = frame->mem_physical + frame->mem_used;
+	frame->mem_used += size;
+
+	return size / 8;
+}
+
+int
+vs_command_queue_create(struct limare_frame *frame, int size)
+{
+	frame->vs_commands_size =
+		command_chunk_create(frame, size, &frame->vs_commands,
+				     &frame->vs_commands_physical);
+	if (frame->vs_commands_size < 0) {
 		printf("%s: no space for vs queue\n", __func__);
 		return -1;
 	}
 
-	frame->vs_commands = frame->mem_address + frame->mem_used;
-	frame->vs_commands_physical = frame->mem_physical + frame->mem_used;
+	frame->vs_commands_start = frame->vs_commands_physical;
 	frame->vs_commands_count = 0;
-	frame->vs_commands_size = size / 8;
+	frame->vs_commands_chunk_size = size;
 
-	frame->mem_used += size;
+	return 0;
+}
+
+/*
+ * Remembers the freshly built queues, so that the next frame in this slot
+ * can rewind to them instead of emitting the plbu preamble again.
+ */
+void
+command_queues_skeleton_save(struct limare_frame *frame)
+{
+	frame->skeleton.vs_commands_size = frame->vs_commands_size;
+	frame->skeleton.plbu_commands_size = frame->plbu_commands_size;
+	frame->skeleton.plbu_commands_count = frame->plbu_commands_count;
+	memcpy(frame->skeleton.plbu_shadow, frame->plbu_shadow,
+	       sizeof(frame->plbu_shadow));
+	frame->skeleton.plbu_shadow_valid = frame->plbu_shadow_valid;
+}
+
+void
+command_queues_skeleton_restore(struct limare_frame *frame)
+{
+	frame->vs_commands_physical = frame->vs_commands_start;
+	frame->vs_commands = frame->mem_address +
+		(frame->vs_commands_start - frame->mem_physical);
+	frame->vs_commands_count = 0;
+	frame->vs_commands_size = frame->skeleton.vs_commands_size;
+
+	frame->plbu_commands_physical = frame->plbu_commands_start;
+	frame->plbu_commands = frame->mem_address +
+		(frame->plbu_commands_start - frame->mem_physical);
+	frame->plbu_commands_count = frame->skeleton.plbu_commands_count;
+	frame->plbu_commands_size = frame->skeleton.plbu_commands_size;
+
+	memcpy(frame->plbu_shadow, frame->skeleton.plbu_shadow,
+	       sizeof(frame->plbu_shadow));
+	frame->plbu_shadow_valid = frame->skeleton.plbu_shadow_valid;
+}
+
+/*
+ * Returns room for count commands, to be followed by vs_commands_commit()
+ * with the number actually written.
+ */
+struct lima_cmd *
+vs_commands_reserve(struct limare_frame *frame, int count)
+{
+	struct lima_cmd *cmds;
+	int physical, size;
+
+	if ((frame->vs_commands_count + count) < frame->vs_commands_size)
+		return frame->vs_commands + frame->vs_commands_count;
+
+	size = frame->vs_commands_chunk_size;
+	if (size < (8 * (count + 1)))
+		size = 8 * (count + 1);
+
+	size = command_chunk_create(frame, size, &cmds, &physical);
+	if (size < 0) {
+		printf("%s: no space for vs commands\n", __func__);
+		return NULL;
+	}
+
+	frame->vs_commands[frame->vs_commands_count].val = physical;
+	frame->vs_commands[frame->vs_commands_count].cmd =
+		LIMA_VS_CMD_CONTINUE;
+
+	frame->vs_commands = cmds;
+	frame->vs_commands_physical = physical;
+	frame->vs_commands_count = 0;
+	frame->vs_commands_size = size;
+
+	return cmds;
+}
+
+void
+vs_commands_commit(struct limare_frame *frame, int count)
+{
+	frame->vs_commands_count += count;
+}
+
+/*
+ * A bare PLBU queue, without the frame setup preamble, for command lists.
+ */
+int
+plbu_command_list_create(struct limare_frame *frame, int size)
+{
+	frame->plbu_commands_size =
+		command_chunk_create(frame, size, &frame->plbu_commands,
+				     &frame->plbu_commands_physical);
+	if (frame->plbu_commands_size < 0) {
+		printf("%s: no space for plbu queue\n", __func__);
+		return -1;
+	}
+
+	frame->plbu_commands_start = frame->plbu_commands_physical;
+	frame->plbu_commands_count = 0;
+	frame->plbu_commands_chunk_size = size;
 
 	return 0;
 }
 
+struct lima_cmd *
+plbu_commands_reserve(struct limare_frame *frame, int count)
+{
+	struct lima_cmd *cmds;
+	int physical, size;
+
+	if ((frame->plbu_commands_count + count) < frame->plbu_commands_size)
+		return frame->plbu_commands + frame->plbu_commands_count;
+
+	size = frame->plbu_commands_chunk_size;
+	if (size < (8 * (count + 1)))
+		size = 8 * (count + 1);
+
+	size = command_chunk_create(frame, size, &cmds, &physical);
+	if (size < 0) {
+		printf("%s: no space for plbu commands\n", __func__);
+		return NULL;
+	}
+
+	frame->plbu_commands[frame->plbu_commands_count].val = physical;
+	frame->plbu_commands[frame->plbu_commands_count].cmd =
+		LIMA_PLBU_CMD_CONTINUE;
+
+	frame->plbu_commands = cmds;
+	frame->plbu_commands_physical = physical;
+	frame->plbu_commands_count = 0;
+	frame->plbu_commands_size = size;
+
+	return cmds;
+}
+
 void
+plbu_commands_commit(struct limare_frame *frame, int count)
+{
+	frame->plbu_commands_count += count;
+}
+
+/*
+ * Appends all commands queued in source to frame, following the CONTINUE
+ * links between the chunks of source.
+ */
+static int
+commands_copy(struct limare_frame *frame, struct limare_frame *source,
+	      int plbu)
+{
+	unsigned int next;
+	struct lima_cmd *src, *end, *dst;
+	int count;
+
+	if (plbu) {
+		next = LIMA_PLBU_CMD_CONTINUE;
+		src = source->mem_address +
+			(source->plbu_commands_start - source->mem_physical);
+		end = source->plbu_commands + source->plbu_commands_count;
+	} else {
+		next = LIMA_VS_CMD_CONTINUE;
+		src = source->mem_address +
+			(source->vs_commands_start - source->mem_physical);
+		end = source->vs_commands + source->vs_commands_count;
+	}
+
+	while (src != end) {
+		for (count = 0; ((src + count) != end) &&
+			     (src[count].cmd != next); count++)
+			;
+
+		if (plbu)
+			dst = plbu_commands_reserve(frame, count);
+		else
+			dst = vs_commands_reserve(frame, count);
+		if (!dst)
+			return -1;
+
+		memcpy(dst, src, count * sizeof(struct lima_cmd));
+
+		if (plbu)
+			plbu_commands_commit(frame, count);
+		else
+			vs_commands_commit(frame, count);
+
+		if ((src + count) == end)
+			break;
+
+		src = source->mem_address +
+			(src[count].val - source->mem_physical);
+	}
+
+	return 0;
+}
+
+int
+vs_commands_copy(struct limare_frame *frame, struct limare_frame *source)
+{
+	return commands_copy(frame, source, 0);
+}
+
+int
+plbu_commands_copy(struct limare_frame *frame, struct limare_frame *source)
+{
+	return commands_copy(frame, source, 1);
+}
+
+/*
+ * Writes a PLBU state command, unless the last one emitted for the same
+ * register in this frame was identical. Returns the number of commands
+ * written.
+ */
+static int
+plbu_state_emit(struct limare_frame *frame, struct lima_cmd *cmd,
+		int shadow, unsigned int val, unsigned int command)
+{
+	struct lima_cmd *last = &frame->plbu_shadow[shadow];
+
+	if ((frame->plbu_shadow_valid & (1 << shadow)) &&
+	    (last->val == val) && (last->cmd == command))
+		return 0;
+
+	cmd->val = val;
+	cmd->cmd = command;
+
+	*last = *cmd;
+	frame->plbu_shadow_valid |= 1 << shadow;
+
+	return 1;
+}
+
+/*
+ * Whether near or far differ from what was last emitted in this frame.
+ */
+static int
+plbu_depth_range_changed(struct limare_frame *frame, float near, float far)
+{
+	unsigned int valid = (1 << LIMARE_PLBU_SHADOW_DEPTH_RANGE_NEAR) |
+		(1 << LIMARE_PLBU_SHADOW_DEPTH_RANGE_FAR);
+
+	return ((frame->plbu_shadow_valid & valid) != valid) ||
+		(frame->plbu_shadow[LIMARE_PLBU_SHADOW_DEPTH_RANGE_NEAR].val !=
+		 from_float(near)) ||
+		(frame->plbu_shadow[LIMARE_PLBU_SHADOW_DEPTH_RANGE_FAR].val !=
+		 from_float(far));
+}
+
+/*
+ * Always writes both values, as the blob does. The unknown 0x1000010A
+ * command that accompanies them is left to the callers, which keep the
+ * order the blob uses for each case.
+ */
+static int
+plbu_depth_range_emit(struct limare_frame *frame, struct lima_cmd *cmds,
+		      float near, float far)
+{
+	int i = 0;
+
+	frame->plbu_shadow_valid &=
+		~((1 << LIMARE_PLBU_SHADOW_DEPTH_RANGE_NEAR) |
+		  (1 << LIMARE_PLBU_SHADOW_DEPTH_RANGE_FAR));
+
+	i += plbu_state_emit(frame, &cmds[i],
+			     LIMARE_PLBU_SHADOW_DEPTH_RANGE_NEAR,
+			     from_float(near), LIMA_PLBU_CMD_DEPTH_RANGE_NEAR);
+	i += plbu_state_emit(frame, &cmds[i],
+			     LIMARE_PLBU_SHADOW_DEPTH_RANGE_FAR,
+			     from_float(far), LIMA_PLBU_CMD_DEPTH_RANGE_FAR);
+
+	return i;
+}
+
+int
 plbu_viewport_set(struct limare_frame *frame,
 		  float x, float y, float w, float h)
 {
-	struct lima_cmd *cmds = frame->plbu_commands;
-	int i = frame->plbu_commands_count;
-
-	cmds[i].val = from_float(x);
-	cmds[i].cmd = LIMA_PLBU_CMD_VIEWPORT_X;
-	i++;
+	struct lima_cmd *cmds = plbu_commands_reserve(frame, 4);
+	int i = 0;
 
-	cmds[i].val = from_float(x + w);
-	cmds[i].cmd = LIMA_PLBU_CMD_VIEWPORT_W;
-	i++;
+	if (!cmds)
+		return -1;
 
-	cmds[i].val = from_float(y);
-	cmds[i].cmd = LIMA_PLBU_CMD_VIEWPORT_Y;
-	i++;
+	i += plbu_state_emit(frame, &cmds[i], LIMARE_PLBU_SHADOW_VIEWPORT_X,
+			     from_float(x), LIMA_PLBU_CMD_VIEWPORT_X);
+	i += plbu_state_emit(frame, &cmds[i], LIMARE_PLBU_SHADOW_VIEWPORT_W,
+			     from_float(x + w), LIMA_PLBU_CMD_VIEWPORT_W);
+	i += plbu_state_emit(frame, &cmds[i], LIMARE_PLBU_SHADOW_VIEWPORT_Y,
+			     from_float(y), LIMA_PLBU_CMD_VIEWPORT_Y);
+	i += plbu_state_emit(frame, &cmds[i], LIMARE_PLBU_SHADOW_VIEWPORT_H,
+			     from_float(y + h), LIMA_PLBU_CMD_VIEWPORT_H);
 
-	cmds[i].val = from_float(y + h);
-	cmds[i].cmd = LIMA_PLBU_CMD_VIEWPORT_H;
-	i++;
+	plbu_commands_commit(frame, i);
 
-	frame->plbu_commands_count = i;
+	return 0;
 }
 
-void
+static int
 plbu_scissor(struct limare_state *state, struct limare_frame *frame)
 {
-	struct lima_cmd *cmds = frame->plbu_commands;
-	int i = frame->plbu_commands_count;
-	int x, y, w, h;
+	struct lima_cmd *cmds = plbu_commands_reserve(frame, 1);
+	int x, y, w, h, i;
+
+	if (!cmds)
+		return -1;
 
 	if (state->scissor) {
 		x = state->scissor_x;
@@ -115,11 +398,14 @@ plbu_scissor(struct limare_state *state, struct limare_frame *frame)
 		h = state->viewport_h;
 	}
 
-	cmds[i].val = (x << 30) | (y + h - 1) << 15 | y;
-	cmds[i].cmd = LIMA_PLBU_CMD_SCISSORS |
-		(x + w  -1) << 13 | (x >> 2);
+	i = plbu_state_emit(frame, cmds, LIMARE_PLBU_SHADOW_SCISSORS,
+			    (x << 30) | (y + h - 1) << 15 | y,
+			    LIMA_PLBU_CMD_SCISSORS |
+			    (x + w  -1) << 13 | (x >> 2));
+
+	plbu_commands_commit(frame, i);
 
-	frame->plbu_commands_count++;
+	return 0;
 }
 
 int
@@ -130,10 +416,10 @@ plbu_command_queue_create(struct limare_state *state,
 	struct lima_cmd *cmds;
 	int i = 0;
 
-	size = ALIGN(size, 0x40);
 	heap_size = ALIGN(heap_size, 0x40);
 
-	if ((frame->mem_size - frame->mem_used) < (size + heap_size)) {
+	if ((frame->mem_size - frame->mem_used) <
+	    (ALIGN(size, 0x40) + heap_size)) {
 		printf("%s: no space for plbu queue and tile heap\n", __func__);
 		return -1;
 	}
@@ -142,17 +428,20 @@ plbu_command_queue_create(struct limare_state *state,
 	frame->tile_heap_size = heap_size;
 	frame->mem_used += heap_size;
 
-	frame->plbu_commands = frame->mem_address + frame->mem_used;
-	frame->plbu_commands_physical = frame->mem_physical + frame->mem_used;
+	frame->plbu_commands_size =
+		command_chunk_create(frame, size, &frame->plbu_commands,
+				     &frame->plbu_commands_physical);
+	frame->plbu_commands_start = frame->plbu_commands_physical;
 	frame->plbu_commands_count = 0;
-	frame->plbu_commands_size = size / 8;
-	frame->mem_used += size;
+	frame->plbu_commands_chunk_size = size;
 
-	cmds = frame->plbu_commands;
+	cmds = plbu_commands_reserve(frame, 5);
+	if (!cmds)
+		return -1;
 
-	cmds[i].val = 0x0000200;
-	cmds[i].cmd = LIMA_PLBU_CMD_PRIMITIVE_SETUP;
-	i++;
+	i += plbu_state_emit(frame, &cmds[i],
+			     LIMARE_PLBU_SHADOW_PRIMITIVE_SETUP,
+			     0x0000200, LIMA_PLBU_CMD_PRIMITIVE_SETUP);
 
 	cmds[i].val = plb->shift_w | (plb->shift_h << 16);
 	if (state->type == LIMARE_TYPE_M400)
@@ -177,11 +466,15 @@ plbu_command_queue_create(struct limare_state *state,
 	}
 	i++;
 
-	frame->plbu_commands_count = i;
+	plbu_commands_commit(frame, i);
 
-	plbu_viewport_set(frame, 0.0, 0.0, state->width, state->height);
+	if (plbu_viewport_set(frame, 0.0, 0.0, state->width, state->height))
+		return -1;
 
-	i = frame->plbu_commands_count;
+	cmds = plbu_commands_reserve(frame, 2);
+	if (!cmds)
+		return -1;
+	i = 0;
 
 	cmds[i].val = frame->mem_physical + frame->tile_heap_offset;
 	cmds[i].cmd = LIMA_PLBU_CMD_TILE_HEAP_START;
@@ -193,7 +486,7 @@ plbu_command_queue_create(struct limare_state *state,
 	cmds[i].cmd = LIMA_PLBU_CMD_TILE_HEAP_END;
 	i++;
 
-	frame->plbu_commands_count = i;
+	plbu_commands_commit(frame, i);
 
 	return 0;
 }
@@ -235,10 +528,22 @@ vs_info_setup(struct limare_state *state, struct limare_frame *frame,
 			return -1;
 		}
 
-		info->attribute_area = frame->mem_address + frame->mem_used;
-		info->attribute_area_size = 0x10 * sizeof(struct gp_common_entry);
-		info->attribute_area_offset = frame->mem_used;
-		frame->mem_used += ALIGN(info->attribute_area_size, 0x40);
+		if (draw->instance_first) {
+			struct vs_info *first = draw->instance_first->vs;
+
+			info->attribute_area = first->attribute_area;
+			info->attribute_area_size = first->attribute_area_size;
+			info->attribute_area_offset =
+				first->attribute_area_offset;
+		} else {
+			info->attribute_area =
+				frame->mem_address + frame->mem_used;
+			info->attribute_area_size =
+				0x10 * sizeof(struct gp_common_entry);
+			info->attribute_area_offset = frame->mem_used;
+			frame->mem_used +=
+				ALIGN(info->attribute_area_size, 0x40);
+		}
 
 		info->varying_area = frame->mem_address + frame->mem_used;
 		info->varying_area_size = 0x10 * sizeof(struct gp_common_entry);
@@ -336,14 +641,17 @@ vs_info_attach_varyings(struct limare_program *program,
 	return 0;
 }
 
-void
+int
 vs_commands_draw_add(struct limare_state *state, struct limare_frame *frame,
 		     struct limare_program *program, struct draw_info *draw)
 {
 	struct vs_info *vs = draw->vs;
 	struct plbu_info *plbu = draw->plbu;
-	struct lima_cmd *cmds = frame->vs_commands;
-	int i = frame->vs_commands_count;
+	struct lima_cmd *cmds = vs_commands_reserve(frame, 12);
+	int i = 0;
+
+	if (!cmds)
+		return -1;
 
 	if (!plbu->indices_mem_physical) {
 		cmds[i].val = LIMA_VS_CMD_ARRAYS_SEMAPHORE_BEGIN_1;
@@ -355,21 +663,26 @@ vs_commands_draw_add(struct limare_state *state, struct limare_frame *frame,
 		i++;
 	}
 
-	cmds[i].val = program->mem_physical + program->vertex_mem_offset;
-	cmds[i].cmd = LIMA_VS_CMD_SHADER_ADDRESS |
-		((program->vertex_shader_size / 16) << 16);
-	i++;
+	/* instances only need to update uniforms and varyings */
+	if (!draw->instance_first) {
+		cmds[i].val =
+			program->mem_physical + program->vertex_mem_offset;
+		cmds[i].cmd = LIMA_VS_CMD_SHADER_ADDRESS |
+			((program->vertex_shader_size / 16) << 16);
+		i++;
 
-	cmds[i].val = (program->vertex_attribute_prefetch - 1) << 20;
-	cmds[i].val |= ((ALIGN(program->vertex_shader_size, 16) / 16) - 1)
-		<< 10;
-	cmds[i].cmd = LIMA_VS_CMD_SHADER_INFO;
-	i++;
+		cmds[i].val = (program->vertex_attribute_prefetch - 1) << 20;
+		cmds[i].val |=
+			((ALIGN(program->vertex_shader_size, 16) / 16) - 1)
+			<< 10;
+		cmds[i].cmd = LIMA_VS_CMD_SHADER_INFO;
+		i++;
 
-	cmds[i].val = (program->varying_map_count << 8) |
-		((vs->attribute_count - 1) << 24);
-	cmds[i].cmd = LIMA_VS_CMD_VARYING_ATTRIBUTE_COUNT;
-	i++;
+		cmds[i].val = (program->varying_map_count << 8) |
+			((vs->attribute_count - 1) << 24);
+		cmds[i].cmd = LIMA_VS_CMD_VARYING_ATTRIBUTE_COUNT;
+		i++;
+	}
 
 	cmds[i].val = frame->mem_physical + vs->uniform_offset;
 	cmds[i].cmd = LIMA_VS_CMD_UNIFORMS_ADDRESS |
@@ -382,10 +695,13 @@ vs_commands_draw_add(struct limare_state *state, struct limare_frame *frame,
 			(vs->common_size << 14);
 		i++;
 	} else if (state->type == LIMARE_TYPE_M400) {
-		cmds[i].val = frame->mem_physical + vs->attribute_area_offset;
-		cmds[i].cmd = LIMA_VS_CMD_ATTRIBUTES_ADDRESS |
-			(vs->attribute_count << 17);
-		i++;
+		if (!draw->instance_first) {
+			cmds[i].val =
+				frame->mem_physical + vs->attribute_area_offset;
+			cmds[i].cmd = LIMA_VS_CMD_ATTRIBUTES_ADDRESS |
+				(vs->attribute_count << 17);
+			i++;
+		}
 
 		cmds[i].val = frame->mem_physical + vs->varying_area_offset;
 		cmds[i].cmd = LIMA_VS_CMD_VARYINGS_ADDRESS |
@@ -415,7 +731,9 @@ vs_commands_draw_add(struct limare_state *state, struct limare_frame *frame,
 	i++;
 
 	/* update our size so we can set the gp job properly */
-	frame->vs_commands_count = i;
+	vs_commands_commit(frame, i);
+
+	return 0;
 }
 
 void
@@ -430,7 +748,9 @@ vs_info_finalize(struct limare_state *state, struct limare_frame *frame,
 			struct symbol *symbol = info->attributes[i];
 
 			info->common->attributes[i].physical =
-				symbol->mem_physical;
+				symbol->mem_physical +
+				(symbol->entry_stride *
+				 (draw->vertex_base + draw->vertex_start));
 			info->common->attributes[i].size =
 				(symbol->entry_stride << 11) |
 				(symbol->component_type << 2) |
@@ -457,17 +777,21 @@ vs_info_finalize(struct limare_state *state, struct limare_frame *frame,
 		}
 
 	} else if (state->type == LIMARE_TYPE_M400) {
-		for (i = 0; i < info->attribute_count; i++) {
-			struct symbol *symbol = info->attributes[i];
-
-
-			info->attribute_area[i].physical =
-				symbol->mem_physical +
-				(symbol->entry_stride * draw->vertex_start);
-			info->attribute_area[i].size =
-				(symbol->entry_stride << 11) |
-				(symbol->component_type << 2) |
-				(symbol->component_count - 1);
+		/* instances share the attribute area of the first draw */
+		if (!draw->instance_first) {
+			for (i = 0; i < info->attribute_count; i++) {
+				struct symbol *symbol = info->attributes[i];
+
+				info->attribute_area[i].physical =
+					symbol->mem_physical +
+					(symbol->entry_stride *
+					 (draw->vertex_base +
+					  draw->vertex_start));
+				info->attribute_area[i].size =
+					(symbol->entry_stride << 11) |
+					(symbol->component_type << 2) |
+					(symbol->component_count - 1);
+			}
 		}
 
 		for (i = 0; i < program->varying_map_count; i++) {
@@ -491,14 +815,18 @@ vs_info_finalize(struct limare_state *state, struct limare_frame *frame,
 	}
 }
 
-void
+int
 plbu_commands_draw_add(struct limare_state *state, struct limare_frame *frame,
 		       struct draw_info *draw)
 {
 	struct plbu_info *plbu = draw->plbu;
 	struct vs_info *vs = draw->vs;
-	struct lima_cmd *cmds = frame->plbu_commands;
-	int i = frame->plbu_commands_count;
+	struct lima_cmd *cmds = plbu_commands_reserve(frame, 3);
+	unsigned int primitive;
+	int i = 0;
+
+	if (!cmds)
+		return -1;
 
 	/*
 	 *
@@ -509,66 +837,72 @@ plbu_commands_draw_add(struct limare_state *state, struct limare_frame *frame,
 		i++;
 	}
 
-	cmds[i].val = LIMA_PLBU_CMD_PRIMITIVE_GLES2 | 0x0000200;
+	primitive = LIMA_PLBU_CMD_PRIMITIVE_GLES2 | 0x0000200;
 	if (plbu->indices_mem_physical) {
 		if (plbu->indices_type == GL_UNSIGNED_SHORT)
-			cmds[i].val |= LIMA_PLBU_CMD_PRIMITIVE_INDEX_SHORT;
+			primitive |= LIMA_PLBU_CMD_PRIMITIVE_INDEX_SHORT;
 		else
-			cmds[i].val |= LIMA_PLBU_CMD_PRIMITIVE_INDEX_BYTE;
+			primitive |= LIMA_PLBU_CMD_PRIMITIVE_INDEX_BYTE;
 	}
 	if (state->culling) {
 		if (state->cull_front_cw) {
 			if (state->cull_front)
-				cmds[i].val |= LIMA_PLBU_CMD_PRIMITIVE_CULL_CW;
+				primitive |= LIMA_PLBU_CMD_PRIMITIVE_CULL_CW;
 			if (state->cull_back)
-				cmds[i].val |= LIMA_PLBU_CMD_PRIMITIVE_CULL_CCW;
+				primitive |= LIMA_PLBU_CMD_PRIMITIVE_CULL_CCW;
 		} else {
 			if (state->cull_front)
-				cmds[i].val |= LIMA_PLBU_CMD_PRIMITIVE_CULL_CCW;
+				primitive |= LIMA_PLBU_CMD_PRIMITIVE_CULL_CCW;
 			if (state->cull_back)
-				cmds[i].val |= LIMA_PLBU_CMD_PRIMITIVE_CULL_CW;
+				primitive |= LIMA_PLBU_CMD_PRIMITIVE_CULL_CW;
 		}
 	}
 
-	cmds[i].cmd = LIMA_PLBU_CMD_PRIMITIVE_SETUP;
-	i++;
+	i += plbu_state_emit(frame, &cmds[i],
+			     LIMARE_PLBU_SHADOW_PRIMITIVE_SETUP,
+			     primitive, LIMA_PLBU_CMD_PRIMITIVE_SETUP);
 
 	cmds[i].val = frame->mem_physical + plbu->render_state_offset;
 	cmds[i].cmd = LIMA_PLBU_CMD_RSW_VERTEX_ARRAY;
 	cmds[i].cmd |= (frame->mem_physical + vs->gl_Position_offset) >> 4;
 	i++;
 
-	frame->plbu_commands_count = i;
+	plbu_commands_commit(frame, i);
 
 	/* original mali driver also flushes depth in this case. */
 	if (state->viewport_dirty && state->scissor_dirty)
 		state->depth_dirty = 1;
 
 	if (state->viewport_dirty) {
-		plbu_viewport_set(frame, state->viewport_x, state->viewport_y,
-				  state->viewport_w, state->viewport_h);
+		if (plbu_viewport_set(frame, state->viewport_x,
+				      state->viewport_y, state->viewport_w,
+				      state->viewport_h))
+			return -1;
 		state->viewport_dirty = 0;
 	}
 
 	if (state->scissor_dirty) {
-		plbu_scissor(state, frame);
+		if (plbu_scissor(state, frame))
+			return -1;
 		state->scissor_dirty = 0;
 	}
 
-	i = frame->plbu_commands_count;
-	if (state->depth_dirty) {
-		cmds[i].val = 0x00000000;
-		cmds[i].cmd = 0x1000010a;
-		i++;
-
-		cmds[i].val = from_float(state->depth_near);
-		cmds[i].cmd = LIMA_PLBU_CMD_DEPTH_RANGE_NEAR;
-		i++;
-
-		cmds[i].val = from_float(state->depth_far);
-		cmds[i].cmd = LIMA_PLBU_CMD_DEPTH_RANGE_FAR;
-		i++;
+	cmds = plbu_commands_reserve(frame, 7);
+	if (!cmds)
+		return -1;
+	i = 0;
 
+	if (state->depth_dirty) {
+		if (plbu_depth_range_changed(frame, state->depth_near,
+					     state->depth_far)) {
+			cmds[i].val = 0x00000000;
+			cmds[i].cmd = 0x1000010a;
+			i++;
+
+			i += plbu_depth_range_emit(frame, &cmds[i],
+						   state->depth_near,
+						   state->depth_far);
+		}
 		state->depth_dirty = 0;
 	}
 
@@ -600,50 +934,53 @@ plbu_commands_draw_add(struct limare_state *state, struct limare_frame *frame,
 	}
 
 	/* update our size so we can set the gp job properly */
-	frame->plbu_commands_count = i;
+	plbu_commands_commit(frame, i);
+
+	return 0;
 }
 
-void
+int
 plbu_commands_depth_buffer_clear_draw_add(struct limare_state *state,
 					  struct limare_frame *frame,
 					  struct draw_info *draw, unsigned int
 					  varying_vertices_physical)
 {
 	struct plbu_info *plbu = draw->plbu;
-	struct lima_cmd *cmds = frame->plbu_commands;
-	int i;
+	struct lima_cmd *cmds;
+	int i = 0;
 
-	plbu_viewport_set(frame, 0.0, 0.0, 4096.0, 4096.0);
+	if (plbu_viewport_set(frame, 0.0, 0.0, 4096.0, 4096.0))
+		return -1;
 	state->viewport_dirty = 1;
 
 	if (state->scissor_dirty) {
-		plbu_scissor(state, frame);
+		if (plbu_scissor(state, frame))
+			return -1;
 		state->scissor_dirty = 0;
 	}
 
-	i = frame->plbu_commands_count;
+	cmds = plbu_commands_reserve(frame, 8);
+	if (!cmds)
+		return -1;
 	cmds[i].val = frame->mem_physical + plbu->render_state_offset;
 	cmds[i].cmd = LIMA_PLBU_CMD_RSW_VERTEX_ARRAY;
 	cmds[i].cmd |= varying_vertices_physical >> 4;
 	i++;
 
-	cmds[i].val = 0x00000200;
-	cmds[i].cmd = LIMA_PLBU_CMD_PRIMITIVE_SETUP;
-	i++;
-
-	cmds[i].val = from_float(state->depth_near);
-	cmds[i].cmd = LIMA_PLBU_CMD_DEPTH_RANGE_NEAR;
-	i++;
-
-	cmds[i].val = from_float(state->depth_far);
-	cmds[i].cmd = LIMA_PLBU_CMD_DEPTH_RANGE_FAR;
-	i++;
+	i += plbu_state_emit(frame, &cmds[i],
+			     LIMARE_PLBU_SHADOW_PRIMITIVE_SETUP,
+			     0x00000200, LIMA_PLBU_CMD_PRIMITIVE_SETUP);
 
-	cmds[i].val = 0x00000000;
-	cmds[i].cmd = 0x1000010a;
-	i++;
+	/* depth range is shadowed, so there is no need to dirty it again. */
+	if (plbu_depth_range_changed(frame, state->depth_near,
+				     state->depth_far)) {
+		i += plbu_depth_range_emit(frame, &cmds[i], state->depth_near,
+					   state->depth_far);
 
-	state->depth_dirty = 1;
+		cmds[i].val = 0x00000000;
+		cmds[i].cmd = 0x1000010a;
+		i++;
+	}
 
 	cmds[i].val = plbu->indices_mem_physical;
 	cmds[i].cmd = LIMA_PLBU_CMD_INDICES;
@@ -659,10 +996,15 @@ plbu_commands_depth_buffer_clear_draw_add(struct limare_state *state,
 	i++;
 
 	/* update our size so we can set the gp job properly */
-	frame->plbu_commands_count = i;
+	plbu_commands_commit(frame, i);
+
+	return 0;
 }
 
 
+/*
+ * This always fits, as the slot kept free for CONTINUE is used instead.
+ */
 void
 plbu_commands_finish(struct limare_frame *frame)
 {
@@ -827,12 +1169,61 @@ plbu_info_attach_textures(struct limare_state *state,
 	return 0;
 }
 
+static struct draw_info *
+draw_info_alloc(struct limare_frame *frame)
+{
+	struct draw_info_block *block = frame->draw_block;
+	struct draw_info *draw;
+
+	if (!block || (frame->draw_block_used == DRAW_INFO_BLOCK_SIZE)) {
+		struct draw_info_block *next =
+			block ? block->next : frame->draw_blocks;
+
+		if (!next) {
+			next = malloc(sizeof(struct draw_info_block));
+			if (!next) {
+				printf("%s: Error: failed to allocate draws: "
+				       "%s\n", __func__, strerror(errno));
+				return NULL;
+			}
+			next->next = NULL;
+
+			if (block)
+				block->next = next;
+			else
+				frame->draw_blocks = next;
+		}
+
+		block = next;
+		frame->draw_block = block;
+		frame->draw_block_used = 0;
+	}
+
+	draw = &block->draws[frame->draw_block_used];
+	frame->draw_block_used++;
+
+	memset(draw, 0, sizeof(struct draw_info));
+
+	return draw;
+}
+
+void
+draw_info_blocks_free(struct draw_info_block *block)
+{
+	struct draw_info_block *next;
+
+	for (; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+}
+
 struct draw_info *
 draw_create_new(struct limare_state *state, struct limare_frame *frame,
 		int draw_mode, int attributes_vertex_count, int vertex_start,
 		int vertex_count)
 {
-	struct draw_info *draw = calloc(1, sizeof(struct draw_info));
+	struct draw_info *draw = draw_info_alloc(frame);
 
 	if (!draw)
 		return NULL;
@@ -844,16 +1235,39 @@ draw_create_new(struct limare_state *state, struct limare_frame *frame,
 	draw->vertex_start = vertex_start;
 	draw->vertex_count = vertex_count;
 
-	if (vs_info_setup(state, frame, draw)) {
-		free(draw);
+	/* the slot is only handed back when the frame is reset */
+	if (vs_info_setup(state, frame, draw))
 		return NULL;
-	}
 
 	return draw;
 }
 
-void
-draw_info_destroy(struct draw_info *draw)
+/*
+ * Creates a further instance of first, which shares its vertex count,
+ * attributes and shader setup.
+ */
+struct draw_info *
+draw_create_instance(struct limare_state *state, struct limare_frame *frame,
+		     struct draw_info *first)
 {
-	free(draw);
+	struct draw_info *draw = draw_info_alloc(frame);
+
+	if (!draw)
+		return NULL;
+
+	draw->draw_mode = first->draw_mode;
+
+	draw->attributes_vertex_count = first->attributes_vertex_count;
+
+	draw->vertex_start = first->vertex_start;
+	draw->vertex_base = first->vertex_base;
+	draw->vertex_count = first->vertex_count;
+
+	draw->instance_first = first;
+
+	if (vs_info_setup(state, frame, draw))
+		return NULL;
+
+	return draw;
 }
+
@@ -72,10 +72,10 @@ int vs_info_attach_attribute(struct limare_frame *frame,
 int vs_info_attach_varyings(struct limare_program *program,
 			    struct limare_frame *frame, struct draw_info *draw);
 
-void vs_commands_draw_add(struct limare_state *state,
-			  struct limare_frame *frame,
-			  struct limare_program *program,
-			  struct draw_info *draw);
+int vs_commands_draw_add(struct limare_state *state,
+			 struct limare_frame *frame,
+			 struct limare_program *program,
+			 struct draw_info *draw);
 void vs_info_finalize(struct limare_state *state, struct limare_frame *frame,
 		      struct limare_program *program,
 		      struct draw_info *draw, struct vs_info *info);
@@ -96,19 +96,31 @@ struct plbu_info {
 };
 
 int vs_command_queue_create(struct limare_frame *frame, int size);
+void command_queues_skeleton_save(struct limare_frame *frame);
+void command_queues_skeleton_restore(struct limare_frame *frame);
+struct lima_cmd *vs_commands_reserve(struct limare_frame *frame, int count);
+void vs_commands_commit(struct limare_frame *frame, int count);
+struct lima_cmd *plbu_commands_reserve(struct limare_frame *frame, int count);
+void plbu_commands_commit(struct limare_frame *frame, int count);
+
+int plbu_command_list_create(struct limare_frame *frame, int size);
+int vs_commands_copy(struct limare_frame *frame, struct limare_frame *source);
+int plbu_commands_copy(struct limare_frame *frame,
+		       struct limare_frame *source);
+
 int plbu_command_queue_create(struct limare_state *state,
 			      struct limare_frame *frame,
 			      int size, int heap_size);
 
-void plbu_viewport_set(struct limare_frame *frame,
-		       float x, float y, float w, float h);
+int plbu_viewport_set(struct limare_frame *frame,
+		      float x, float y, float w, float h);
 
-void plbu_commands_draw_add(struct limare_state *state,
-			    struct limare_frame *frame, struct draw_info *draw);
-void plbu_commands_depth_buffer_clear_draw_add(struct limare_state *state,
-					       struct limare_frame *frame,
-					       struct draw_info *draw, unsigned
-					       int varying_vertices_physical);
+int plbu_commands_draw_add(struct limare_state *state,
+			   struct limare_frame *frame, struct draw_info *draw);
+int plbu_commands_depth_buffer_clear_draw_add(struct limare_state *state,
+					      struct limare_frame *frame,
+					      struct draw_info *draw, unsigned
+					      int varying_vertices_physical);
 void plbu_commands_finish(struct limare_frame *frame);
 
 int plbu_info_attach_uniforms(struct limare_frame *frame,
@@ -127,6 +139,8 @@ struct draw_info {
 	int attributes_vertex_count;
 
 	int vertex_start;
+	/* added to the indices of rebased 32 bit index batches. */
+	int vertex_base;
 	/* will be different from attribute when doing indexed draws */
 	int vertex_count;
 
@@ -134,6 +148,12 @@ struct draw_info {
 
 	struct plbu_info plbu[1];
 
+	/*
+	 * For the second and later instances of an instanced draw: the
+	 * draw which holds the shared shader and attribute setup.
+	 */
+	struct draw_info *instance_first;
+
 #define LIMARE_DRAW_TEXTURE_COUNT 8 /* per draw hw limit */
 	int texture_descriptor_count;
 	unsigned int texture_descriptor_list_offset;
@@ -145,6 +165,20 @@ struct draw_info *draw_create_new(struct limare_state *state,
 				  int draw_mode, int attribute_vertex_count,
 				  int vertex_start, int vertex_count);
 
-void draw_info_destroy(struct draw_info *draw);
+struct draw_info *draw_create_instance(struct limare_state *state,
+				       struct limare_frame *frame,
+				       struct draw_info *first);
+
+/*
+ * draw_info storage of a frame. The blocks stay with the frame slot and
+ * are reused by the next frame, rather than freed.
+ */
+#define DRAW_INFO_BLOCK_SIZE 64
+struct draw_info_block {
+	struct draw_info draws[DRAW_INFO_BLOCK_SIZE];
+	struct draw_info_block *next;
+};
+
+void draw_info_blocks_free(struct draw_info_block *block);
 
 #endif /* LIMARE_GP_H */
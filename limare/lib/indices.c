@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2013 Luc Verhaegen <libv@skynet.be>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Finding the lowest and highest index is a full pass over the indices
+ * for every client side indexed draw, so this uses NEON or SSE when the
+ * compiler target has them.
+ */
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define INDICES_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define INDICES_SSE2 1
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+#endif
+
+#include "indices.h"
+
+void
+indices_range_byte(const unsigned char *indices, int count,
+		   int *min, int *max)
+{
+	unsigned char low = 0xFF, high = 0;
+	int i = 0;
+
+	if (count <= 0) {
+		*min = 0;
+		*max = 0;
+		return;
+	}
+
+#if defined(INDICES_NEON) || defined(INDICES_SSE2)
+	if (count >= 16) {
+		unsigned char lows[16], highs[16];
+		int j;
+#ifdef INDICES_NEON
+		uint8x16_t vlow = vdupq_n_u8(0xFF), vhigh = vdupq_n_u8(0);
+
+		for (; (i + 16) <= count; i += 16) {
+			uint8x16_t v = vld1q_u8(indices + i);
+
+			vlow = vminq_u8(vlow, v);
+			vhigh = vmaxq_u8(vhigh, v);
+		}
+
+		vst1q_u8(lows, vlow);
+		vst1q_u8(highs, vhigh);
+#else
+		__m128i vlow = _mm_set1_epi8(0xFF), vhigh = _mm_setzero_si128();
+
+		for (; (i + 16) <= count; i += 16) {
+			__m128i v = _mm_loadu_si128((__m128i *) (indices + i));
+
+			vlow = _mm_min_epu8(vlow, v);
+			vhigh = _mm_max_epu8(vhigh, v);
+		}
+
+		_mm_storeu_si128((__m128i *) lows, vlow);
+		_mm_storeu_si128((__m128i *) highs, vhigh);
+#endif
+		for (j = 0; j < 16; j++) {
+			if (lows[j] < low)
+				low = lows[j];
+			if (highs[j] > high)
+				high = highs[j];
+		}
+	}
+#endif
+
+	for (; i < count; i++) {
+		if (indices[i] < low)
+			low = indices[i];
+		if (indices[i] > high)
+			high = indices[i];
+	}
+
+	*min = low;
+	*max = high;
+}
+
+void
+indices_range_short(const unsigned short *indices, int count,
+		    int *min, int *max)
+{
+	unsigned short low = 0xFFFF, high = 0;
+	int i = 0;
+
+	if (count <= 0) {
+		*min = 0;
+		*max = 0;
+		return;
+	}
+
+#if defined(INDICES_NEON) || defined(INDICES_SSE2)
+	if (count >= 8) {
+		unsigned short lows[8], highs[8];
+		int j;
+#ifdef INDICES_NEON
+		uint16x8_t vlow = vdupq_n_u16(0xFFFF), vhigh = vdupq_n_u16(0);
+
+		for (; (i + 8) <= count; i += 8) {
+			uint16x8_t v = vld1q_u16(indices + i);
+
+			vlow = vminq_u16(vlow, v);
+			vhigh = vmaxq_u16(vhigh, v);
+		}
+
+		vst1q_u16(lows, vlow);
+		vst1q_u16(highs, vhigh);
+#else
+		/* sse2 only has signed 16bit min/max, so bias by 0x8000. */
+		__m128i bias = _mm_set1_epi16(0x8000);
+		__m128i vlow = _mm_set1_epi16(0x7FFF);
+		__m128i vhigh = _mm_set1_epi16(0x8000);
+
+		for (; (i + 8) <= count; i += 8) {
+			__m128i v = _mm_loadu_si128((__m128i *) (indices + i));
+
+			v = _mm_xor_si128(v, bias);
+			vlow = _mm_min_epi16(vlow, v);
+			vhigh = _mm_max_epi16(vhigh, v);
+		}
+
+		_mm_storeu_si128((__m128i *) lows, _mm_xor_si128(vlow, bias));
+		_mm_storeu_si128((__m128i *) highs, _mm_xor_si128(vhigh, bias));
+#endif
+		for (j = 0; j < 8; j++) {
+			if (lows[j] < low)
+				low = lows[j];
+			if (highs[j] > high)
+				high = highs[j];
+		}
+	}
+#endif
+
+	for (; i < count; i++) {
+		if (indices[i] < low)
+			low = indices[i];
+		if (indices[i] > high)
+			high = indices[i];
+	}
+
+	*min = low;
+	*max = high;
+}
+
+void
+indices_range_int(const unsigned int *indices, int count,
+		  unsigned int *min, unsigned int *max)
+{
+	unsigned int low = 0xFFFFFFFF, high = 0;
+	int i = 0;
+
+	if (count <= 0) {
+		*min = 0;
+		*max = 0;
+		return;
+	}
+
+#if defined(INDICES_NEON) || defined(__SSE4_1__)
+	if (count >= 4) {
+		unsigned int lows[4], highs[4];
+		int j;
+#ifdef INDICES_NEON
+		uint32x4_t vlow = vdupq_n_u32(0xFFFFFFFF);
+		uint32x4_t vhigh = vdupq_n_u32(0);
+
+		for (; (i + 4) <= count; i += 4) {
+			uint32x4_t v = vld1q_u32(indices + i);
+
+			vlow = vminq_u32(vlow, v);
+			vhigh = vmaxq_u32(vhigh, v);
+		}
+
+		vst1q_u32(lows, vlow);
+		vst1q_u32(highs, vhigh);
+#else
+		__m128i vlow = _mm_set1_epi32(0xFFFFFFFF);
+		__m128i vhigh = _mm_setzero_si128();
+
+		for (; (i + 4) <= count; i += 4) {
+			__m128i v = _mm_loadu_si128((__m128i *) (indices + i));
+
+			vlow = _mm_min_epu32(vlow, v);
+			vhigh = _mm_max_epu32(vhigh, v);
+		}
+
+		_mm_storeu_si128((__m128i *) lows, vlow);
+		_mm_storeu_si128((__m128i *) highs, vhigh);
+#endif
+		for (j = 0; j < 4; j++) {
+			if (lows[j] < low)
+				low = lows[j];
+			if (highs[j] > high)
+				high = highs[j];
+		}
+	}
+#endif
+
+	for (; i < count; i++) {
+		if (indices[i] < low)
+			low = indices[i];
+		if (indices[i] > high)
+			high = indices[i];
+	}
+
+	*min = low;
+	*max = high;
+}
@@ -50,13 +50,17 @@
 static pthread_mutex_t gp_job_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t gp_job_cond = PTHREAD_COND_INITIALIZER;
 static unsigned int gp_job_done;
+static unsigned int gp_job_heap_current;
+static unsigned int gp_job_stalled;
+static unsigned int gp_job_stalled_cookie;
 
 static pthread_mutex_t pp_job_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t pp_job_cond = PTHREAD_COND_INITIALIZER;
 static unsigned int pp_job_done;
+static unsigned int pp_job_perf_counter[2];
 
 static void
-limare_gp_job_done(unsigned int id)
+limare_gp_job_done(unsigned int id, unsigned int heap_current)
 {
 	int ret;
 
@@ -66,6 +70,7 @@ limare_gp_job_done(unsigned int id)
 		       strerror(ret));
 
         gp_job_done = id;
+	gp_job_heap_current = heap_current;
 
         pthread_cond_broadcast(&gp_job_cond);
 
@@ -75,10 +80,81 @@ limare_gp_job_done(unsigned int id)
 		       strerror(ret));
 }
 
+/*
+ * The plbu ran out of tile heap, the render thread decides what happens.
+ */
+static void
+limare_gp_job_stalled(unsigned int id, unsigned int cookie)
+{
+	pthread_mutex_lock(&gp_job_mutex);
+
+	gp_job_stalled = id;
+	gp_job_stalled_cookie = cookie;
+
+	pthread_cond_broadcast(&gp_job_cond);
+
+	pthread_mutex_unlock(&gp_job_mutex);
+}
+
+/*
+ * Hand a stalled gp job the free frame memory as extra tile heap, and
+ * abort it when there is none left.
+ */
 static void
+limare_gp_job_heap_extend(struct limare_state *state,
+			  struct limare_frame *frame, unsigned int cookie)
+{
+	_mali_uk_gp_suspend_response_s response = { 0 };
+	int size, request, ret;
+
+	/* keep some room for the pp stacks */
+	size = frame->mem_size - frame->mem_used - 0x1000;
+	if (size > (frame->tile_heap_size + frame->tile_heap_extra))
+		size = frame->tile_heap_size + frame->tile_heap_extra;
+	size &= ~0x3F;
+
+	frame->tile_heap_stalled = 1;
+
+	response.ctx = (void *) state->fd;
+	response.cookie = cookie;
+
+	if (size >= 0x1000) {
+		frame->tile_heap_extend_start =
+			frame->mem_physical + frame->mem_used;
+		frame->tile_heap_extend_end =
+			frame->tile_heap_extend_start + size;
+		frame->tile_heap_extra += size;
+		frame->mem_used += size;
+
+		response.code = _MALIGP_JOB_RESUME_WITH_NEW_HEAP;
+		response.arguments[0] = frame->tile_heap_extend_start;
+		response.arguments[1] = frame->tile_heap_extend_end;
+	} else {
+		printf("%s: Error: no memory left for tile heap, aborting "
+		       "frame %d\n", __func__, frame->id);
+		response.code = _MALIGP_JOB_ABORT;
+	}
+
+	if (state->kernel_version < MALI_DRIVER_VERSION_R3P0)
+		request = MALI_IOC_GP2_SUSPEND_RESPONSE_R2P1;
+	else
+		request = MALI_IOC_GP2_SUSPEND_RESPONSE_R3P0;
+
+	ret = ioctl(state->fd, request, &response);
+	if (ret == -1)
+		printf("%s: Error: failed to respond to gp stall: %s\n",
+		       __func__, strerror(errno));
+}
+
+/*
+ * Returns where the plbu stopped in the tile heap. Heap stalls of our
+ * job are handled here, in the render thread.
+ */
+static unsigned int
 limare_gp_job_wait(struct limare_frame *frame)
 {
 	unsigned int job_id = frame->id | 0x80000000;
+	unsigned int heap_current, cookie;
 	int ret;
 
 	ret = pthread_mutex_lock(&gp_job_mutex);
@@ -86,21 +162,38 @@ limare_gp_job_wait(struct limare_frame *frame)
 		printf("%s: error locking mutex: %s\n", __func__,
 		       strerror(ret));
 
-	while (gp_job_done < job_id)
+	while (gp_job_done < job_id) {
+		if (gp_job_stalled == job_id) {
+			gp_job_stalled = 0;
+			cookie = gp_job_stalled_cookie;
+
+			pthread_mutex_unlock(&gp_job_mutex);
+			limare_gp_job_heap_extend(frame->state, frame, cookie);
+			pthread_mutex_lock(&gp_job_mutex);
+			continue;
+		}
+
 		pthread_cond_wait(&gp_job_cond, &gp_job_mutex);
+	}
+	heap_current = gp_job_heap_current;
 
 	ret = pthread_mutex_unlock(&gp_job_mutex);
 	if (ret)
 		printf("%s: error unlocking mutex: %s\n", __func__,
 		       strerror(ret));
+
+	return heap_current;
 }
 
 static void
-limare_pp_job_done(unsigned int id)
+limare_pp_job_done(unsigned int id, unsigned int counter0,
+		   unsigned int counter1)
 {
 	pthread_mutex_lock(&pp_job_mutex);
 
         pp_job_done = id;
+	pp_job_perf_counter[0] = counter0;
+	pp_job_perf_counter[1] = counter1;
 
         pthread_cond_broadcast(&pp_job_cond);
 
@@ -117,6 +210,9 @@ limare_pp_job_wait(struct limare_frame *frame)
 	while (pp_job_done < job_id)
 		pthread_cond_wait(&pp_job_cond, &pp_job_mutex);
 
+	frame->pp_perf_counter[0] = pp_job_perf_counter[0];
+	frame->pp_perf_counter[1] = pp_job_perf_counter[1];
+
         pthread_mutex_unlock(&pp_job_mutex);
 }
 
@@ -149,6 +245,15 @@ limare_notification_thread(void *arg)
 			if ((wait.code.type & 0xFF) == 0x10)
 				break;
 
+			if (wait.code.type == _MALI_NOTIFICATION_GP_STALLED) {
+				_mali_uk_gp_job_suspended_s *suspended =
+					&wait.data.gp_job_suspended;
+
+				limare_gp_job_stalled(suspended->user_job_ptr,
+						      suspended->cookie);
+				continue;
+			}
+
 			printf("%s: %x: %x\n", __func__, wait.code.type,
 			       wait.data.gp_job_suspended.reason);
 		}
@@ -162,7 +267,9 @@ limare_notification_thread(void *arg)
 				       wait.data.pp_job_finished.user_job_ptr,
 				       status);
 
-			limare_pp_job_done(wait.data.pp_job_finished.user_job_ptr);
+			limare_pp_job_done(wait.data.pp_job_finished.user_job_ptr,
+					   wait.data.pp_job_finished.perf_counter0,
+					   wait.data.pp_job_finished.perf_counter1);
 		} else if (wait.code.type == _MALI_NOTIFICATION_GP_FINISHED) {
 			_mali_uk_job_status status =
 				wait.data.gp_job_finished.status;
@@ -170,7 +277,8 @@ limare_notification_thread(void *arg)
 			if (status != _MALI_UK_JOB_STATUS_END_SUCCESS)
 				printf("gp job returned 0x%08X\n", status);
 
-			limare_gp_job_done(wait.data.pp_job_finished.user_job_ptr);
+			limare_gp_job_done(wait.data.gp_job_finished.user_job_ptr,
+					   wait.data.gp_job_finished.heap_current_addr);
 		}
 	}
 
@@ -191,7 +299,8 @@ limare_gp_job_bench_start(struct timespec *start)
 	}
 }
 
-void
+/* returns the job time in usec. */
+long long
 limare_gp_job_bench_stop(struct timespec *start)
 {
 	struct timespec new = { 0 };
@@ -199,7 +308,7 @@ limare_gp_job_bench_stop(struct timespec *start)
 
 	if (clock_gettime(CLOCK_MONOTONIC, &new)) {
 		printf("Error: failed to get time: %s\n", strerror(errno));
-		return;
+		return 0;
 	}
 
 	total = (new.tv_sec - start->tv_sec) * 1000000;
@@ -208,6 +317,8 @@ limare_gp_job_bench_stop(struct timespec *start)
 	pthread_mutex_lock(&gp_job_time_mutex);
 	gp_job_time += total;
 	pthread_mutex_unlock(&gp_job_time_mutex);
+
+	return total;
 }
 
 static pthread_mutex_t pp_job_time_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -222,7 +333,8 @@ limare_pp_job_bench_start(struct timespec *start)
 	}
 }
 
-void
+/* returns the job time in usec. */
+long long
 limare_pp_job_bench_stop(struct timespec *start)
 {
 	struct timespec new = { 0 };
@@ -230,7 +342,7 @@ limare_pp_job_bench_stop(struct timespec *start)
 
 	if (clock_gettime(CLOCK_MONOTONIC, &new)) {
 		printf("Error: failed to get time: %s\n", strerror(errno));
-		return;
+		return 0;
 	}
 
 	total = (new.tv_sec - start->tv_sec) * 1000000;
@@ -239,6 +351,51 @@ limare_pp_job_bench_stop(struct timespec *start)
 	pthread_mutex_lock(&pp_job_time_mutex);
 	pp_job_time += total;
 	pthread_mutex_unlock(&pp_job_time_mutex);
+
+	return total;
+}
+
+static struct limare_pp_stats pp_job_stats;
+
+static void
+limare_pp_job_stats_add(struct limare_frame *frame)
+{
+	pthread_mutex_lock(&pp_job_time_mutex);
+	pp_job_stats.frames++;
+	pp_job_stats.time += frame->pp_time;
+	pp_job_stats.counter[0] += frame->pp_perf_counter[0];
+	pp_job_stats.counter[1] += frame->pp_perf_counter[1];
+	pthread_mutex_unlock(&pp_job_time_mutex);
+}
+
+void
+limare_pp_job_stats(struct limare_pp_stats *stats, int reset)
+{
+	pthread_mutex_lock(&pp_job_time_mutex);
+	*stats = pp_job_stats;
+	if (reset)
+		memset(&pp_job_stats, 0, sizeof(pp_job_stats));
+	pthread_mutex_unlock(&pp_job_time_mutex);
+}
+
+/*
+ * Fills in the perf_counter members of the pp job start ioctls.
+ */
+static void
+limare_pp_job_perf_counters(struct limare_state *state, unsigned int *flag,
+			    unsigned int *source0, unsigned int *source1)
+{
+	*flag = 0;
+
+	if (state->pp_perf_counter_source[0] >= 0) {
+		*flag |= _MALI_PERFORMANCE_COUNTER_FLAG_SRC0_ENABLE;
+		*source0 = state->pp_perf_counter_source[0];
+	}
+
+	if (state->pp_perf_counter_source[1] >= 0) {
+		*flag |= _MALI_PERFORMANCE_COUNTER_FLAG_SRC1_ENABLE;
+		*source1 = state->pp_perf_counter_source[1];
+	}
 }
 
 static int
@@ -293,10 +450,10 @@ limare_gp_job_start(struct limare_state *state, struct limare_frame *frame)
 	struct lima_gp_frame_registers frame_regs = { 0 };
 	int ret;
 
-	frame_regs.vs_commands_start = frame->vs_commands_physical;
+	frame_regs.vs_commands_start = frame->vs_commands_start;
 	frame_regs.vs_commands_end =
 		frame->vs_commands_physical + 8 * frame->vs_commands_count;
-	frame_regs.plbu_commands_start = frame->plbu_commands_physical;
+	frame_regs.plbu_commands_start = frame->plbu_commands_start;
 	frame_regs.plbu_commands_end =
 		frame->plbu_commands_physical + 8 * frame->plbu_commands_count;
 	frame_regs.tile_heap_start =
@@ -332,6 +489,10 @@ limare_m200_pp_job_start_direct(struct limare_state *state,
 	job.wb[0] = *wb_regs;
 	job.abort_id = 0;
 
+	limare_pp_job_perf_counters(state, &job.perf_counter_flag,
+				    &job.perf_counter_src0,
+				    &job.perf_counter_src1);
+
 	ret = ioctl(state->fd, LIMA_M200_PP_START_JOB, &job);
 	if (ret == -1) {
 		printf("%s: Error: failed to start job: %s\n",
@@ -359,6 +520,10 @@ limare_m400_pp_job_start_r2p1(struct limare_state *state,
 	job.wb[0] = *wb_regs;
 	job.abort_id = 0;
 
+	limare_pp_job_perf_counters(state, &job.perf_counter_flag,
+				    &job.perf_counter_src0,
+				    &job.perf_counter_src1);
+
 	ret = ioctl(state->fd, LIMA_M400_PP_START_JOB_R2P1, &job);
 	if (ret == -1) {
 		printf("%s: Error: failed to start job: %s\n",
@@ -389,7 +554,11 @@ limare_m400_pp_job_start_r3p0(struct limare_state *state,
 	memcpy(&job.addr_stack, addr_stack, 7 * 4);
 
 	job.wb0 = *wb_regs;
-	job.num_cores = state->pp_core_count;
+	job.num_cores = frame->pp_core_active;
+
+	limare_pp_job_perf_counters(state, &job.perf_counter_flag,
+				    &job.perf_counter_src0,
+				    &job.perf_counter_src1);
 
 	ret = ioctl(state->fd, LIMA_M400_PP_START_JOB_R3P0, &job);
 	if (ret == -1) {
@@ -421,7 +590,11 @@ limare_m400_pp_job_start_r3p1(struct limare_state *state,
 	memcpy(&job.addr_stack, addr_stack, 7 * 4);
 
 	job.wb0 = *wb_regs;
-	job.num_cores = state->pp_core_count;
+	job.num_cores = frame->pp_core_active;
+
+	limare_pp_job_perf_counters(state, &job.perf_counter_flag,
+				    &job.perf_counter_src0,
+				    &job.perf_counter_src1);
 
 	ret = ioctl(state->fd, LIMA_M400_PP_START_JOB_R3P0, &job);
 	if (ret == -1) {
@@ -453,10 +626,14 @@ limare_m400_pp_job_start_r3p2(struct limare_state *state,
 	memcpy(&job.addr_stack, addr_stack, 7 * 4);
 
 	job.wb0 = *wb_regs;
-	job.num_cores = state->pp_core_count;
+	job.num_cores = frame->pp_core_active;
 	job.fence = -1;
 	job.stream = -1;
 
+	limare_pp_job_perf_counters(state, &job.perf_counter_flag,
+				    &job.perf_counter_src0,
+				    &job.perf_counter_src1);
+
 	ret = ioctl(state->fd, LIMA_M400_PP_START_JOB_R3P0, &job);
 	if (ret == -1) {
 		printf("%s: Error: failed to start job: %s\n",
@@ -470,6 +647,7 @@ limare_m400_pp_job_start_r3p2(struct limare_state *state,
 static void
 limare_render_sequence(struct limare_state *state, struct limare_frame *frame)
 {
+	unsigned int heap_start, heap_current;
 	struct timespec start;
 
 	pthread_mutex_lock(&frame->mutex);
@@ -481,20 +659,42 @@ limare_render_sequence(struct limare_state *state, struct limare_frame *frame)
 
 	limare_gp_job_start(state, frame);
 
-	limare_gp_job_wait(frame);
-
-	limare_gp_job_bench_stop(&start);
+	heap_current = limare_gp_job_wait(frame);
+
+	frame->gp_time = limare_gp_job_bench_stop(&start);
+
+	heap_start = frame->mem_physical + frame->tile_heap_offset;
+	if (!frame->tile_heap_extra &&
+	    (heap_current >= heap_start) &&
+	    (heap_current <= (heap_start + frame->tile_heap_size)))
+		frame->tile_heap_used = heap_current - heap_start;
+	else if (frame->tile_heap_extra &&
+		 (heap_current >= frame->tile_heap_extend_start) &&
+		 (heap_current <= frame->tile_heap_extend_end))
+		frame->tile_heap_used = frame->tile_heap_size +
+			frame->tile_heap_extra -
+			(frame->tile_heap_extend_end - heap_current);
+	else
+		frame->tile_heap_used =
+			frame->tile_heap_size + frame->tile_heap_extra;
 
 	/*
 	 * Now we can work on the pp.
 	 */
 	limare_pp_job_bench_start(&start);
 
-	limare_pp_job_start(state, frame);
+	/* a frame without damaged tiles leaves the buffer as it is */
+	if (frame_plb_pp_balance(state, frame)) {
+		limare_pp_job_start(state, frame);
+
+		limare_pp_job_wait(frame);
+	}
+
+	frame->pp_time = limare_pp_job_bench_stop(&start);
 
-	limare_pp_job_wait(frame);
+	limare_pp_job_stats_add(frame);
 
-	limare_pp_job_bench_stop(&start);
+	frame_plb_fill_clear(state, frame);
 
         /* wait for display sync, and flip the current fb. */
 	limare_fb_flip(state, frame);
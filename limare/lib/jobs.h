@@ -67,4 +67,6 @@ void limare_jobs_end(struct limare_state *state);
 
 void limare_render_start(struct limare_frame *frame);
 
+void limare_pp_job_stats(struct limare_pp_stats *stats, int reset);
+
 #endif /* LIMARE_JOBS_H */
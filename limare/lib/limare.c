@@ -27,6 +27,7 @@
 #include <sys/ioctl.h>
 #include <asm/ioctl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <inttypes.h>
@@ -43,6 +44,9 @@
 
 #include "version.h"
 #include "limare.h"
+#include "indices.h"
+#include "vcache.h"
+#include "quantise.h"
 #include "fb.h"
 #include "plb.h"
 #include "gp.h"
@@ -50,6 +54,9 @@
 #include "jobs.h"
 #include "symbols.h"
 #include "compiler.h"
+#include "bundle.h"
+#include "fnv.h"
+#include "shader_stats.h"
 #include "texture.h"
 #include "hfloat.h"
 #include "program.h"
@@ -58,8 +65,13 @@
 #define FRAME_MEMORY_SIZE 0x400000
 #define AUX_MEMORY_SIZE 0x01000000
 #define FB_MEMORY_OFFSET 0x08000000
-#define COMMAND_BUFFER_SIZE 0x10000
+/* initial size, command queues grow in chunks of this size. */
+#define COMMAND_BUFFER_SIZE 0x4000
+#define COMMAND_LIST_BUFFER_SIZE 0x1000
 #define TILE_HEAP_SIZE 0x100000
+#define TILE_HEAP_SIZE_MIN 0x20000
+#define TILE_HEAP_SIZE_MAX (FRAME_MEMORY_SIZE / 2)
+#define TILE_HEAP_ADAPT_FRAMES 16
 
 static int
 limare_fd_open(struct limare_state *state)
@@ -304,6 +316,11 @@ limare_init(void)
 		goto error;
 	}
 
+	state->pp_perf_counter_source[0] = -1;
+	state->pp_perf_counter_source[1] = -1;
+
+	state->tile_heap_size = TILE_HEAP_SIZE;
+
 	ret = limare_fd_open(state);
 	if (ret)
 		goto error;
@@ -335,13 +352,11 @@ limare_init(void)
 void
 limare_frame_destroy(struct limare_frame *frame)
 {
-	int i;
-
 	if (!frame)
 		return;
 
-	for (i = 0; i < frame->draw_count; i++)
-		draw_info_destroy(frame->draws[i]);
+	draw_info_blocks_free(frame->draw_blocks);
+	free(frame->draws);
 
 	if (frame->pp)
 		pp_info_destroy(frame->pp);
@@ -351,16 +366,112 @@ limare_frame_destroy(struct limare_frame *frame)
 	free(frame);
 }
 
+static int
+frame_draw_add(struct limare_frame *frame, struct draw_info *draw)
+{
+	if (!draw)
+		return -1;
+
+	if (frame->draw_count == frame->draw_size) {
+		int size = frame->draw_size ? 2 * frame->draw_size : 64;
+		struct draw_info **draws =
+			realloc(frame->draws, size * sizeof(struct draw_info *));
+
+		if (!draws) {
+			printf("%s: Error: failed to grow draws: %s\n",
+			       __func__, strerror(errno));
+			return -1;
+		}
+
+		frame->draws = draws;
+		frame->draw_size = size;
+	}
+
+	frame->draws[frame->draw_count] = draw;
+	frame->draw_count++;
+
+	return 0;
+}
+
+/*
+ * Clears a frame for the next frame in its slot. The frame itself, its
+ * pp_info, draws array and draw_info blocks are kept, so that rendering
+ * in steady state does no heap allocations.
+ */
+static void
+limare_frame_reset(struct limare_frame *frame)
+{
+	struct limare_frame old = *frame;
+	int i;
+
+	pthread_mutex_destroy(&frame->mutex);
+	memset(frame, 0, sizeof(struct limare_frame));
+
+	frame->draw_blocks = old.draw_blocks;
+	frame->draws = old.draws;
+	frame->draw_size = old.draw_size;
+	frame->pp = old.pp;
+
+	if (!old.skeleton.plb)
+		return;
+
+	frame->skeleton = old.skeleton;
+
+	frame->mem_physical = old.mem_physical;
+	frame->mem_size = old.mem_size;
+	frame->mem_address = old.mem_address;
+
+	frame->plb_offset = old.plb_offset;
+	frame->plb_plbu_offset = old.plb_plbu_offset;
+	for (i = 0; i < LIMA_PP_CORE_MAX; i++) {
+		frame->plb_pp_offset[i] = old.plb_pp_offset[i];
+		frame->pp_tile_start[i] = old.pp_tile_start[i];
+	}
+	frame->pp_core_active = old.pp_core_active;
+	frame->pp_stream_partial = old.pp_stream_partial;
+
+	frame->tile_heap_offset = old.tile_heap_offset;
+	frame->tile_heap_size = old.tile_heap_size;
+
+	frame->vs_commands_start = old.vs_commands_start;
+	frame->vs_commands_chunk_size = old.vs_commands_chunk_size;
+	frame->plbu_commands_start = old.plbu_commands_start;
+	frame->plbu_commands_chunk_size = old.plbu_commands_chunk_size;
+}
+
+/*
+ * Whether the static area of a reused frame still matches our setup.
+ */
+static int
+frame_skeleton_valid(struct limare_state *state, struct limare_frame *frame,
+		     int offset, int size)
+{
+	return (frame->skeleton.plb == state->plb) &&
+		(frame->skeleton.width == state->width) &&
+		(frame->skeleton.height == state->height) &&
+		(frame->skeleton.pp_core_count == state->pp_core_count) &&
+		(frame->tile_heap_size == state->tile_heap_size) &&
+		(frame->mem_physical == (state->mem_base + offset)) &&
+		(frame->mem_size == size);
+}
+
+/*
+ * Sets up frame for reuse, or allocates a new one when frame is NULL.
+ */
 struct limare_frame *
-limare_frame_create(struct limare_state *state, int offset, int size)
+limare_frame_create(struct limare_state *state, struct limare_frame *frame,
+		    int offset, int size)
 {
-	struct limare_frame *frame;
 	pthread_mutexattr_t mattr;
 	int ret;
 
-	frame = calloc(1, sizeof(struct limare_frame));
-	if (!frame)
-		return NULL;
+	if (frame)
+		limare_frame_reset(frame);
+	else {
+		frame = calloc(1, sizeof(struct limare_frame));
+		if (!frame)
+			return NULL;
+	}
 
 	frame->id = state->frame_count;
 	frame->index = frame->id & 0x01;
@@ -377,6 +488,19 @@ limare_frame_create(struct limare_state *state, int offset, int size)
 		printf("%s: pthread_mutex_init failed: %s\n",
 		       __func__, strerror(ret));
 
+	if (frame->skeleton.plb &&
+	    frame_skeleton_valid(state, frame, offset, size)) {
+		frame->mem_used = frame->skeleton.mem_used;
+		frame->pp->clear_color = state->clear_color;
+		command_queues_skeleton_restore(frame);
+
+		state->viewport_dirty = 1;
+		state->depth_dirty = 1;
+
+		return frame;
+	}
+	memset(&frame->skeleton, 0, sizeof(frame->skeleton));
+
 	/* space for our programs and textures. */
 	frame->mem_size = size;
 	frame->mem_used = 0;
@@ -389,8 +513,7 @@ limare_frame_create(struct limare_state *state, int offset, int size)
 	}
 
 	/* now add the area for the pp, again, unchanged between draws. */
-	frame->pp = pp_info_create(state, frame);
-	if (!frame->pp) {
+	if (pp_info_setup(state, frame)) {
 		limare_frame_destroy(frame);
 		return NULL;
 	}
@@ -398,11 +521,18 @@ limare_frame_create(struct limare_state *state, int offset, int size)
 	/* now the two command queues */
 	if (vs_command_queue_create(frame, COMMAND_BUFFER_SIZE) ||
 	    plbu_command_queue_create(state, frame, COMMAND_BUFFER_SIZE,
-				      TILE_HEAP_SIZE)) {
+				      state->tile_heap_size)) {
 		limare_frame_destroy(frame);
 		return NULL;
 	}
 
+	frame->skeleton.plb = state->plb;
+	frame->skeleton.width = state->width;
+	frame->skeleton.height = state->height;
+	frame->skeleton.pp_core_count = state->pp_core_count;
+	frame->skeleton.mem_used = frame->mem_used;
+	command_queues_skeleton_save(frame);
+
 	state->viewport_dirty = 1;
 	state->depth_dirty = 1;
 
@@ -498,7 +628,8 @@ limare_state_setup(struct limare_state *state, int width, int height,
 
 	limare_state_init(state, clear_color);
 
-	state->plb = plb_info_create(state);
+	state->plb_block_limit = plb_block_limit_default(state);
+	state->plb = plb_info_create(state, state->plb_block_limit);
 	if (!state->plb)
 		return -1;
 
@@ -615,6 +746,219 @@ limare_attrib_type_size(enum limare_attrib_type type)
 	return 0;
 }
 
+static struct limare_uniform_block *
+limare_uniform_block_find(struct limare_state *state, int handle)
+{
+	int i;
+
+	for (i = 0; i < LIMARE_UNIFORM_BLOCK_COUNT; i++) {
+		struct limare_uniform_block *block = state->uniform_blocks[i];
+
+		if (block && (block->handle == handle))
+			return block;
+	}
+
+	return NULL;
+}
+
+int
+limare_uniform_block_new(struct limare_state *state)
+{
+	struct limare_uniform_block *block;
+	int i;
+
+	for (i = 0; i < LIMARE_UNIFORM_BLOCK_COUNT; i++)
+		if (!state->uniform_blocks[i])
+			break;
+
+	if (i == LIMARE_UNIFORM_BLOCK_COUNT) {
+		printf("%s: Error: no more uniform block slots available!\n",
+		       __func__);
+		return -1;
+	}
+
+	block = calloc(1, sizeof(struct limare_uniform_block));
+	if (!block) {
+		printf("%s: Error: failed to allocate uniform block: %s\n",
+		       __func__, strerror(errno));
+		return -1;
+	}
+
+	block->handle = 0x10000000 + state->uniform_block_handles;
+	state->uniform_block_handles++;
+	block->serial = 1;
+
+	state->uniform_blocks[i] = block;
+
+	return block->handle;
+}
+
+/*
+ * Copies the data into the block, so the caller is free to reuse its
+ * buffer. Every program the block is bound to picks up the new value on
+ * its next draw.
+ */
+int
+limare_uniform_block_set(struct limare_state *state, int handle,
+			 const char *name, int count, const float *data)
+{
+	struct limare_uniform_block *block =
+		limare_uniform_block_find(state, handle);
+	struct limare_uniform_block_entry *entry = NULL;
+	int i;
+
+	if (!block) {
+		printf("%s: unable to find uniform block with handle 0x%08X\n",
+		       __func__, handle);
+		return -1;
+	}
+
+	for (i = 0; i < block->entry_count; i++)
+		if (!strcmp(block->entries[i].name, name)) {
+			entry = &block->entries[i];
+			break;
+		}
+
+	if (entry && (entry->count != count)) {
+		printf("%s: Error: Uniform %s has wrong dimensions\n",
+		       __func__, name);
+		return -1;
+	}
+
+	if (!entry) {
+		if (block->entry_count == LIMARE_UNIFORM_BLOCK_ENTRY_COUNT) {
+			printf("%s: Error: uniform block is full!\n",
+			       __func__);
+			return -1;
+		}
+
+		entry = &block->entries[block->entry_count];
+		entry->name = strdup(name);
+		entry->data = malloc(count * sizeof(float));
+		entry->data_half = malloc(count * sizeof(hfloat));
+		if (!entry->name || !entry->data || !entry->data_half) {
+			printf("%s: Error: failed to allocate uniform %s: %s\n",
+			       __func__, name, strerror(errno));
+			free(entry->name);
+			free(entry->data);
+			free(entry->data_half);
+			memset(entry, 0, sizeof(*entry));
+			return -1;
+		}
+
+		entry->count = count;
+		block->entry_count++;
+	}
+
+	memcpy(entry->data, data, count * sizeof(float));
+	for (i = 0; i < count; i++)
+		entry->data_half[i] = float_to_hfloat(data[i]);
+
+	block->serial++;
+
+	return 0;
+}
+
+int
+limare_uniform_block_bind(struct limare_state *state, int handle)
+{
+	struct limare_program *program = state->program_current;
+	struct limare_uniform_block *block =
+		limare_uniform_block_find(state, handle);
+	int i;
+
+	if (!program) {
+		printf("%s: Error: no program is current\n", __func__);
+		return -1;
+	}
+
+	if (!block) {
+		printf("%s: unable to find uniform block with handle 0x%08X\n",
+		       __func__, handle);
+		return -1;
+	}
+
+	for (i = 0; i < program->uniform_block_count; i++)
+		if (program->uniform_blocks[i] == block)
+			return 0;
+
+	if (program->uniform_block_count ==
+	    LIMARE_PROGRAM_UNIFORM_BLOCK_COUNT) {
+		printf("%s: Error: program has too many uniform blocks!\n",
+		       __func__);
+		return -1;
+	}
+
+	program->uniform_blocks[i] = block;
+	program->uniform_block_serials[i] = 0;
+	program->uniform_block_count++;
+
+	return 0;
+}
+
+static int
+uniform_block_symbols_attach(struct limare_uniform_block_entry *entry,
+			     struct symbol **symbols, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		struct symbol *symbol = symbols[i];
+
+		if (strcmp(symbol->name, entry->name))
+			continue;
+
+		if (symbol->component_count != entry->count) {
+			printf("%s: Error: Uniform %s has wrong dimensions\n",
+			       __func__, entry->name);
+			return -1;
+		}
+
+		if (symbol->data && symbol->data_allocated)
+			free(symbol->data);
+
+		if (symbol->precision == 3)
+			symbol->data = entry->data;
+		else
+			symbol->data = entry->data_half;
+		symbol->data_allocated = 0;
+		return 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Points the program symbols straight at the block storage, but only when
+ * a block changed since this program last looked at it.
+ */
+static int
+limare_program_uniform_blocks_update(struct limare_program *program)
+{
+	int i, j;
+
+	for (i = 0; i < program->uniform_block_count; i++) {
+		struct limare_uniform_block *block = program->uniform_blocks[i];
+
+		if (program->uniform_block_serials[i] == block->serial)
+			continue;
+
+		for (j = 0; j < block->entry_count; j++) {
+			if (uniform_block_symbols_attach(&block->entries[j],
+					program->vertex_uniforms,
+					program->vertex_uniform_count) ||
+			    uniform_block_symbols_attach(&block->entries[j],
+					program->fragment_uniforms,
+					program->fragment_uniform_count))
+				return -1;
+		}
+
+		program->uniform_block_serials[i] = block->serial;
+	}
+
+	return 0;
+}
+
 int
 limare_attribute_pointer(struct limare_state *state, char *name,
 			 enum limare_attrib_type type, int component_count,
@@ -675,37 +1019,167 @@ limare_attribute_pointer(struct limare_state *state, char *name,
 	return 0;
 }
 
+/*
+ * Copies entries [first, first + count) into the frame, or the whole array
+ * when count is 0. mem_physical still points at where entry 0 would be, as
+ * the draw offsets it by the first index.
+ */
 static int
-attribute_upload(struct limare_frame *frame, struct symbol *symbol)
+attribute_upload(struct limare_frame *frame, struct symbol *symbol,
+		 int first, int count)
 {
+	int offset = symbol->entry_stride * first;
 	void *address;
 	int size;
 
-	size = ALIGN(symbol->size, 0x40);
+	if (!count || (offset >= symbol->size))
+		offset = 0;
 
-	if ((frame->mem_size - frame->mem_used) < size) {
+	size = symbol->size - offset;
+	if (count && ((symbol->entry_stride * count) < size))
+		size = symbol->entry_stride * count;
+
+	if ((frame->mem_size - frame->mem_used) < ALIGN(size, 0x40)) {
 		printf("%s: Not enough space for %s\n", __func__, symbol->name);
 		return -1;
 	}
 
 	address = frame->mem_address + frame->mem_used;
-	symbol->mem_physical = frame->mem_physical + frame->mem_used;
-	frame->mem_used += size;
+	symbol->mem_physical = frame->mem_physical + frame->mem_used - offset;
+	frame->mem_used += ALIGN(size, 0x40);
 
-	memcpy(address, symbol->data, symbol->size);
+	memcpy(address, symbol->data + offset, size);
 
 	return 0;
 }
 
-int
-limare_attribute_buffer_upload(struct limare_state *state,
-			       enum limare_attrib_type type,
-			       int component_count, int entry_stride,
-			       int entry_count, void *data)
+/*
+ * Finds the entry for this array, or takes over the least recently drawn
+ * one whose aux copy is no longer read by a frame in flight.
+ */
+static struct limare_attribute_cache *
+attribute_cache_get(struct limare_state *state, struct symbol *symbol,
+		    int frame_id)
+{
+	struct limare_attribute_cache *cache, *victim = NULL;
+	int i;
+
+	for (i = 0; i < LIMARE_ATTRIBUTE_CACHE_COUNT; i++) {
+		cache = &state->attribute_cache[i];
+
+		if ((cache->data == symbol->data) &&
+		    (cache->size == symbol->size))
+			return cache;
+
+		if (cache->mem_size &&
+		    ((frame_id - cache->frame_used) < FRAME_COUNT))
+			continue;
+
+		if (!victim || !cache->data ||
+		    (victim->data && (cache->frame_seen < victim->frame_seen)))
+			victim = cache;
+	}
+
+	if (victim) {
+		victim->data = symbol->data;
+		victim->size = symbol->size;
+		victim->frames = 0;
+		victim->promoted = 0;
+	}
+
+	return victim;
+}
+
+/*
+ * Moves an array into aux memory, if the aux copy is free and big enough
+ * or a new one fits in the cache budget.
+ */
+static int
+attribute_cache_promote(struct limare_state *state,
+			struct limare_attribute_cache *cache, int frame_id)
+{
+	int size = ALIGN(cache->size, 0x40);
+
+	if (cache->mem_size &&
+	    ((frame_id - cache->frame_used) < FRAME_COUNT))
+		return -1;
+
+	if (cache->mem_size < size) {
+		if (((state->attribute_cache_mem_used + size) >
+		     LIMARE_ATTRIBUTE_CACHE_MEMORY) ||
+		    ((state->aux_mem_size - state->aux_mem_used) < size))
+			return -1;
+
+		cache->mem_offset = state->aux_mem_used;
+		cache->mem_physical =
+			state->aux_mem_physical + state->aux_mem_used;
+		cache->mem_size = size;
+		state->aux_mem_used += size;
+		state->attribute_cache_mem_used += size;
+	}
+
+	memcpy(state->aux_mem_address + cache->mem_offset, cache->data,
+	       cache->size);
+	cache->promoted = 1;
+
+	return 0;
+}
+
+/*
+ * Client side attributes normally get copied into each frame, only the
+ * [first, first + count) range when count is set. Contents are hashed on
+ * every draw, as the client may change them at any time.
+ */
+static int
+attribute_cache_upload(struct limare_state *state,
+		       struct limare_frame *frame, struct symbol *symbol,
+		       int first, int count)
+{
+	struct limare_attribute_cache *cache;
+	unsigned int hash;
+
+	/* command lists keep their own snapshot */
+	if (frame->command_list)
+		return attribute_upload(frame, symbol, first, count);
+
+	cache = attribute_cache_get(state, symbol, frame->id);
+	if (!cache)
+		return attribute_upload(frame, symbol, first, count);
+
+	hash = lima_fnv_hash_words(LIMA_FNV_OFFSET, symbol->data,
+				   symbol->size);
+
+	if (!cache->frames || (cache->hash != hash)) {
+		cache->hash = hash;
+		cache->frames = 1;
+		cache->frame_seen = frame->id;
+		cache->promoted = 0;
+	} else if (cache->frame_seen != frame->id) {
+		cache->frames++;
+		cache->frame_seen = frame->id;
+	}
+
+	if (!cache->promoted &&
+	    ((cache->frames < LIMARE_ATTRIBUTE_CACHE_PROMOTE) ||
+	     attribute_cache_promote(state, cache, frame->id)))
+		return attribute_upload(frame, symbol, first, count);
+
+	cache->frame_used = frame->id;
+	symbol->mem_physical = cache->mem_physical;
+
+	return 0;
+}
+
+/*
+ * Takes a buffer slot and regions times the buffer size of aux memory.
+ */
+static struct limare_attribute_buffer *
+attribute_buffer_create(struct limare_state *state,
+			enum limare_attrib_type type, int component_count,
+			int entry_stride, int entry_count, int regions)
 {
 	struct limare_attribute_buffer *buffer;
 	int i, size, component_size;
-	void *address;
 
 	for (i = 0; i < LIMARE_ATTRIBUTE_BUFFER_COUNT; i++)
 		if (!state->attribute_buffers[i])
@@ -714,14 +1188,14 @@ limare_attribute_buffer_upload(struct limare_state *state,
 	if (i == LIMARE_ATTRIBUTE_BUFFER_COUNT) {
 		printf("%s: all attribute buffer slots have been taken!\n",
 		       __func__);
-		return -1;
+		return NULL;
 	}
 
 	buffer = calloc(1, sizeof(struct limare_attribute_buffer));
 	if (!buffer) {
 		printf("%s: Error: failed to allocate attribute buffer: %s\n",
 		       __func__, strerror(errno));
-		return -1;
+		return NULL;
 	}
 
 	component_size = limare_attrib_type_size(type);
@@ -734,16 +1208,15 @@ limare_attribute_buffer_upload(struct limare_state *state,
 	size = entry_stride * entry_count;
 	size = ALIGN(size, 0x40);
 
-	if ((state->aux_mem_size - state->aux_mem_used) < size) {
+	if ((state->aux_mem_size - state->aux_mem_used) < (regions * size)) {
 		printf("%s: Not enough space for buffer\n", __func__);
 		free(buffer);
-		return -1;
+		return NULL;
 	}
 
-	address = state->aux_mem_address + state->aux_mem_used;
 	buffer->mem_offset = state->aux_mem_used;
 	buffer->mem_physical = state->aux_mem_physical + state->aux_mem_used;
-	state->aux_mem_used += size;
+	state->aux_mem_used += regions * size;
 
 	buffer->component_type = type;
 	buffer->component_count = component_count;
@@ -753,40 +1226,102 @@ limare_attribute_buffer_upload(struct limare_state *state,
 	buffer->handle = 0x80000000 + state->attribute_buffer_handles;
 	state->attribute_buffer_handles++;
 
-	memcpy(address, data, size);
-
 	state->attribute_buffers[i] = buffer;
 
-	return buffer->handle;
+	return buffer;
 }
 
 int
-limare_attribute_buffer_attach(struct limare_state *state, char *name,
-			       int buffer_handle)
+limare_attribute_buffer_upload(struct limare_state *state,
+			       enum limare_attrib_type type,
+			       int component_count, int entry_stride,
+			       int entry_count, void *data)
 {
-	struct limare_program *program = state->program_current;
-	struct symbol *symbol = NULL;
 	struct limare_attribute_buffer *buffer;
-	int i;
-
-	for (i = 0; i < LIMARE_ATTRIBUTE_BUFFER_COUNT; i++) {
-		buffer = state->attribute_buffers[i];
-
-		if (!buffer)
-			continue;
-
-		if (buffer->handle == buffer_handle)
-			break;
-	}
 
-	if (i == LIMARE_ATTRIBUTE_BUFFER_COUNT) {
-		printf("%s: Error: Unable to find attribute buffer 0x%08X\n",
-		       __func__, buffer_handle);
+	buffer = attribute_buffer_create(state, type, component_count,
+					 entry_stride, entry_count, 1);
+	if (!buffer)
 		return -1;
-	}
 
-	for (i = 0; i < program->vertex_attribute_count; i++) {
-		symbol = program->vertex_attributes[i];
+	memcpy(state->aux_mem_address + buffer->mem_offset, data,
+	       buffer->entry_stride * buffer->entry_count);
+
+	return buffer->handle;
+}
+
+int
+limare_attribute_buffer_dynamic_new(struct limare_state *state,
+				    enum limare_attrib_type type,
+				    int component_count, int entry_stride,
+				    int entry_count)
+{
+	struct limare_attribute_buffer *buffer;
+
+	buffer = attribute_buffer_create(state, type, component_count,
+					 entry_stride, entry_count,
+					 FRAME_COUNT);
+	if (!buffer)
+		return -1;
+
+	buffer->region_size =
+		ALIGN(buffer->entry_stride * buffer->entry_count, 0x40);
+
+	return buffer->handle;
+}
+
+int
+limare_attribute_buffer_upload_quantised(struct limare_state *state,
+		enum limare_attrib_usage usage, int component_count,
+		int entry_count, const float *data, float max_error,
+		struct limare_attribute_quantisation *quantisation)
+{
+	void *converted;
+	int entry_stride, handle;
+
+	converted = attribute_quantise(usage, data, component_count,
+				       entry_count, max_error, &entry_stride,
+				       quantisation);
+	if (!converted)
+		return -1;
+
+	handle = limare_attribute_buffer_upload(state, quantisation->type,
+						component_count, entry_stride,
+						entry_count, converted);
+	free(converted);
+
+	return handle;
+}
+
+static struct limare_attribute_buffer *
+limare_attribute_buffer_find(struct limare_state *state, int buffer_handle)
+{
+	int i;
+
+	for (i = 0; i < LIMARE_ATTRIBUTE_BUFFER_COUNT; i++)
+		if (state->attribute_buffers[i] &&
+		    (state->attribute_buffers[i]->handle == buffer_handle))
+			return state->attribute_buffers[i];
+
+	return NULL;
+}
+
+/*
+ * Binds an attribute to offset within each stride sized entry of buffer,
+ * so that interleaved vertex data can be shared between attributes.
+ */
+static int
+attribute_buffer_bind(struct limare_state *state, char *name,
+		      struct limare_attribute_buffer *buffer, int offset,
+		      int stride, enum limare_attrib_type type,
+		      int component_count)
+{
+	struct limare_program *program = state->program_current;
+	struct symbol *symbol = NULL;
+	int i, component_size, size;
+
+	for (i = 0; i < program->vertex_attribute_count; i++) {
+		symbol = program->vertex_attributes[i];
 
 		if (!strcmp(symbol->name, name))
 			break;
@@ -804,31 +1339,128 @@ limare_attribute_buffer_attach(struct limare_state *state, char *name,
 		return -1;
 	}
 
-#if 0
-	if (symbol->component_size != buffer->component_size) {
-		printf("%s: Error: Attribute %s has different dimensions\n",
-		       __func__, name);
+	component_size = limare_attrib_type_size(type);
+	if (!component_size) {
+		printf("%s: Error: Invalid attribute type %d\n", __func__,
+		       type);
+		return -1;
+	}
+
+	if (!stride)
+		stride = buffer->entry_stride;
+
+	size = buffer->entry_stride * buffer->entry_count;
+
+	if ((offset < 0) || (offset % component_size) ||
+	    ((offset + component_size * component_count) > stride) ||
+	    ((offset + component_size * component_count) > size)) {
+		printf("%s: Error: Attribute %s does not fit offset %d, "
+		       "stride %d\n", __func__, name, offset, stride);
 		return -1;
 	}
-#endif
 
 	if (symbol->data && symbol->data_allocated)
 		free(symbol->data);
 	symbol->data = NULL;
 	symbol->data_allocated = 0;
 
-	symbol->component_type = buffer->component_type;
-	symbol->component_count = buffer->component_count;
-	symbol->entry_count = buffer->entry_count;
-	symbol->entry_stride = buffer->entry_stride;
+	symbol->component_type = type;
+	symbol->component_count = component_count;
+	symbol->entry_count =
+		(size - offset - component_size * component_count) / stride + 1;
+	symbol->entry_stride = stride;
 	symbol->size = symbol->entry_stride * symbol->entry_count;
 
-	symbol->data_handle = buffer_handle;
-	symbol->mem_physical = buffer->mem_physical;
+	symbol->data_handle = buffer->handle;
+	symbol->data_offset = offset;
+	symbol->mem_physical = buffer->mem_physical + offset;
 
 	return 0;
 }
 
+int
+limare_attribute_buffer_attach(struct limare_state *state, char *name,
+			       int buffer_handle)
+{
+	struct limare_attribute_buffer *buffer;
+
+	buffer = limare_attribute_buffer_find(state, buffer_handle);
+	if (!buffer) {
+		printf("%s: Error: Unable to find attribute buffer 0x%08X\n",
+		       __func__, buffer_handle);
+		return -1;
+	}
+
+	return attribute_buffer_bind(state, name, buffer, 0,
+				     buffer->entry_stride,
+				     buffer->component_type,
+				     buffer->component_count);
+}
+
+int
+limare_attribute_buffer_bind(struct limare_state *state, char *name,
+			     int buffer_handle, int offset, int stride,
+			     enum limare_attrib_type type,
+			     int component_count)
+{
+	struct limare_attribute_buffer *buffer;
+
+	buffer = limare_attribute_buffer_find(state, buffer_handle);
+	if (!buffer) {
+		printf("%s: Error: Unable to find attribute buffer 0x%08X\n",
+		       __func__, buffer_handle);
+		return -1;
+	}
+
+	return attribute_buffer_bind(state, name, buffer, offset, stride,
+				     type, component_count);
+}
+
+void *
+limare_attribute_buffer_map(struct limare_state *state, int buffer_handle)
+{
+	struct limare_attribute_buffer *buffer;
+
+	if (!state->frames[state->frame_current]) {
+		printf("%s: Error: no frame was set up!\n", __func__);
+		return NULL;
+	}
+
+	buffer = limare_attribute_buffer_find(state, buffer_handle);
+	if (!buffer || !buffer->region_size) {
+		printf("%s: Error: no dynamic attribute buffer 0x%08X\n",
+		       __func__, buffer_handle);
+		return NULL;
+	}
+
+	return state->aux_mem_address + buffer->mem_offset +
+		buffer->region_size * state->frame_current;
+}
+
+/*
+ * Points attributes in dynamic buffers at the region of the frame slot
+ * which this draw ends up in.
+ */
+static void
+attribute_dynamic_update(struct limare_state *state,
+			 struct limare_frame *frame, struct symbol *symbol)
+{
+	struct limare_attribute_buffer *buffer;
+	int slot;
+
+	buffer = limare_attribute_buffer_find(state, symbol->data_handle);
+	if (!buffer || !buffer->region_size)
+		return;
+
+	if (frame->command_list)
+		slot = frame->command_list_slot;
+	else
+		slot = frame->id % FRAME_COUNT;
+
+	symbol->mem_physical = buffer->mem_physical + symbol->data_offset +
+		buffer->region_size * slot;
+}
+
 void
 limare_viewport_transform(struct limare_state *state)
 {
@@ -1024,21 +1656,145 @@ limare_texture_attach(struct limare_state *state, char *uniform_name,
 }
 
 static int
-limare_draw(struct limare_state *state, int mode, int start, int count,
-	    struct limare_indices_buffer *indices_buffer)
+command_list_patch_add(struct limare_frame *frame, struct symbol *symbol,
+		       int uniform, int offset)
+{
+	struct limare_command_list *list = frame->command_list;
+	int slot = frame->command_list_slot;
+	struct limare_command_list_patch *patch;
+
+	if (list->patch_count[slot] == list->patch_size[slot]) {
+		int size = list->patch_size[slot] ?
+			2 * list->patch_size[slot] : 16;
+
+		patch = realloc(list->patches[slot], size * sizeof(*patch));
+		if (!patch) {
+			printf("%s: Error: failed to grow patches: %s\n",
+			       __func__, strerror(errno));
+			return -1;
+		}
+
+		list->patches[slot] = patch;
+		list->patch_size[slot] = size;
+	}
+
+	patch = &list->patches[slot][list->patch_count[slot]];
+	patch->symbol = symbol;
+	patch->uniform = uniform;
+	patch->offset = offset;
+	list->patch_count[slot]++;
+
+	return 0;
+}
+
+static int
+command_list_program_add(struct limare_command_list *list,
+			 struct limare_program *program)
 {
-	struct limare_program *program = state->program_current;
-	struct limare_frame *frame =
-		state->frames[state->frame_current];
-	struct draw_info *draw;
-	int attributes_vertex_count = 0;
 	int i;
 
-	if (!frame) {
-		printf("%s: Error: no frame was set up!\n", __func__);
+	for (i = 0; i < list->program_count; i++)
+		if (list->programs[i] == program->handle)
+			return 0;
+
+	if (list->program_count == list->program_size) {
+		int size = list->program_size ? 2 * list->program_size : 4;
+		int *programs =
+			realloc(list->programs, size * sizeof(int));
+
+		if (!programs) {
+			printf("%s: Error: failed to grow programs: %s\n",
+			       __func__, strerror(errno));
+			return -1;
+		}
+
+		list->programs = programs;
+		list->program_size = size;
+	}
+
+	list->programs[list->program_count] = program->handle;
+	list->program_count++;
+
+	return 0;
+}
+
+/*
+ * Remembers the program of a recorded draw, and where its patchable
+ * uniforms ended up.
+ */
+static int
+command_list_patches_record(struct limare_frame *frame,
+			    struct limare_program *program,
+			    struct draw_info *draw)
+{
+	struct limare_command_list *list = frame->command_list;
+	int i, j;
+
+	if (command_list_program_add(list, program))
 		return -1;
+
+	for (i = 0; i < list->uniform_count; i++) {
+		struct limare_command_list_uniform *uniform =
+			&list->uniforms[i];
+
+		for (j = 0; j < program->vertex_uniform_count; j++) {
+			struct symbol *symbol = program->vertex_uniforms[j];
+
+			if (strcmp(symbol->name, uniform->name))
+				continue;
+
+			if (symbol->component_count != uniform->count) {
+				printf("%s: Error: Uniform %s has wrong "
+				       "dimensions\n", __func__, uniform->name);
+				return -1;
+			}
+
+			if (command_list_patch_add(frame, symbol, i,
+						   draw->vs->uniform_offset +
+						   symbol->component_size *
+						   symbol->offset))
+				return -1;
+		}
+
+		if (!draw->plbu->uniform_size)
+			continue;
+
+		for (j = 0; j < program->fragment_uniform_count; j++) {
+			struct symbol *symbol = program->fragment_uniforms[j];
+
+			if (strcmp(symbol->name, uniform->name))
+				continue;
+
+			if (symbol->component_count != uniform->count) {
+				printf("%s: Error: Uniform %s has wrong "
+				       "dimensions\n", __func__, uniform->name);
+				return -1;
+			}
+
+			if (command_list_patch_add(frame, symbol, i,
+						   draw->plbu->uniform_offset +
+						   symbol->component_size *
+						   symbol->offset))
+				return -1;
+		}
 	}
 
+	return 0;
+}
+
+/*
+ * Checks that everything the current program needs is attached, and
+ * brings the driver provided uniforms up to date.
+ */
+static int
+limare_draw_validate(struct limare_state *state,
+		     struct limare_program *program,
+		     int *attributes_vertex_count)
+{
+	int i;
+
+	*attributes_vertex_count = 0;
+
 	for (i = 0; i < program->vertex_attribute_count; i++) {
 		struct symbol *symbol = program->vertex_attributes[i];
 
@@ -1049,8 +1805,8 @@ limare_draw(struct limare_state *state, int mode, int start, int count,
 		}
 
 		if (!i)
-			attributes_vertex_count = symbol->entry_count;
-		else if (attributes_vertex_count != symbol->entry_count) {
+			*attributes_vertex_count = symbol->entry_count;
+		else if (*attributes_vertex_count != symbol->entry_count) {
 			printf("%s: Error: attribute %s has wrong vertex count"
 			       " %d.\n", __func__, symbol->name,
 			       symbol->entry_count);
@@ -1064,6 +1820,9 @@ limare_draw(struct limare_state *state, int mode, int start, int count,
 		/* the dirty flags will be removed in the plbu */
 	}
 
+	if (limare_program_uniform_blocks_update(program))
+		return -1;
+
 	for (i = 0; i < program->vertex_uniform_count; i++) {
 		struct symbol *symbol = program->vertex_uniforms[i];
 
@@ -1092,27 +1851,47 @@ limare_draw(struct limare_state *state, int mode, int start, int count,
 		}
 	}
 
-	if (frame->draw_count >= LIMARE_DRAW_COUNT) {
-		printf("%s: Error: too many draws already!\n", __func__);
-		return -1;
-	}
+	return 0;
+}
 
-	if (indices_buffer)
-		draw = draw_create_new(state, frame, mode,
-				       attributes_vertex_count, start, count);
-	else
-		draw = draw_create_new(state, frame, mode, count, start, count);
+/*
+ * Fills in a freshly created draw and emits its commands. When first is
+ * given, attributes and textures are taken from that earlier draw of the
+ * same batch instead of being attached again. Indexed draws only upload
+ * the indexed range of client attributes, unless shared is set because
+ * later draws with other indices will reuse them.
+ */
+static int
+limare_draw_emit(struct limare_state *state, struct limare_frame *frame,
+		 struct limare_program *program, struct draw_info *draw,
+		 struct draw_info *first,
+		 struct limare_indices_buffer *indices_buffer, int shared)
+{
+	int vertex_first = 0, vertex_count = 0;
+	int i;
 
-	frame->draws[frame->draw_count] = draw;
-	frame->draw_count++;
+	if (indices_buffer && !shared) {
+		vertex_first = indices_buffer->base + indices_buffer->start;
+		vertex_count = indices_buffer->end - indices_buffer->start + 1;
+	}
 
-	for (i = 0; i < program->vertex_attribute_count; i++) {
-		struct symbol *symbol = program->vertex_attributes[i];
+	if (first) {
+		memcpy(draw->vs->attributes, first->vs->attributes,
+		       sizeof(draw->vs->attributes));
+		draw->vs->attribute_count = first->vs->attribute_count;
+	} else {
+		for (i = 0; i < program->vertex_attribute_count; i++) {
+			struct symbol *symbol = program->vertex_attributes[i];
 
-		if (symbol->data)
-			attribute_upload(frame, symbol);
+			if (symbol->data &&
+			    attribute_cache_upload(state, frame, symbol,
+						   vertex_first, vertex_count))
+				return -1;
+			else if (symbol->data_handle)
+				attribute_dynamic_update(state, frame, symbol);
 
-		vs_info_attach_attribute(frame, draw, symbol);
+			vs_info_attach_attribute(frame, draw, symbol);
+		}
 	}
 
 	if (vs_info_attach_varyings(program, frame, draw))
@@ -1124,7 +1903,14 @@ limare_draw(struct limare_state *state, int mode, int start, int count,
 				    program->vertex_uniform_size))
 		return -1;
 
-	if (plbu_info_attach_textures(state, frame, draw))
+	if (first) {
+		draw->texture_descriptor_count =
+			first->texture_descriptor_count;
+		draw->texture_descriptor_list_offset =
+			first->texture_descriptor_list_offset;
+		memcpy(draw->texture_handles, first->texture_handles,
+		       sizeof(draw->texture_handles));
+	} else if (plbu_info_attach_textures(state, frame, draw))
 		return -1;
 
 	if (plbu_info_attach_uniforms(frame, draw,
@@ -1133,514 +1919,2526 @@ limare_draw(struct limare_state *state, int mode, int start, int count,
 				      program->fragment_uniform_size))
 		return -1;
 
-	if (indices_buffer)
+	if (frame->command_list &&
+	    command_list_patches_record(frame, program, draw))
+		return -1;
+
+	if (indices_buffer) {
 		plbu_info_attach_indices(draw, indices_buffer->indices_type,
 					 indices_buffer->mem_physical);
+		draw->vertex_base = indices_buffer->base;
+	}
 
-	vs_commands_draw_add(state, frame, program, draw);
+	if (vs_commands_draw_add(state, frame, program, draw))
+		return -1;
 	vs_info_finalize(state, frame, program, draw, draw->vs);
 
 	draw_render_state_create(frame, program, draw,
 				 state->render_state_template);
-	plbu_commands_draw_add(state, frame, draw);
+	if (plbu_commands_draw_add(state, frame, draw))
+		return -1;
 
 	return 0;
 }
 
-int
-limare_draw_arrays(struct limare_state *state, int mode, int start, int count)
+/*
+ * Indexed draws only transform the vertices between the lowest and the
+ * highest index. The attributes get offset by the lowest index, which the
+ * PLBU subtracts again from each index.
+ */
+static int
+indices_vertex_count(struct limare_indices_buffer *buffer,
+		     int attributes_vertex_count)
 {
-	return limare_draw(state, mode, start, count, NULL);
+	if ((buffer->base + buffer->end) >= attributes_vertex_count) {
+		printf("%s: Error: index %d is beyond vertex count %d\n",
+		       __func__, buffer->base + buffer->end,
+		       attributes_vertex_count);
+		return -1;
+	}
+
+	return buffer->end - buffer->start + 1;
 }
 
-static void
-elements_count_byte(unsigned char *indices, int indices_count,
-		    int *start, int *end)
+static int
+limare_draw(struct limare_state *state, struct limare_frame *frame,
+	    int mode, int start, int count,
+	    struct limare_indices_buffer *indices_buffer)
 {
-	int i;
+	struct limare_program *program = state->program_current;
+	struct draw_info *draw;
+	int attributes_vertex_count;
+
+	if (!frame) {
+		printf("%s: Error: no frame was set up!\n", __func__);
+		return -1;
+	}
 
-	*start = indices_count;
-	*end = 0;
+	if (limare_draw_validate(state, program, &attributes_vertex_count))
+		return -1;
+
+	if (!indices_buffer) {
+		draw = draw_create_new(state, frame, mode, count, start,
+				       count);
+
+		if (frame_draw_add(frame, draw))
+			return -1;
 
-	for (i = 0; i < indices_count; i++) {
-		if (indices[i] < *start)
-			*start = indices[i];
-		if (indices[i] > *end)
-			*end = indices[i];
+		return limare_draw_emit(state, frame, program, draw, NULL,
+					NULL, 0);
 	}
-}
 
-static void
-elements_count_word(unsigned short *indices, int indices_count,
-		    int *start, int *end)
-{
-	int i;
+	/* split 32 bit index lists become one draw per batch */
+	for (; indices_buffer; indices_buffer = indices_buffer->next) {
+		int vertex_count =
+			indices_vertex_count(indices_buffer,
+					     attributes_vertex_count);
+		if (vertex_count < 0)
+			return -1;
+
+		draw = draw_create_new(state, frame, mode, vertex_count,
+				       start, count);
+
+		if (frame_draw_add(frame, draw))
+			return -1;
 
-	*start = 0x7FFFFFFF;
-	*end = 0;
+		if (limare_draw_emit(state, frame, program, draw, NULL,
+				     indices_buffer, 0))
+			return -1;
 
-	for (i = 0; i < indices_count; i++) {
-		if (indices[i] < *start)
-			*start = indices[i];
-		if (indices[i] > *end)
-			*end = indices[i];
+		if (indices_buffer->next) {
+			start = indices_buffer->next->start;
+			count = indices_buffer->next->count;
+		}
 	}
+
+	return 0;
 }
 
 /*
- * TODO: have a quick scan through the elements, and find the lowest and
- * highest indices. Then, only upload these, and limit the vertex count to
- * this. This might significantly reduce the amount of data the vs has to
- * churn through.
+ * Per draw uniform data is bound by pointing the symbols straight at the
+ * slice for each draw, mediump data gets converted once for all draws.
  */
-int
-limare_draw_elements(struct limare_state *state, int mode, int count,
-		     void *indices, int indices_type)
+struct limare_instance_symbol {
+	struct symbol *symbol;
+	struct limare_instance_uniform *uniform;
+	void *data;
+	int stride;
+	int allocated;
+};
+
+static int
+limare_instance_symbol_setup(struct limare_instance_symbol *instance,
+			     struct symbol *symbol,
+			     struct limare_instance_uniform *uniform,
+			     int draw_count)
 {
-	struct limare_frame *frame = state->frames[state->frame_current];
-	struct limare_indices_buffer buffer;
-	int size, start, end;
-	void *address;
+	int stride = uniform->stride ? uniform->stride : uniform->count;
+	int i, j;
 
-	if (indices_type == GL_UNSIGNED_BYTE) {
-		size = count;
-		elements_count_byte(indices, count, &start, &end);
-	} else if (indices_type == GL_UNSIGNED_SHORT) {
-		size = count * 2;
-		elements_count_word(indices, count, &start, &end);
-	} else {
-		printf("%s: only bytes and shorts supported.\n", __func__);
+	if (symbol->component_count != uniform->count) {
+		printf("%s: Error: Uniform %s has wrong dimensions\n",
+		       __func__, uniform->name);
 		return -1;
 	}
 
-	buffer.handle = 0;
-	buffer.drawing_mode = mode;
-	buffer.indices_type = indices_type;
-	buffer.count = count;
-
-	if ((frame->mem_size - frame->mem_used) < (0x40 + ALIGN(size, 0x40))) {
-		printf("%s: no space for indices\n", __func__);
+	if (stride < uniform->count) {
+		printf("%s: Error: Uniform %s has invalid stride %d\n",
+		       __func__, uniform->name, uniform->stride);
 		return -1;
 	}
 
-	address = frame->mem_address + frame->mem_used;
-	buffer.mem_physical = frame->mem_physical + frame->mem_used;
-	frame->mem_used += ALIGN(size, 0x40);
+	if (symbol->data && symbol->data_allocated)
+		free(symbol->data);
+	symbol->data = NULL;
+	symbol->data_allocated = 0;
+
+	instance->symbol = symbol;
+	instance->uniform = uniform;
+
+	if (symbol->precision == 3) {
+		instance->data = uniform->data;
+		instance->stride = stride * sizeof(float);
+		instance->allocated = 0;
+	} else {
+		hfloat *data = malloc(uniform->count * draw_count *
+				      sizeof(hfloat));
+
+		if (!data) {
+			printf("%s: Error: failed to allocate %s: %s\n",
+			       __func__, uniform->name, strerror(errno));
+			return -1;
+		}
+
+		for (i = 0; i < draw_count; i++)
+			for (j = 0; j < uniform->count; j++)
+				data[i * uniform->count + j] =
+					float_to_hfloat(uniform->data
+							[i * stride + j]);
 
-	memcpy(address, indices, size);
+		instance->data = data;
+		instance->stride = uniform->count * sizeof(hfloat);
+		instance->allocated = 1;
+	}
 
-	return limare_draw(state, mode, start, count, &buffer);
+	return 0;
+}
+
+/*
+ * Looks up the per draw uniforms, a uniform can live in both the vertex
+ * and the fragment shader. symbol_count is kept valid for the cleanup,
+ * even on error.
+ */
+static int
+limare_instance_symbols_setup(struct limare_program *program,
+			      struct limare_instance_symbol *symbols,
+			      int *symbol_count,
+			      struct limare_instance_uniform *uniforms,
+			      int uniform_count, int draw_count)
+{
+	int i, j;
+
+	*symbol_count = 0;
+
+	if (uniform_count > LIMARE_INSTANCE_UNIFORM_COUNT) {
+		printf("%s: Error: too many instance uniforms (%d)\n",
+		       __func__, uniform_count);
+		return -1;
+	}
+
+	for (i = 0; i < uniform_count; i++) {
+		int found = 0;
+
+		for (j = 0; j < program->vertex_uniform_count; j++) {
+			struct symbol *symbol = program->vertex_uniforms[j];
+
+			if (strcmp(symbol->name, uniforms[i].name))
+				continue;
+
+			if (limare_instance_symbol_setup(&symbols[*symbol_count],
+							 symbol, &uniforms[i],
+							 draw_count))
+				return -1;
+			(*symbol_count)++;
+			found = 1;
+			break;
+		}
+
+		for (j = 0; j < program->fragment_uniform_count; j++) {
+			struct symbol *symbol = program->fragment_uniforms[j];
+
+			if (strcmp(symbol->name, uniforms[i].name))
+				continue;
+
+			if (limare_instance_symbol_setup(&symbols[*symbol_count],
+							 symbol, &uniforms[i],
+							 draw_count))
+				return -1;
+			(*symbol_count)++;
+			found = 1;
+			break;
+		}
+
+		if (!found) {
+			printf("%s: Error: Unable to find uniform %s\n",
+			       __func__, uniforms[i].name);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+limare_instance_symbols_bind(struct limare_instance_symbol *symbols,
+			     int symbol_count, int draw)
+{
+	int i;
+
+	for (i = 0; i < symbol_count; i++)
+		symbols[i].symbol->data =
+			symbols[i].data + draw * symbols[i].stride;
+}
+
+/*
+ * Leaves the uniforms bound to the data of the last draw.
+ */
+static void
+limare_instance_symbols_release(struct limare_instance_symbol *symbols,
+				int symbol_count, int last)
+{
+	int i;
+
+	for (i = 0; i < symbol_count; i++) {
+		struct limare_instance_uniform *uniform = symbols[i].uniform;
+		int stride = uniform->stride ? uniform->stride : uniform->count;
+
+		symbols[i].symbol->data = NULL;
+		symbol_attach_data(symbols[i].symbol, uniform->count,
+				   uniform->data + last * stride);
+
+		if (symbols[i].allocated)
+			free(symbols[i].data);
+	}
+}
+
+static int
+limare_draw_instanced(struct limare_state *state, struct limare_frame *frame,
+		      int mode, int start, int count,
+		      struct limare_indices_buffer *indices_buffer,
+		      int instance_count,
+		      struct limare_instance_uniform *uniforms,
+		      int uniform_count)
+{
+	struct limare_program *program = state->program_current;
+	struct limare_instance_symbol
+		symbols[2 * LIMARE_INSTANCE_UNIFORM_COUNT];
+	struct draw_info *draw, *first = NULL;
+	int attributes_vertex_count;
+	int symbol_count, ret = -1, i;
+
+	if (!frame) {
+		printf("%s: Error: no frame was set up!\n", __func__);
+		return -1;
+	}
+
+	if (instance_count < 1) {
+		printf("%s: Error: invalid instance count %d\n", __func__,
+		       instance_count);
+		return -1;
+	}
+
+	if (indices_buffer && indices_buffer->next) {
+		printf("%s: Error: instanced draws need all indices within "
+		       "65536 vertices\n", __func__);
+		return -1;
+	}
+
+	if (limare_instance_symbols_setup(program, symbols, &symbol_count,
+					  uniforms, uniform_count,
+					  instance_count))
+		goto out;
+
+	limare_instance_symbols_bind(symbols, symbol_count, 0);
+
+	if (limare_draw_validate(state, program, &attributes_vertex_count))
+		goto out;
+
+	if (indices_buffer) {
+		attributes_vertex_count =
+			indices_vertex_count(indices_buffer,
+					     attributes_vertex_count);
+		if (attributes_vertex_count < 0)
+			goto out;
+	} else
+		attributes_vertex_count = count;
+
+	for (i = 0; i < instance_count; i++) {
+		limare_instance_symbols_bind(symbols, symbol_count, i);
+
+		if (first)
+			draw = draw_create_instance(state, frame, first);
+		else
+			draw = draw_create_new(state, frame, mode,
+					       attributes_vertex_count,
+					       start, count);
+
+		if (frame_draw_add(frame, draw))
+			goto out;
+
+		if (limare_draw_emit(state, frame, program, draw, first,
+				     indices_buffer, 0))
+			goto out;
+
+		if (!first)
+			first = draw;
+	}
+
+	ret = 0;
+ out:
+	limare_instance_symbols_release(symbols, symbol_count,
+					instance_count - 1);
+
+	return ret;
+}
+
+/*
+ * Draws normally go into the current frame. While a command list is being
+ * recorded, they are emitted once into each frame slot of the list, as
+ * every frame in flight needs its own varyings and uniforms. The dirty
+ * flags are restored for each slot, so all copies get the same state.
+ */
+struct limare_draw_target {
+	struct limare_frame *frames[FRAME_COUNT];
+	int count;
+
+	int viewport_dirty;
+	int scissor_dirty;
+	int depth_dirty;
+};
+
+static void
+limare_draw_target_get(struct limare_state *state,
+		       struct limare_draw_target *target)
+{
+	struct limare_command_list *list = state->command_list_recording;
+	int i;
+
+	if (list) {
+		for (i = 0; i < FRAME_COUNT; i++)
+			target->frames[i] = list->frames[i];
+		target->count = FRAME_COUNT;
+	} else {
+		target->frames[0] = state->frames[state->frame_current];
+		target->count = 1;
+	}
+
+	target->viewport_dirty = state->viewport_dirty;
+	target->scissor_dirty = state->scissor_dirty;
+	target->depth_dirty = state->depth_dirty;
+}
+
+static struct limare_frame *
+limare_draw_target_frame(struct limare_state *state,
+			 struct limare_draw_target *target, int index)
+{
+	state->viewport_dirty = target->viewport_dirty;
+	state->scissor_dirty = target->scissor_dirty;
+	state->depth_dirty = target->depth_dirty;
+
+	return target->frames[index];
+}
+
+int
+limare_draw_arrays(struct limare_state *state, int mode, int start, int count)
+{
+	struct limare_draw_target target;
+	struct limare_frame *frame;
+	int i;
+
+	limare_draw_target_get(state, &target);
+
+	for (i = 0; i < target.count; i++) {
+		frame = limare_draw_target_frame(state, &target, i);
+
+		if (limare_draw(state, frame, mode, start, count, NULL))
+			return -1;
+	}
+
+	return 0;
+}
+
+static void
+indices_buffer_chain_free(struct limare_indices_buffer *buffer)
+{
+	struct limare_indices_buffer *next;
+
+	for (; buffer; buffer = next) {
+		next = buffer->next;
+		free(buffer);
+	}
+}
+
+static int
+elements_primitive_size(int mode)
+{
+	switch (mode) {
+	case GL_POINTS:
+		return 1;
+	case GL_LINES:
+		return 2;
+	case GL_TRIANGLES:
+		return 3;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * The hardware only takes byte and short indices. 32 bit indices get
+ * rebased into 16 bit batches, split at primitive boundaries, each batch
+ * in its own buffer chained to the first.
+ */
+static int
+elements_upload_int(void *mem_address, unsigned int mem_physical,
+		    int mem_size, int *mem_used, int mode, int count,
+		    const unsigned int *indices,
+		    struct limare_indices_buffer *buffer)
+{
+	struct limare_indices_buffer *batch = NULL;
+	int step = elements_primitive_size(mode);
+	unsigned int min, max;
+	unsigned short *address;
+	int fits, i, j, n;
+
+	indices_range_int(indices, count, &min, &max);
+	fits = (max - min) <= 0xFFFF;
+
+	if (!fits && !step) {
+		printf("%s: Error: strips and fans need all indices within "
+		       "65536 vertices\n", __func__);
+		return -1;
+	}
+
+	if (!fits)
+		count -= count % step;
+
+	for (i = 0; i < count; i += n) {
+		if (fits)
+			n = count;
+		else {
+			unsigned int low = 0xFFFFFFFF, high = 0;
+
+			min = 0xFFFFFFFF;
+			max = 0;
+
+			for (n = 0; (i + n + step) <= count; n += step) {
+				for (j = 0; j < step; j++) {
+					unsigned int index = indices[i + n + j];
+
+					if (index < low)
+						low = index;
+					if (index > high)
+						high = index;
+				}
+
+				if ((high - low) > 0xFFFF)
+					break;
+
+				min = low;
+				max = high;
+			}
+
+			if (!n) {
+				printf("%s: Error: primitive spans more than "
+				       "65536 vertices\n", __func__);
+				return -1;
+			}
+		}
+
+		if (!batch)
+			batch = buffer;
+		else {
+			batch->next =
+				calloc(1, sizeof(struct limare_indices_buffer));
+			if (!batch->next) {
+				printf("%s: Error: failed to allocate batch: "
+				       "%s\n", __func__, strerror(errno));
+				return -1;
+			}
+			batch = batch->next;
+		}
+
+		if ((mem_size - *mem_used) < ALIGN(2 * n, 0x40)) {
+			printf("%s: no space for indices\n", __func__);
+			return -1;
+		}
+
+		address = mem_address + *mem_used;
+		batch->mem_physical = mem_physical + *mem_used;
+		*mem_used += ALIGN(2 * n, 0x40);
+
+		for (j = 0; j < n; j++)
+			address[j] = indices[i + j] - min;
+
+		batch->drawing_mode = mode;
+		batch->indices_type = GL_UNSIGNED_SHORT;
+		batch->count = n;
+		batch->start = 0;
+		batch->end = max - min;
+		batch->base = min;
+	}
+
+	return 0;
+}
+
+/*
+ * Copies the indices to *mem_used, and fills in buffer including the
+ * index range. On failure, batches chained to buffer are left for the
+ * caller to free.
+ */
+static int
+elements_upload(void *mem_address, unsigned int mem_physical, int mem_size,
+		int *mem_used, int mode, int count, const void *indices,
+		int indices_type, struct limare_indices_buffer *buffer)
+{
+	int size;
+
+	if (count <= 0) {
+		printf("%s: Error: empty index list\n", __func__);
+		return -1;
+	}
+
+	buffer->drawing_mode = mode;
+	buffer->indices_type = indices_type;
+	buffer->count = count;
+	buffer->start = 0;
+	buffer->end = 0;
+	buffer->base = 0;
+	buffer->next = NULL;
+
+	if (indices_type == GL_UNSIGNED_BYTE) {
+		size = count;
+		indices_range_byte(indices, count, &buffer->start,
+				   &buffer->end);
+	} else if (indices_type == GL_UNSIGNED_SHORT) {
+		size = count * 2;
+		indices_range_short(indices, count, &buffer->start,
+				    &buffer->end);
+	} else if (indices_type == GL_UNSIGNED_INT) {
+		return elements_upload_int(mem_address, mem_physical,
+					   mem_size, mem_used, mode, count,
+					   indices, buffer);
+	} else {
+		printf("%s: only bytes, shorts and ints supported.\n",
+		       __func__);
+		return -1;
+	}
+
+	if ((mem_size - *mem_used) < (0x40 + ALIGN(size, 0x40))) {
+		printf("%s: no space for indices\n", __func__);
+		return -1;
+	}
+
+	buffer->mem_physical = mem_physical + *mem_used;
+	memcpy(mem_address + *mem_used, indices, size);
+	*mem_used += ALIGN(size, 0x40);
+
+	return 0;
+}
+
+static int
+elements_frame_upload(struct limare_frame *frame, int mode, int count,
+		      void *indices, int indices_type,
+		      struct limare_indices_buffer *buffer)
+{
+	buffer->handle = 0;
+
+	return elements_upload(frame->mem_address, frame->mem_physical,
+			       frame->mem_size, &frame->mem_used, mode, count,
+			       indices, indices_type, buffer);
+}
+
+int
+limare_draw_elements(struct limare_state *state, int mode, int count,
+		     void *indices, int indices_type)
+{
+	struct limare_draw_target target;
+	struct limare_indices_buffer buffer;
+	struct limare_frame *frame;
+	int ret, i;
+
+	limare_draw_target_get(state, &target);
+
+	for (i = 0; i < target.count; i++) {
+		frame = limare_draw_target_frame(state, &target, i);
+
+		if (!frame) {
+			printf("%s: Error: no frame was set up!\n", __func__);
+			return -1;
+		}
+
+		ret = elements_frame_upload(frame, mode, count, indices,
+					    indices_type, &buffer);
+		if (!ret)
+			ret = limare_draw(state, frame, mode, buffer.start,
+					  buffer.count, &buffer);
+
+		indices_buffer_chain_free(buffer.next);
+		if (ret)
+			return -1;
+	}
+
+	return 0;
+}
+
+int
+limare_draw_arrays_instanced(struct limare_state *state, int mode,
+			     int start, int count, int instance_count,
+			     struct limare_instance_uniform *uniforms,
+			     int uniform_count)
+{
+	struct limare_draw_target target;
+	struct limare_frame *frame;
+	int i;
+
+	limare_draw_target_get(state, &target);
+
+	for (i = 0; i < target.count; i++) {
+		frame = limare_draw_target_frame(state, &target, i);
+
+		if (limare_draw_instanced(state, frame, mode, start, count,
+					  NULL, instance_count, uniforms,
+					  uniform_count))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * The indices are uploaded once, and shared by all instances.
+ */
+int
+limare_draw_elements_instanced(struct limare_state *state, int mode,
+			       int count, void *indices, int indices_type,
+			       int instance_count,
+			       struct limare_instance_uniform *uniforms,
+			       int uniform_count)
+{
+	struct limare_draw_target target;
+	struct limare_indices_buffer buffer;
+	struct limare_frame *frame;
+	int ret, i;
+
+	limare_draw_target_get(state, &target);
+
+	for (i = 0; i < target.count; i++) {
+		frame = limare_draw_target_frame(state, &target, i);
+
+		if (!frame) {
+			printf("%s: Error: no frame was set up!\n", __func__);
+			return -1;
+		}
+
+		ret = elements_frame_upload(frame, mode, count, indices,
+					    indices_type, &buffer);
+		if (!ret)
+			ret = limare_draw_instanced(state, frame, mode,
+						    buffer.start, count,
+						    &buffer, instance_count,
+						    uniforms, uniform_count);
+
+		indices_buffer_chain_free(buffer.next);
+		if (ret)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Reorders the indices for vertex locality, and optionally renumbers the
+ * vertices in first use order, in which case *remap holds the new number
+ * of each of the *vertex_count vertices. Returns the reordered indices in
+ * a newly allocated array of the same type.
+ */
+static void *
+elements_optimise(int mode, int type, int count, void *data, int flags,
+		  unsigned int **remap, int *vertex_count)
+{
+	unsigned int *indices;
+	unsigned int min, max;
+	void *optimised = NULL;
+	int i, size;
+
+	*remap = NULL;
+
+	if ((flags & LIMARE_ELEMENTS_VCACHE) && (mode != GL_TRIANGLES)) {
+		printf("%s: Error: only triangle lists can be reordered\n",
+		       __func__);
+		return NULL;
+	}
+
+	if (type == GL_UNSIGNED_BYTE)
+		size = 1;
+	else if (type == GL_UNSIGNED_SHORT)
+		size = 2;
+	else if (type == GL_UNSIGNED_INT)
+		size = 4;
+	else {
+		printf("%s: only bytes, shorts and ints supported.\n",
+		       __func__);
+		return NULL;
+	}
+
+	indices = malloc(count * sizeof(unsigned int));
+	if (!indices) {
+		printf("%s: Error: failed to allocate indices: %s\n",
+		       __func__, strerror(errno));
+		return NULL;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (type == GL_UNSIGNED_BYTE)
+			indices[i] = ((unsigned char *) data)[i];
+		else if (type == GL_UNSIGNED_SHORT)
+			indices[i] = ((unsigned short *) data)[i];
+		else
+			indices[i] = ((unsigned int *) data)[i];
+	}
+
+	indices_range_int(indices, count, &min, &max);
+	*vertex_count = max + 1;
+
+	if ((flags & LIMARE_ELEMENTS_VCACHE) &&
+	    vcache_triangles_reorder(indices, count, max + 1))
+		goto out;
+
+	if (flags & LIMARE_ELEMENTS_VERTEX_ORDER) {
+		*remap = malloc((max + 1) * sizeof(unsigned int));
+		if (!*remap) {
+			printf("%s: Error: failed to allocate remap: %s\n",
+			       __func__, strerror(errno));
+			goto out;
+		}
+
+		if (vcache_vertices_reorder(indices, count, max + 1,
+					    *remap) < 0)
+			goto out;
+	}
+
+	optimised = malloc(count * size);
+	if (!optimised) {
+		printf("%s: Error: failed to allocate indices: %s\n",
+		       __func__, strerror(errno));
+		goto out;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (type == GL_UNSIGNED_BYTE)
+			((unsigned char *) optimised)[i] = indices[i];
+		else if (type == GL_UNSIGNED_SHORT)
+			((unsigned short *) optimised)[i] = indices[i];
+		else
+			((unsigned int *) optimised)[i] = indices[i];
+	}
+
+ out:
+	if (!optimised) {
+		free(*remap);
+		*remap = NULL;
+	}
+	free(indices);
+
+	return optimised;
+}
+
+static void
+elements_attributes_free(void **copies, int attribute_count)
+{
+	int i;
+
+	if (!copies)
+		return;
+
+	for (i = 0; i < attribute_count; i++)
+		free(copies[i]);
+	free(copies);
+}
+
+/*
+ * Checks all the attribute buffers, and builds their renumbered contents
+ * aside, so that nothing is touched until the indices are in place.
+ */
+static void **
+elements_attributes_remap(struct limare_state *state, int *attribute_handles,
+			  int attribute_count, int vertex_count,
+			  const unsigned int *remap)
+{
+	struct limare_attribute_buffer *buffer;
+	void **copies;
+	int i;
+
+	for (i = 0; i < attribute_count; i++) {
+		buffer = limare_attribute_buffer_find(state,
+						      attribute_handles[i]);
+		if (!buffer || buffer->region_size) {
+			printf("%s: Error: no static attribute buffer "
+			       "0x%08X\n", __func__, attribute_handles[i]);
+			return NULL;
+		}
+
+		if (buffer->entry_count < vertex_count) {
+			printf("%s: Error: index %d is beyond vertex count "
+			       "%d\n", __func__, vertex_count - 1,
+			       buffer->entry_count);
+			return NULL;
+		}
+	}
+
+	copies = calloc(attribute_count, sizeof(void *));
+	if (!copies) {
+		printf("%s: Error: failed to allocate: %s\n",
+		       __func__, strerror(errno));
+		return NULL;
+	}
+
+	for (i = 0; i < attribute_count; i++) {
+		buffer = limare_attribute_buffer_find(state,
+						      attribute_handles[i]);
+
+		copies[i] = malloc(vertex_count * buffer->entry_stride);
+		if (!copies[i]) {
+			printf("%s: Error: failed to allocate: %s\n",
+			       __func__, strerror(errno));
+			elements_attributes_free(copies, attribute_count);
+			return NULL;
+		}
+
+		vcache_attributes_remap(copies[i], state->aux_mem_address +
+					buffer->mem_offset,
+					buffer->entry_stride, vertex_count,
+					remap);
+	}
+
+	return copies;
+}
+
+int
+limare_elements_buffer_upload(struct limare_state *state, int mode, int type,
+			      int count, void *data)
+{
+	return limare_elements_buffer_upload_flags(state, mode, type, count,
+						   data, 0, NULL, 0);
+}
+
+/*
+ * With LIMARE_ELEMENTS_VERTEX_ORDER, the attribute buffers only get
+ * renumbered once the reordered indices have been uploaded, so a failure
+ * leaves them as they were.
+ */
+int
+limare_elements_buffer_upload_flags(struct limare_state *state, int mode,
+				    int type, int count, void *data,
+				    int flags, int *attribute_handles,
+				    int attribute_count)
+{
+	struct limare_indices_buffer *buffer;
+	struct limare_attribute_buffer *attribute;
+	unsigned int *remap = NULL;
+	void *optimised = NULL;
+	void **copies = NULL;
+	int aux_mem_used = state->aux_mem_used;
+	int vertex_count = 0;
+	int i, j, ret;
+
+	for (i = 0; i < LIMARE_INDICES_BUFFER_COUNT; i++)
+		if (!state->indices_buffers[i])
+			break;
+
+	if (i == LIMARE_INDICES_BUFFER_COUNT) {
+		printf("%s: all indices buffer slots have been taken!\n",
+		       __func__);
+		return -1;
+	}
+
+	if (count <= 0) {
+		printf("%s: Error: empty index list\n", __func__);
+		return -1;
+	}
+
+	if (attribute_count < 0) {
+		printf("%s: Error: invalid attribute count %d\n", __func__,
+		       attribute_count);
+		return -1;
+	}
+
+	/* renumbered indices are useless without their attributes */
+	if ((flags & LIMARE_ELEMENTS_VERTEX_ORDER) &&
+	    (!attribute_count || !attribute_handles)) {
+		printf("%s: Error: vertex reordering needs the attribute "
+		       "buffers\n", __func__);
+		return -1;
+	}
+
+	if (flags) {
+		optimised = elements_optimise(mode, type, count, data, flags,
+					      &remap, &vertex_count);
+		if (!optimised)
+			return -1;
+		data = optimised;
+	}
+
+	if (remap) {
+		copies = elements_attributes_remap(state, attribute_handles,
+						   attribute_count,
+						   vertex_count, remap);
+		free(remap);
+		if (!copies) {
+			free(optimised);
+			return -1;
+		}
+	}
+
+	buffer = calloc(1, sizeof(struct limare_indices_buffer));
+	if (!buffer) {
+		printf("%s: Error: failed to allocate indices buffer: %s\n",
+		       __func__, strerror(errno));
+		elements_attributes_free(copies, attribute_count);
+		free(optimised);
+		return -1;
+	}
+
+	ret = elements_upload(state->aux_mem_address, state->aux_mem_physical,
+			      state->aux_mem_size, &state->aux_mem_used, mode,
+			      count, data, type, buffer);
+	free(optimised);
+	if (ret) {
+		state->aux_mem_used = aux_mem_used;
+		indices_buffer_chain_free(buffer);
+		elements_attributes_free(copies, attribute_count);
+		return -1;
+	}
+
+	if (copies) {
+		for (j = 0; j < attribute_count; j++) {
+			attribute = limare_attribute_buffer_find(state,
+						attribute_handles[j]);
+			memcpy(state->aux_mem_address + attribute->mem_offset,
+			       copies[j],
+			       vertex_count * attribute->entry_stride);
+		}
+		elements_attributes_free(copies, attribute_count);
+	}
+
+	buffer->handle = 0x40000000 + state->indices_buffer_handles;
+	state->indices_buffer_handles++;
+
+	state->indices_buffers[i] = buffer;
+
+	return buffer->handle;
+}
+
+static struct limare_indices_buffer *
+limare_indices_buffer_find(struct limare_state *state, int buffer_handle)
+{
+	int i;
+
+	for (i = 0; i < LIMARE_INDICES_BUFFER_COUNT; i++)
+		if (state->indices_buffers[i] &&
+		    (state->indices_buffers[i]->handle == buffer_handle))
+			return state->indices_buffers[i];
+
+	return NULL;
+}
+
+int
+limare_draw_elements_buffer(struct limare_state *state, int buffer_handle)
+{
+	struct limare_indices_buffer *buffer;
+	struct limare_draw_target target;
+	struct limare_frame *frame;
+	int i;
+
+	buffer = limare_indices_buffer_find(state, buffer_handle);
+	if (!buffer) {
+		printf("%s: Error: unable to fine handle 0x%08X\n",
+		       __func__, buffer_handle);
+		return -1;
+	}
+
+	limare_draw_target_get(state, &target);
+
+	for (i = 0; i < target.count; i++) {
+		frame = limare_draw_target_frame(state, &target, i);
+
+		if (limare_draw(state, frame, buffer->drawing_mode,
+				buffer->start, buffer->count, buffer))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Emits a batch of draws with the current program and bindings. The program
+ * is validated, the client attributes are uploaded and the textures are
+ * attached only once. uniforms[i].data holds the values for each draw,
+ * stride floats apart.
+ */
+static int
+limare_draw_multi_frame(struct limare_state *state,
+			struct limare_frame *frame,
+			struct limare_draw_desc *descs, int desc_count,
+			struct limare_instance_uniform *uniforms,
+			int uniform_count)
+{
+	struct limare_program *program = state->program_current;
+	struct limare_instance_symbol
+		symbols[2 * LIMARE_INSTANCE_UNIFORM_COUNT];
+	struct draw_info *draw, *first = NULL;
+	int attributes_vertex_count, vertex_count;
+	int symbol_count, ret = -1, i;
+
+	if (!frame) {
+		printf("%s: Error: no frame was set up!\n", __func__);
+		return -1;
+	}
+
+	if (desc_count < 1)
+		return 0;
+
+	if (limare_instance_symbols_setup(program, symbols, &symbol_count,
+					  uniforms, uniform_count,
+					  desc_count))
+		goto out;
+
+	limare_instance_symbols_bind(symbols, symbol_count, 0);
+
+	if (limare_draw_validate(state, program, &attributes_vertex_count))
+		goto out;
+
+	for (i = 0; i < desc_count; i++) {
+		struct limare_draw_desc *desc = &descs[i];
+		struct limare_indices_buffer *buffer = NULL;
+
+		limare_instance_symbols_bind(symbols, symbol_count, i);
+
+		if (desc->indices_handle) {
+			buffer = limare_indices_buffer_find(state,
+							    desc->indices_handle);
+			if (!buffer) {
+				printf("%s: Error: unable to find handle "
+				       "0x%08X\n", __func__,
+				       desc->indices_handle);
+				goto out;
+			}
+
+		}
+
+		/* split 32 bit index lists become one draw per batch */
+		do {
+			if (buffer) {
+				vertex_count =
+					indices_vertex_count(buffer,
+						attributes_vertex_count);
+				if (vertex_count < 0)
+					goto out;
+
+				draw = draw_create_new(state, frame,
+						       buffer->drawing_mode,
+						       vertex_count,
+						       buffer->start,
+						       buffer->count);
+			} else
+				draw = draw_create_new(state, frame,
+						       desc->mode,
+						       desc->count,
+						       desc->start,
+						       desc->count);
+
+			if (frame_draw_add(frame, draw))
+				goto out;
+
+			if (limare_draw_emit(state, frame, program, draw,
+					     first, buffer, 1))
+				goto out;
+
+			if (!first)
+				first = draw;
+
+			if (buffer)
+				buffer = buffer->next;
+		} while (buffer);
+	}
+
+	ret = 0;
+ out:
+	limare_instance_symbols_release(symbols, symbol_count,
+					desc_count - 1);
+
+	return ret;
+}
+
+int
+limare_draw_multi(struct limare_state *state,
+		  struct limare_draw_desc *descs, int desc_count,
+		  struct limare_instance_uniform *uniforms, int uniform_count)
+{
+	struct limare_draw_target target;
+	struct limare_frame *frame;
+	int i;
+
+	limare_draw_target_get(state, &target);
+
+	for (i = 0; i < target.count; i++) {
+		frame = limare_draw_target_frame(state, &target, i);
+
+		if (limare_draw_multi_frame(state, frame, descs, desc_count,
+					    uniforms, uniform_count))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Adds rect to the list, when the list is full, the last entry grows to
+ * cover it.
+ */
+static void
+damage_rect_add(struct limare_damage_rect *rects, int *count,
+		struct limare_damage_rect *rect)
+{
+	struct limare_damage_rect *last;
+
+	if ((rect->x0 >= rect->x1) || (rect->y0 >= rect->y1))
+		return;
+
+	if (*count < LIMARE_DAMAGE_MAX) {
+		rects[*count] = *rect;
+		(*count)++;
+		return;
+	}
+
+	last = &rects[LIMARE_DAMAGE_MAX - 1];
+	if (last->x0 > rect->x0)
+		last->x0 = rect->x0;
+	if (last->y0 > rect->y0)
+		last->y0 = rect->y0;
+	if (last->x1 < rect->x1)
+		last->x1 = rect->x1;
+	if (last->y1 < rect->y1)
+		last->y1 = rect->y1;
+}
+
+/*
+ * Only have the pp render the tiles touched by these rectangles, for the
+ * current frame. rects holds count times x, y, width, height, with the
+ * origin at the bottom left, like limare_scissor(). The rest of the buffer
+ * is left as it is, so everything overlapping the damage still has to be
+ * drawn. A count of 0 renders the whole frame again.
+ */
+int
+limare_frame_damage(struct limare_state *state, int count, const int *rects)
+{
+	struct limare_frame *frame = state->frames[state->frame_current];
+	int i;
+
+	if (!frame) {
+		printf("%s: Error: no frame was set up!\n", __func__);
+		return -1;
+	}
+
+	if (count < 0) {
+		printf("%s: Error: invalid count %d\n", __func__, count);
+		return -1;
+	}
+
+	frame->damage_set = count ? 1 : 0;
+	frame->damage_count = 0;
+
+	for (i = 0; i < count; i++) {
+		struct limare_damage_rect rect;
+		int x0 = rects[4 * i + 0];
+		int y0 = state->height - (rects[4 * i + 1] + rects[4 * i + 3]);
+		int x1 = x0 + rects[4 * i + 2];
+		int y1 = y0 + rects[4 * i + 3];
+
+		if (x0 < 0)
+			x0 = 0;
+		if (y0 < 0)
+			y0 = 0;
+		if (x1 > state->width)
+			x1 = state->width;
+		if (y1 > state->height)
+			y1 = state->height;
+
+		if ((x0 >= x1) || (y0 >= y1))
+			continue;
+
+		rect.x0 = x0 >> 4;
+		rect.y0 = y0 >> 4;
+		rect.x1 = (x1 + 15) >> 4;
+		rect.y1 = (y1 + 15) >> 4;
+
+		damage_rect_add(frame->damage, &frame->damage_count, &rect);
+	}
+
+	return 0;
+}
+
+/*
+ * With two buffers, the one we render to still holds the frame before the
+ * previous one, so the damage of the previous frame needs to be redone as
+ * well.
+ */
+static void
+frame_damage_resolve(struct limare_state *state, struct limare_frame *frame)
+{
+	struct limare_damage_rect damage[LIMARE_DAMAGE_MAX];
+	int damage_set = frame->damage_set;
+	int damage_count = frame->damage_count;
+	int i;
+
+	memcpy(damage, frame->damage, sizeof(damage));
+
+	if (state->fb->dual_buffer && frame->damage_set) {
+		if (!state->damage_last_set || (frame->id < 2))
+			frame->damage_set = 0;
+		else
+			for (i = 0; i < state->damage_last_count; i++)
+				damage_rect_add(frame->damage,
+						&frame->damage_count,
+						&state->damage_last[i]);
+	}
+
+	state->damage_last_set = damage_set;
+	state->damage_last_count = damage_count;
+	memcpy(state->damage_last, damage, sizeof(damage));
+}
+
+int
+limare_frame_flush(struct limare_state *state)
+{
+	struct limare_frame *frame = state->frames[state->frame_current];
+
+	if (!frame) {
+		printf("%s: Error: no frame was set up!\n", __func__);
+		return -1;
+	}
+
+	pthread_mutex_lock(&frame->mutex);
+
+	plbu_commands_finish(frame);
+
+	frame_damage_resolve(state, frame);
+
+	if (frame->mem_used > state->frame_memory_max)
+		state->frame_memory_max = frame->mem_used;
+
+	frame->render_status = 1;
+
+	pthread_mutex_unlock(&frame->mutex);
+
+	limare_render_start(frame);
+
+	return 0;
+}
+
+/*
+ * Just run fflush(stdout) to give the wrapper library a chance to finish.
+ */
+void
+limare_finish(struct limare_state *state)
+{
+	printf("Max frame memory used: %d/%dkB\n",
+	       state->frame_memory_max / 1024, FRAME_MEMORY_SIZE / 1024);
+
+	printf("Auxiliary memory used: %d/%dkB\n",
+		       state->aux_mem_used / 1024, state->aux_mem_size / 1024);
+
+	limare_jobs_end(state);
+
+	fflush(stdout);
+	sleep(1);
+}
+
+static struct limare_program *
+limare_program_find(struct limare_state *state, int handle)
+{
+	int i;
+
+	for (i = 0; i < LIMARE_PROGRAM_COUNT; i++) {
+		struct limare_program *program = state->programs[i];
+
+		if (program && (program->handle == handle))
+			return program;
+	}
+
+	return NULL;
+}
+
+int
+limare_program_current(struct limare_state *state, int handle)
+{
+	struct limare_program *program = limare_program_find(state, handle);
+
+	if (!program) {
+		printf("%s: unable to find program with handle 0x%08X\n",
+		       __func__, handle);
+
+		return -1;
+	}
+
+	state->program_current = program;
+
+	return 0;
+}
+
+int
+limare_program_new(struct limare_state *state)
+{
+	struct limare_program *program;
+	int i;
+
+	for (i = 0; i < LIMARE_PROGRAM_COUNT; i++)
+		if (!state->programs[i])
+			break;
+
+	if (i == LIMARE_PROGRAM_COUNT) {
+		printf("%s: Error: no more program slots available!\n",
+		       __func__);
+		return -1;
+	}
+
+	program = limare_program_create(state->program_mem_address,
+					state->program_mem_physical,
+					i * LIMARE_PROGRAM_SIZE,
+					LIMARE_PROGRAM_SIZE);
+	if (!program)
+		return -ENOMEM;
+
+	program->handle = state->program_handles;
+	state->program_handles++;
+
+	state->program_current = program;
+	state->programs[i] = program;
+
+	return program->handle;
+}
+
+/*
+ * Frees the program and its slot. Frames still queued with this program
+ * must have been flushed and rendered before its slot gets reused.
+ */
+int
+limare_program_delete(struct limare_state *state, int handle)
+{
+	int i;
+
+	/* recorded lists point at its shaders and uniform symbols */
+	for (i = 0; i < LIMARE_COMMAND_LIST_COUNT; i++) {
+		struct limare_command_list *list = state->command_lists[i];
+		int j;
+
+		if (!list)
+			continue;
+
+		for (j = 0; j < list->program_count; j++)
+			if (list->programs[j] == handle)
+				list->program_deleted = 1;
+	}
+
+	for (i = 0; i < LIMARE_VARIANT_COUNT; i++) {
+		struct limare_program_variant *variant = state->variants[i];
+
+		if (variant && (variant->program_handle == handle)) {
+			free(variant->vertex_source);
+			free(variant->fragment_source);
+			free(variant->defines);
+			free(variant);
+			state->variants[i] = NULL;
+		}
+	}
+
+	for (i = 0; i < LIMARE_PROGRAM_COUNT; i++) {
+		struct limare_program *program = state->programs[i];
+
+		if (program && (program->handle == handle)) {
+			if (state->program_current == program)
+				state->program_current = NULL;
+
+			limare_program_destroy(program);
+			state->programs[i] = NULL;
+			return 0;
+		}
+	}
+
+	printf("%s: unable to find program with handle 0x%08X\n",
+	       __func__, handle);
+	return -1;
 }
 
 int
-limare_elements_buffer_upload(struct limare_state *state, int mode, int type,
-			      int count, void *data)
+vertex_shader_attach(struct limare_state *state, int handle,
+		     const char *source)
 {
-	struct limare_indices_buffer *buffer;
-	int i, size, start, end;
-	void *address;
+	struct limare_program *program = limare_program_find(state, handle);
 
-	for (i = 0; i < LIMARE_INDICES_BUFFER_COUNT; i++)
-		if (!state->indices_buffers[i])
+	if (!program) {
+		printf("%s: unable to find program with handle 0x%08X\n",
+		       __func__, handle);
+
+		return -1;
+	}
+
+	return limare_program_vertex_shader_attach(state, program, source);
+}
+
+int
+fragment_shader_attach(struct limare_state *state, int handle,
+		       const char *source)
+{
+	struct limare_program *program = limare_program_find(state, handle);
+
+	if (!program) {
+		printf("%s: unable to find program with handle 0x%08X\n",
+		       __func__, handle);
+
+		return -1;
+	}
+
+	return limare_program_fragment_shader_attach(state, program, source);
+}
+
+int
+vertex_shader_attach_mbs_file(struct limare_state *state, int handle,
+			      const char *filename)
+{
+	struct limare_program *program = limare_program_find(state, handle);
+
+	if (!program) {
+		printf("%s: unable to find program with handle 0x%08X\n",
+		       __func__, handle);
+
+		return -1;
+	}
+
+	return limare_program_vertex_shader_attach_mbs_file(state, program,
+							    filename);
+}
+
+int
+vertex_shader_attach_mbs_stream(struct limare_state *state, int handle,
+				const void *stream, int size)
+{
+	struct limare_program *program = limare_program_find(state, handle);
+
+	if (!program) {
+		printf("%s: unable to find program with handle 0x%08X\n",
+		       __func__, handle);
+
+		return -1;
+	}
+
+	return limare_program_vertex_shader_attach_mbs_stream(state, program,
+							      stream, size);
+}
+
+int
+fragment_shader_attach_mbs_file(struct limare_state *state, int handle,
+				const char *filename)
+{
+	struct limare_program *program = limare_program_find(state, handle);
+
+	if (!program) {
+		printf("%s: unable to find program with handle 0x%08X\n",
+		       __func__, handle);
+
+		return -1;
+	}
+
+	return limare_program_fragment_shader_attach_mbs_file(state, program,
+							      filename);
+}
+
+int
+fragment_shader_attach_mbs_stream(struct limare_state *state, int handle,
+				const void *stream, int size)
+{
+	struct limare_program *program = limare_program_find(state, handle);
+
+	if (!program) {
+		printf("%s: unable to find program with handle 0x%08X\n",
+		       __func__, handle);
+
+		return -1;
+	}
+
+	return limare_program_fragment_shader_attach_mbs_stream(state, program,
+							      stream, size);
+}
+
+int
+limare_link(struct limare_state *state)
+{
+	struct limare_program *program = state->program_current;
+
+	return limare_program_link(program);
+}
+
+static int
+limare_variant_define_compare(const void *a, const void *b)
+{
+	return strcmp(*(const char **) a, *(const char **) b);
+}
+
+/*
+ * Builds the "#define ...\n" block. Defines are sorted first, so that the
+ * order in which they are passed does not create duplicate variants.
+ */
+static char *
+limare_variant_defines_create(const char **defines, int define_count)
+{
+	const char *sorted[LIMARE_VARIANT_DEFINE_COUNT];
+	char *block;
+	int i, size = 1;
+
+	if (define_count) {
+		memcpy(sorted, defines, define_count * sizeof(char *));
+		qsort(sorted, define_count, sizeof(char *),
+		      limare_variant_define_compare);
+	}
+
+	for (i = 0; i < define_count; i++)
+		size += strlen("#define \n") + strlen(sorted[i]);
+
+	block = malloc(size);
+	if (!block) {
+		printf("%s: Error: failed to allocate defines: %s\n",
+		       __func__, strerror(errno));
+		return NULL;
+	}
+
+	block[0] = 0;
+	for (i = 0; i < define_count; i++) {
+		strcat(block, "#define ");
+		strcat(block, sorted[i]);
+		strcat(block, "\n");
+	}
+
+	return block;
+}
+
+/*
+ * Inserts the define block into the source, after a #version line if
+ * there is one.
+ */
+static char *
+limare_variant_source_create(const char *source, const char *defines)
+{
+	const char *body = source;
+	char *result;
+	int version_size = 0;
+
+	while ((*body == ' ') || (*body == '\t') || (*body == '\n'))
+		body++;
+
+	if (!strncmp(body, "#version", 8)) {
+		body = strchr(body, '\n');
+		if (body)
+			body++;
+		else
+			body = source + strlen(source);
+		version_size = body - source;
+	} else
+		body = source;
+
+	result = malloc(strlen(source) + strlen(defines) + 2);
+	if (!result) {
+		printf("%s: Error: failed to allocate source: %s\n",
+		       __func__, strerror(errno));
+		return NULL;
+	}
+
+	memcpy(result, source, version_size);
+	result[version_size] = 0;
+	if (version_size && (result[version_size - 1] != '\n'))
+		strcat(result, "\n");
+	strcat(result, defines);
+	strcat(result, body);
+
+	return result;
+}
+
+/*
+ * Returns a program compiled from the given sources with the given
+ * defines ("NAME" or "NAME value") prepended, reusing an earlier program
+ * when the same variant was asked for before. The program is made
+ * current.
+ */
+int
+limare_program_variant(struct limare_state *state,
+		       const char *vertex_source, const char *fragment_source,
+		       const char **defines, int define_count)
+{
+	struct limare_program_variant *variant;
+	unsigned int vertex_hash, fragment_hash;
+	char *block, *vertex = NULL, *fragment = NULL;
+	int i, handle = -1;
+
+	if ((define_count < 0) ||
+	    (define_count > LIMARE_VARIANT_DEFINE_COUNT)) {
+		printf("%s: Error: invalid define count %d\n",
+		       __func__, define_count);
+		return -1;
+	}
+
+	block = limare_variant_defines_create(defines, define_count);
+	if (!block)
+		return -1;
+
+	vertex_hash = lima_fnv_hash_string(LIMA_FNV_OFFSET, vertex_source);
+	fragment_hash = lima_fnv_hash_string(LIMA_FNV_OFFSET, fragment_source);
+
+	for (i = 0; i < LIMARE_VARIANT_COUNT; i++) {
+		variant = state->variants[i];
+
+		if (variant && (variant->vertex_hash == vertex_hash) &&
+		    (variant->fragment_hash == fragment_hash) &&
+		    !strcmp(variant->vertex_source, vertex_source) &&
+		    !strcmp(variant->fragment_source, fragment_source) &&
+		    !strcmp(variant->defines, block)) {
+			free(block);
+
+			if (limare_program_current(state,
+						   variant->program_handle))
+				return -1;
+			return variant->program_handle;
+		}
+	}
+
+	for (i = 0; i < LIMARE_VARIANT_COUNT; i++)
+		if (!state->variants[i])
 			break;
 
-	if (i == LIMARE_INDICES_BUFFER_COUNT) {
-		printf("%s: all indices buffer slots have been taken!\n",
+	if (i == LIMARE_VARIANT_COUNT) {
+		printf("%s: Error: no more variant slots available!\n",
+		       __func__);
+		free(block);
+		return -1;
+	}
+
+	variant = calloc(1, sizeof(struct limare_program_variant));
+	if (!variant) {
+		printf("%s: Error: failed to allocate variant: %s\n",
+		       __func__, strerror(errno));
+		free(block);
+		return -1;
+	}
+
+	variant->vertex_source = strdup(vertex_source);
+	variant->fragment_source = strdup(fragment_source);
+	if (!variant->vertex_source || !variant->fragment_source) {
+		printf("%s: Error: failed to copy sources: %s\n",
+		       __func__, strerror(errno));
+		goto error;
+	}
+
+	vertex = limare_variant_source_create(vertex_source, block);
+	fragment = limare_variant_source_create(fragment_source, block);
+	if (!vertex || !fragment)
+		goto error;
+
+	handle = limare_program_new(state);
+	if (handle < 0)
+		goto error;
+
+	if (vertex_shader_attach(state, handle, vertex) ||
+	    fragment_shader_attach(state, handle, fragment) ||
+	    limare_link(state)) {
+		limare_program_delete(state, handle);
+		handle = -1;
+		goto error;
+	}
+
+	free(vertex);
+	free(fragment);
+
+	variant->vertex_hash = vertex_hash;
+	variant->fragment_hash = fragment_hash;
+	variant->defines = block;
+	variant->program_handle = handle;
+
+	state->variants[i] = variant;
+
+	return handle;
+ error:
+	free(vertex);
+	free(fragment);
+	free(variant->vertex_source);
+	free(variant->fragment_source);
+	free(variant);
+	free(block);
+	return -1;
+}
+
+int
+limare_program_stats(struct limare_state *state, int handle,
+		     struct limare_program_stats *stats)
+{
+	struct limare_program *program = limare_program_find(state, handle);
+	struct lima_vertex_shader_stats vertex;
+	struct lima_fragment_shader_stats fragment;
+
+	if (!program) {
+		printf("%s: unable to find program with handle 0x%08X\n",
+		       __func__, handle);
+		return -1;
+	}
+
+	if (!program->vertex_shader || !program->fragment_shader) {
+		printf("%s: Error: program 0x%08X has no shaders attached.\n",
+		       __func__, handle);
+		return -1;
+	}
+
+	lima_vertex_shader_stats(program->vertex_shader,
+				 program->vertex_shader_size,
+				 program->vertex_attribute_prefetch, &vertex);
+	lima_fragment_shader_stats(program->fragment_shader,
+				   program->fragment_shader_size, &fragment);
+
+	stats->vertex_instructions = vertex.instructions;
+	stats->vertex_cycles = vertex.cycles;
+	stats->vertex_attribute_prefetch = vertex.attribute_prefetch;
+	stats->vertex_varying_stores = vertex.varying_stores;
+	stats->vertex_temporary_stores = vertex.temporary_stores;
+	stats->vertex_branches = vertex.branches;
+	stats->vertex_uniform_size = program->vertex_uniform_size;
+	stats->vertex_attribute_count = program->vertex_attribute_count;
+
+	stats->fragment_instructions = fragment.instructions;
+	stats->fragment_cycles = fragment.cycles;
+	stats->fragment_varying_fetches = fragment.varying_fetches;
+	stats->fragment_texture_fetches = fragment.texture_fetches;
+	stats->fragment_uniform_fetches = fragment.uniform_fetches;
+	stats->fragment_temporary_writes = fragment.temporary_writes;
+	stats->fragment_branches = fragment.branches;
+	stats->fragment_uniform_size = program->fragment_uniform_size;
+	stats->fragment_varying_count = program->fragment_varying_count;
+
+	return 0;
+}
+
+static struct limare_bundle *
+limare_bundle_find(struct limare_state *state, int handle)
+{
+	int i;
+
+	for (i = 0; i < LIMARE_BUNDLE_COUNT; i++) {
+		struct limare_bundle *bundle = state->bundles[i];
+
+		if (bundle && (bundle->handle == handle))
+			return bundle;
+	}
+
+	return NULL;
+}
+
+/*
+ * Checks that all offsets stay inside the file, so that lookups can
+ * trust the entries afterwards.
+ */
+static int
+limare_bundle_validate(struct limare_bundle *bundle, const char *filename)
+{
+	const struct lima_bundle_header *header = bundle->address;
+	const struct lima_bundle_entry *entries = bundle->address +
+		sizeof(struct lima_bundle_header);
+	int i;
+
+	if ((bundle->size < (int) sizeof(struct lima_bundle_header)) ||
+	    (header->magic != LIMA_BUNDLE_MAGIC)) {
+		printf("%s: Error: %s is not a shader bundle.\n",
+		       __func__, filename);
+		return -1;
+	}
+
+	if (header->version != LIMA_BUNDLE_VERSION) {
+		printf("%s: Error: %s has unsupported version %d.\n",
+		       __func__, filename, header->version);
+		return -1;
+	}
+
+	if ((header->size != bundle->size) || (header->count < 0) ||
+	    (header->count > ((bundle->size - (int)
+			       sizeof(struct lima_bundle_header)) /
+			      (int) sizeof(struct lima_bundle_entry)))) {
+		printf("%s: Error: %s is truncated.\n", __func__, filename);
+		return -1;
+	}
+
+	for (i = 0; i < header->count; i++) {
+		const struct lima_bundle_entry *entry = &entries[i];
+
+		if ((entry->name_offset < 0) ||
+		    (entry->name_offset >= bundle->size) ||
+		    !memchr(bundle->address + entry->name_offset, 0,
+			    bundle->size - entry->name_offset) ||
+		    (entry->vertex_offset < 0) || (entry->vertex_size <= 0) ||
+		    (entry->vertex_size >
+		     (bundle->size - entry->vertex_offset)) ||
+		    (entry->fragment_offset < 0) ||
+		    (entry->fragment_size <= 0) ||
+		    (entry->fragment_size >
+		     (bundle->size - entry->fragment_offset)) ||
+		    (i && (entry->hash < entries[i - 1].hash))) {
+			printf("%s: Error: %s: entry %d is corrupt.\n",
+			       __func__, filename, i);
+			return -1;
+		}
+	}
+
+	bundle->header = header;
+	bundle->entries = entries;
+
+	return 0;
+}
+
+int
+limare_bundle_open(struct limare_state *state, const char *filename)
+{
+	struct limare_bundle *bundle;
+	struct stat buf;
+	int fd, i;
+
+	for (i = 0; i < LIMARE_BUNDLE_COUNT; i++)
+		if (!state->bundles[i])
+			break;
+
+	if (i == LIMARE_BUNDLE_COUNT) {
+		printf("%s: Error: no more bundle slots available!\n",
 		       __func__);
 		return -1;
 	}
 
-	buffer = calloc(1, sizeof(struct limare_indices_buffer));
-	if (!buffer) {
-		printf("%s: Error: failed to allocate indices buffer: %s\n",
-		       __func__, strerror(errno));
+	fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		printf("%s: Error: failed to open %s: %s\n",
+		       __func__, filename, strerror(errno));
 		return -1;
 	}
 
-	buffer->drawing_mode = mode;
-	buffer->indices_type = type;
-	buffer->count = count;
-
-	if (type == GL_UNSIGNED_BYTE) {
-		size = count;
-		elements_count_byte(data, count, &start, &end);
-	} else if (type == GL_UNSIGNED_SHORT) {
-		size = count * 2;
-		elements_count_word(data, count, &start, &end);
-	} else {
-		printf("%s: only bytes and shorts supported.\n", __func__);
+	if (fstat(fd, &buf)) {
+		printf("%s: Error: failed to stat %s: %s\n",
+		       __func__, filename, strerror(errno));
+		close(fd);
 		return -1;
 	}
 
-	buffer->start = start;
-
-	if ((state->aux_mem_size - state->aux_mem_used) <
-	    (0x40 + ALIGN(size, 0x40))) {
-		printf("%s: no space for indices\n", __func__);
-		free(buffer);
+	bundle = calloc(1, sizeof(struct limare_bundle));
+	if (!bundle) {
+		printf("%s: Error: failed to allocate bundle: %s\n",
+		       __func__, strerror(errno));
+		close(fd);
 		return -1;
 	}
 
-	address = state->aux_mem_address + state->aux_mem_used;
-	buffer->mem_physical = state->aux_mem_physical + state->aux_mem_used;
-	state->aux_mem_used += ALIGN(size, 0x40);
+	bundle->size = buf.st_size;
+	bundle->address = mmap(NULL, bundle->size, PROT_READ, MAP_SHARED,
+			       fd, 0);
+	close(fd);
+	if (bundle->address == MAP_FAILED) {
+		printf("%s: Error: failed to mmap %s: %s\n",
+		       __func__, filename, strerror(errno));
+		free(bundle);
+		return -1;
+	}
 
-	memcpy(address, data, size);
+	if (limare_bundle_validate(bundle, filename)) {
+		munmap(bundle->address, bundle->size);
+		free(bundle);
+		return -1;
+	}
 
-	buffer->handle = 0x40000000 + state->indices_buffer_handles;
-	state->indices_buffer_handles++;
+	bundle->handle = 0x20000000 + state->bundle_handles;
+	state->bundle_handles++;
 
-	state->indices_buffers[i] = buffer;
+	state->bundles[i] = bundle;
 
-	return buffer->handle;
+	return bundle->handle;
 }
 
 int
-limare_draw_elements_buffer(struct limare_state *state, int buffer_handle)
+limare_bundle_close(struct limare_state *state, int handle)
 {
-	struct limare_indices_buffer *buffer;
 	int i;
 
-	for (i = 0; i < LIMARE_INDICES_BUFFER_COUNT; i++) {
-		if (!state->indices_buffers[i])
-			continue;
+	for (i = 0; i < LIMARE_BUNDLE_COUNT; i++) {
+		struct limare_bundle *bundle = state->bundles[i];
 
-		buffer = state->indices_buffers[i];
-		if (buffer->handle == buffer_handle)
-			break;
+		if (bundle && (bundle->handle == handle)) {
+			munmap(bundle->address, bundle->size);
+			free(bundle);
+			state->bundles[i] = NULL;
+			return 0;
+		}
 	}
 
-	if (i == LIMARE_INDICES_BUFFER_COUNT) {
-		printf("%s: Error: unable to fine handle 0x%08X\n",
-		       __func__, buffer_handle);
-		return -1;
+	printf("%s: unable to find bundle with handle 0x%08X\n",
+	       __func__, handle);
+	return -1;
+}
+
+/*
+ * Binary search on the name hash, then walk the (rare) colliding
+ * neighbours comparing the actual names.
+ */
+static const struct lima_bundle_entry *
+limare_bundle_lookup(struct limare_bundle *bundle, const char *name)
+{
+	const struct lima_bundle_entry *entries = bundle->entries;
+	unsigned int hash = lima_bundle_hash(name);
+	int low = 0, high = bundle->header->count;
+
+	while (low < high) {
+		int middle = (low + high) / 2;
+
+		if (entries[middle].hash < hash)
+			low = middle + 1;
+		else
+			high = middle;
 	}
 
-	return limare_draw(state, buffer->drawing_mode, buffer->start,
-			   buffer->count, buffer);
+	for (; (low < bundle->header->count) &&
+		     (entries[low].hash == hash); low++)
+		if (!strcmp(bundle->address + entries[low].name_offset, name))
+			return &entries[low];
+
+	return NULL;
 }
 
+/*
+ * Creates and links a program straight from the precompiled streams in
+ * a bundle. Linking itself still happens here, as the vertex shader gets
+ * patched against the fragment shader varyings.
+ */
 int
-limare_frame_flush(struct limare_state *state)
+limare_program_new_bundle(struct limare_state *state, int bundle_handle,
+			  const char *name)
 {
-	struct limare_frame *frame = state->frames[state->frame_current];
+	struct limare_bundle *bundle = limare_bundle_find(state, bundle_handle);
+	const struct lima_bundle_entry *entry;
+	struct limare_program *program;
+	int handle, ret;
 
-	if (!frame) {
-		printf("%s: Error: no frame was set up!\n", __func__);
+	if (!bundle) {
+		printf("%s: unable to find bundle with handle 0x%08X\n",
+		       __func__, bundle_handle);
 		return -1;
 	}
 
-	pthread_mutex_lock(&frame->mutex);
+	entry = limare_bundle_lookup(bundle, name);
+	if (!entry) {
+		printf("%s: Error: bundle has no program \"%s\".\n",
+		       __func__, name);
+		return -1;
+	}
 
-	plbu_commands_finish(frame);
+	handle = limare_program_new(state);
+	if (handle < 0)
+		return handle;
 
-	if (frame->mem_used > state->frame_memory_max)
-		state->frame_memory_max = frame->mem_used;
+	ret = vertex_shader_attach_mbs_stream(state, handle,
+					      bundle->address +
+					      entry->vertex_offset,
+					      entry->vertex_size);
+	if (ret)
+		goto error;
 
-	frame->render_status = 1;
+	ret = fragment_shader_attach_mbs_stream(state, handle,
+						bundle->address +
+						entry->fragment_offset,
+						entry->fragment_size);
+	if (ret)
+		goto error;
 
-	pthread_mutex_unlock(&frame->mutex);
+	ret = limare_link(state);
+	if (ret)
+		goto error;
 
-	limare_render_start(frame);
+	/* the writer parsed the same streams, so these have to match. */
+	program = state->program_current;
+	if ((program->vertex_shader_size != entry->vertex_shader_size) ||
+	    (program->vertex_attribute_prefetch !=
+	     entry->vertex_attribute_prefetch) ||
+	    (program->fragment_shader_size != entry->fragment_shader_size) ||
+	    (program->fragment_first_instruction_size !=
+	     entry->fragment_first_instruction_size)) {
+		printf("%s: Error: bundle entry for \"%s\" does not match "
+		       "its shaders.\n", __func__, name);
+		ret = -1;
+		goto error;
+	}
 
-	return 0;
+	return handle;
+ error:
+	limare_program_delete(state, handle);
+	return ret;
 }
 
-/*
- * Just run fflush(stdout) to give the wrapper library a chance to finish.
- */
-void
-limare_finish(struct limare_state *state)
+#include "shader_clear.c"
+
+static int
+limare_depth_buffer_clear_init(struct limare_state *state)
 {
-	printf("Max frame memory used: %d/%dkB\n",
-	       state->frame_memory_max / 1024, FRAME_MEMORY_SIZE / 1024);
+	struct limare_program *program;
+	unsigned int *shader = mbs_fragment_clear;
+	int shader_size = sizeof(mbs_fragment_clear);
+	int ret;
 
-	printf("Auxiliary memory used: %d/%dkB\n",
-		       state->aux_mem_used / 1024, state->aux_mem_size / 1024);
+	if ((state->aux_mem_size - state->aux_mem_used) < 0x80) {
+		printf("%s: no space left!\n", __func__);
+		return -ENOMEM;
+	}
 
-	limare_jobs_end(state);
+	/* waste space for the vertex shader... */
+	program = limare_program_create(state->aux_mem_address,
+					state->aux_mem_physical,
+					state->aux_mem_used, 0x80);
+	if (!program)
+		return -ENOMEM;
 
-	fflush(stdout);
-	sleep(1);
+	ret = limare_program_fragment_shader_attach_mbs_stream(state, program,
+							       shader,
+							       shader_size);
+	if (ret) {
+		limare_program_destroy(program);
+		return ret;
+	}
+
+	ret = limare_depth_clear_link(state, program);
+	if (ret) {
+		limare_program_destroy(program);
+		return ret;
+	}
+
+	state->depth_buffer_clear_program = program;
+
+	state->aux_mem_used += 0x80;
+
+	return 0;
 }
 
-static struct limare_program *
-limare_program_find(struct limare_state *state, int handle)
+static int
+depth_buffer_clear(struct limare_state *state, struct limare_frame *frame)
 {
-	int i;
+	struct render_state template = {
+		0x00000000, 0x00000000, 0x0C321892, 0x0000003F,
+		0xFFFF0000, 0x00000007, 0x00000007, 0x00000000,
+		0x0000F007, 0x00000000, 0x00000000, 0x00000000,
+		0x00000000, 0x00000000, 0x00000000, 0x00000000
+	};
+	struct draw_info *draw;
+	float vertices[12] = {
+		   0.0,    0.0, 1.0, 1.0,
+		4096.0,    0.0, 1.0, 1.0,
+		   0.0, 4096.0, 1.0, 1.0,
+	};
+	unsigned int vertices_physical;
+	unsigned char indices[3] = {0x00, 0x01, 0x02};
+	unsigned int indices_physical;
+	int ret;
 
-	for (i = 0; i < LIMARE_PROGRAM_COUNT; i++) {
-		struct limare_program *program = state->programs[i];
+	if (!state->depth_buffer_clear_program) {
+		ret = limare_depth_buffer_clear_init(state);
+		if (ret)
+			return ret;
+	}
 
-		if (program && (program->handle == handle))
-			return program;
+	if ((frame->mem_size - frame->mem_used) < 0x80) {
+		printf("%s: no space left!\n", __func__);
+		return -ENOMEM;
 	}
 
-	return NULL;
+	vertices[2] = state->depth_clear_depth;
+	vertices[6] = state->depth_clear_depth;
+	vertices[10] = state->depth_clear_depth;
+
+	vertices_physical = frame->mem_physical + frame->mem_used;
+	memcpy(frame->mem_address + frame->mem_used, vertices,
+	       12 * sizeof(float));
+
+	indices_physical = frame->mem_physical + frame->mem_used + 0x40;
+	memcpy(frame->mem_address + frame->mem_used + 0x40, indices, 3);
+
+	frame->mem_used += 0x80;
+
+	draw = draw_create_new(state, frame, LIMA_DRAW_QUAD_DIRECT, 3, 0, 3);
+	if (frame_draw_add(frame, draw))
+		return -1;
+
+	plbu_info_attach_indices(draw, GL_UNSIGNED_BYTE, indices_physical);
+
+	draw_render_state_create(frame, state->depth_buffer_clear_program, draw,
+				 &template);
+	return plbu_commands_depth_buffer_clear_draw_add(state, frame, draw,
+							 vertices_physical);
 }
 
 int
-limare_program_current(struct limare_state *state, int handle)
+limare_depth_buffer_clear(struct limare_state *state)
 {
-	struct limare_program *program = limare_program_find(state, handle);
+	struct limare_draw_target target;
+	struct limare_frame *frame;
+	int i, ret;
 
-	if (!program) {
-		printf("%s: unable to find program with handle 0x%08X\n",
-		       __func__, handle);
+	limare_draw_target_get(state, &target);
 
-		return -1;
-	}
+	for (i = 0; i < target.count; i++) {
+		frame = limare_draw_target_frame(state, &target, i);
 
-	state->program_current = program;
+		ret = depth_buffer_clear(state, frame);
+		if (ret)
+			return ret;
+	}
 
 	return 0;
 }
 
-int
-limare_program_new(struct limare_state *state)
+static struct limare_command_list *
+limare_command_list_find(struct limare_state *state, int handle)
 {
-	struct limare_program *program;
 	int i;
 
-	for (i = 0; i < LIMARE_PROGRAM_COUNT; i++)
-		if (!state->programs[i])
-			break;
+	for (i = 0; i < LIMARE_COMMAND_LIST_COUNT; i++)
+		if (state->command_lists[i] &&
+		    (state->command_lists[i]->handle == handle))
+			return state->command_lists[i];
 
-	if (i == LIMARE_PROGRAM_COUNT) {
-		printf("%s: Error: no more program slots available!\n",
-		       __func__);
-		return -1;
+	return NULL;
+}
+
+static struct limare_frame *
+command_list_frame_create(struct limare_state *state,
+			  struct limare_command_list *list, int slot, int size)
+{
+	struct limare_frame *frame;
+	int ret;
+
+	if ((state->aux_mem_size - state->aux_mem_used) < size) {
+		printf("%s: Error: no space for command list\n", __func__);
+		return NULL;
 	}
 
-	program = limare_program_create(state->program_mem_address,
-					state->program_mem_physical,
-					i * LIMARE_PROGRAM_SIZE,
-					LIMARE_PROGRAM_SIZE);
-	if (!program)
-		return -ENOMEM;
+	frame = calloc(1, sizeof(struct limare_frame));
+	if (!frame) {
+		printf("%s: Error: failed to allocate frame: %s\n",
+		       __func__, strerror(errno));
+		return NULL;
+	}
 
-	program->handle = state->program_handles;
-	state->program_handles++;
+	ret = pthread_mutex_init(&frame->mutex, NULL);
+	if (ret)
+		printf("%s: pthread_mutex_init failed: %s\n",
+		       __func__, strerror(ret));
 
-	state->program_current = program;
-	state->programs[i] = program;
+	frame->state = state;
+	frame->command_list = list;
+	frame->command_list_slot = slot;
 
-	return program->handle;
+	frame->mem_size = size;
+	frame->mem_used = 0;
+	frame->mem_physical = state->aux_mem_physical + state->aux_mem_used;
+	frame->mem_address = state->aux_mem_address + state->aux_mem_used;
+	state->aux_mem_used += size;
+
+	if (vs_command_queue_create(frame, COMMAND_LIST_BUFFER_SIZE) ||
+	    plbu_command_list_create(frame, COMMAND_LIST_BUFFER_SIZE)) {
+		limare_frame_destroy(frame);
+		return NULL;
+	}
+
+	return frame;
 }
 
+/*
+ * Creates an empty command list, with size bytes of aux memory for each
+ * frame slot. This memory is never handed back.
+ */
 int
-vertex_shader_attach(struct limare_state *state, int handle,
-		     const char *source)
+limare_command_list_new(struct limare_state *state, int size)
 {
-	struct limare_program *program = limare_program_find(state, handle);
+	struct limare_command_list *list;
+	int i, j;
 
-	if (!program) {
-		printf("%s: unable to find program with handle 0x%08X\n",
-		       __func__, handle);
+	for (i = 0; i < LIMARE_COMMAND_LIST_COUNT; i++)
+		if (!state->command_lists[i])
+			break;
 
+	if (i == LIMARE_COMMAND_LIST_COUNT) {
+		printf("%s: Error: no more command list slots available!\n",
+		       __func__);
 		return -1;
 	}
 
-	return limare_program_vertex_shader_attach(state, program, source);
+	list = calloc(1, sizeof(struct limare_command_list));
+	if (!list) {
+		printf("%s: Error: failed to allocate command list: %s\n",
+		       __func__, strerror(errno));
+		return -1;
+	}
+
+	size = ALIGN(size, 0x40);
+
+	for (j = 0; j < FRAME_COUNT; j++) {
+		list->frames[j] = command_list_frame_create(state, list, j,
+							    size);
+		if (!list->frames[j]) {
+			for (j--; j >= 0; j--)
+				limare_frame_destroy(list->frames[j]);
+			free(list);
+			return -1;
+		}
+	}
+
+	for (j = 0; j < FRAME_COUNT; j++)
+		list->replay_frame[j] = -1;
+
+	list->handle = 0x08000000 + state->command_list_handles;
+	state->command_list_handles++;
+
+	state->command_lists[i] = list;
+
+	return list->handle;
 }
 
+/*
+ * Uniforms set on a list before recording become patchable: every replay
+ * writes the current value into the recorded draws. Values can be updated
+ * at any time afterwards.
+ */
 int
-fragment_shader_attach(struct limare_state *state, int handle,
-		       const char *source)
+limare_command_list_uniform_set(struct limare_state *state, int handle,
+				const char *name, int count,
+				const float *data)
 {
-	struct limare_program *program = limare_program_find(state, handle);
+	struct limare_command_list *list =
+		limare_command_list_find(state, handle);
+	struct limare_command_list_uniform *uniform = NULL;
+	int i;
 
-	if (!program) {
-		printf("%s: unable to find program with handle 0x%08X\n",
+	if (!list) {
+		printf("%s: unable to find command list with handle 0x%08X\n",
 		       __func__, handle);
+		return -1;
+	}
+
+	for (i = 0; i < list->uniform_count; i++)
+		if (!strcmp(list->uniforms[i].name, name)) {
+			uniform = &list->uniforms[i];
+			break;
+		}
 
+	if (uniform && (uniform->count != count)) {
+		printf("%s: Error: Uniform %s has wrong dimensions\n",
+		       __func__, name);
 		return -1;
 	}
 
-	return limare_program_fragment_shader_attach(state, program, source);
-}
+	if (!uniform) {
+		if (list->recorded || (state->command_list_recording == list)) {
+			printf("%s: Error: uniform %s was not set before "
+			       "recording\n", __func__, name);
+			return -1;
+		}
 
-int
-vertex_shader_attach_mbs_file(struct limare_state *state, int handle,
-			      const char *filename)
-{
-	struct limare_program *program = limare_program_find(state, handle);
+		if (list->uniform_count == LIMARE_COMMAND_LIST_UNIFORM_COUNT) {
+			printf("%s: Error: command list has too many "
+			       "uniforms!\n", __func__);
+			return -1;
+		}
 
-	if (!program) {
-		printf("%s: unable to find program with handle 0x%08X\n",
-		       __func__, handle);
+		uniform = &list->uniforms[list->uniform_count];
+		uniform->name = strdup(name);
+		uniform->data = malloc(count * sizeof(float));
+		uniform->data_half = malloc(count * sizeof(hfloat));
+		if (!uniform->name || !uniform->data || !uniform->data_half) {
+			printf("%s: Error: failed to allocate uniform %s: %s\n",
+			       __func__, name, strerror(errno));
+			free(uniform->name);
+			free(uniform->data);
+			free(uniform->data_half);
+			memset(uniform, 0, sizeof(*uniform));
+			return -1;
+		}
 
-		return -1;
+		uniform->count = count;
+		list->uniform_count++;
 	}
 
-	return limare_program_vertex_shader_attach_mbs_file(state, program,
-							    filename);
+	memcpy(uniform->data, data, count * sizeof(float));
+	for (i = 0; i < count; i++)
+		uniform->data_half[i] = float_to_hfloat(data[i]);
+
+	return 0;
 }
 
+/*
+ * Until limare_command_list_end(), all draws and depth clears go into the
+ * list instead of the current frame. A list can only be recorded once.
+ */
 int
-vertex_shader_attach_mbs_stream(struct limare_state *state, int handle,
-				const void *stream, int size)
+limare_command_list_begin(struct limare_state *state, int handle)
 {
-	struct limare_program *program = limare_program_find(state, handle);
+	struct limare_command_list *list =
+		limare_command_list_find(state, handle);
 
-	if (!program) {
-		printf("%s: unable to find program with handle 0x%08X\n",
+	if (!list) {
+		printf("%s: unable to find command list with handle 0x%08X\n",
 		       __func__, handle);
-
 		return -1;
 	}
 
-	return limare_program_vertex_shader_attach_mbs_stream(state, program,
-							      stream, size);
-}
-
-int
-fragment_shader_attach_mbs_file(struct limare_state *state, int handle,
-				const char *filename)
-{
-	struct limare_program *program = limare_program_find(state, handle);
+	if (state->command_list_recording) {
+		printf("%s: Error: already recording a command list\n",
+		       __func__);
+		return -1;
+	}
 
-	if (!program) {
-		printf("%s: unable to find program with handle 0x%08X\n",
+	if (list->recorded) {
+		printf("%s: Error: command list 0x%08X was recorded already\n",
 		       __func__, handle);
-
 		return -1;
 	}
 
-	return limare_program_fragment_shader_attach_mbs_file(state, program,
-							      filename);
+	state->command_list_recording = list;
+
+	/* make the list set up all of its own plbu state. */
+	state->viewport_dirty = 1;
+	state->scissor_dirty = 1;
+	state->depth_dirty = 1;
+
+	return 0;
 }
 
 int
-fragment_shader_attach_mbs_stream(struct limare_state *state, int handle,
-				const void *stream, int size)
+limare_command_list_end(struct limare_state *state)
 {
-	struct limare_program *program = limare_program_find(state, handle);
-
-	if (!program) {
-		printf("%s: unable to find program with handle 0x%08X\n",
-		       __func__, handle);
+	struct limare_command_list *list = state->command_list_recording;
 
+	if (!list) {
+		printf("%s: Error: not recording a command list\n", __func__);
 		return -1;
 	}
 
-	return limare_program_fragment_shader_attach_mbs_stream(state, program,
-							      stream, size);
-}
+	list->recorded = 1;
+	state->command_list_recording = NULL;
 
-int
-limare_link(struct limare_state *state)
-{
-	struct limare_program *program = state->program_current;
+	/* the frame still has to get our current state. */
+	state->viewport_dirty = 1;
+	state->scissor_dirty = 1;
+	state->depth_dirty = 1;
 
-	return limare_program_link(program);
+	return 0;
 }
 
-#include "shader_clear.c"
-
-static int
-limare_depth_buffer_clear_init(struct limare_state *state)
+static void
+command_list_patches_apply(struct limare_command_list *list, int slot)
 {
-	struct limare_program *program;
-	unsigned int *shader = mbs_fragment_clear;
-	int shader_size = sizeof(mbs_fragment_clear);
-	int ret;
+	struct limare_frame *frame = list->frames[slot];
+	int i, j;
+
+	for (i = 0; i < list->patch_count[slot]; i++) {
+		struct limare_command_list_patch *patch =
+			&list->patches[slot][i];
+		struct limare_command_list_uniform *uniform =
+			&list->uniforms[patch->uniform];
+		struct symbol *symbol = patch->symbol;
+		void *address = frame->mem_address + patch->offset;
+		void *data;
+
+		if (symbol->precision == 3)
+			data = uniform->data;
+		else
+			data = uniform->data_half;
 
-	if ((state->aux_mem_size - state->aux_mem_used) < 0x80) {
-		printf("%s: no space left!\n", __func__);
-		return -ENOMEM;
+		if (symbol->src_stride == symbol->dst_stride)
+			memcpy(address, data, symbol->size);
+		else
+			for (j = 0; (j * symbol->src_stride) < symbol->size;
+			     j++)
+				memcpy(address + (j * symbol->dst_stride),
+				       data + (j * symbol->src_stride),
+				       symbol->src_stride);
 	}
+}
 
-	/* waste space for the vertex shader... */
-	program = limare_program_create(state->aux_mem_address,
-					state->aux_mem_physical,
-					state->aux_mem_used, 0x80);
-	if (!program)
-		return -ENOMEM;
+/*
+ * Copies the commands recorded for this frame slot into the current frame,
+ * after patching in the current uniform values.
+ */
+int
+limare_command_list_replay(struct limare_state *state, int handle)
+{
+	struct limare_frame *frame = state->frames[state->frame_current];
+	struct limare_command_list *list =
+		limare_command_list_find(state, handle);
+	int slot = state->frame_current;
 
-	ret = limare_program_fragment_shader_attach_mbs_stream(state, program,
-							       shader,
-							       shader_size);
-	if (ret) {
-		free(program);
-		return ret;
+	if (!list) {
+		printf("%s: unable to find command list with handle 0x%08X\n",
+		       __func__, handle);
+		return -1;
 	}
 
-	ret = limare_depth_clear_link(state, program);
-	if (ret) {
-		/* TODO: clean up properly here. */
-		return ret;
+	if (!frame) {
+		printf("%s: Error: no frame was set up!\n", __func__);
+		return -1;
 	}
 
-	state->depth_buffer_clear_program = program;
-
-	state->aux_mem_used += 0x80;
-
-	return 0;
-}
-
-int
-limare_depth_buffer_clear(struct limare_state *state)
-{
-	struct limare_frame *frame = state->frames[state->frame_current];
-	struct render_state template = {
-		0x00000000, 0x00000000, 0x0C321892, 0x0000003F,
-		0xFFFF0000, 0x00000007, 0x00000007, 0x00000000,
-		0x0000F007, 0x00000000, 0x00000000, 0x00000000,
-		0x00000000, 0x00000000, 0x00000000, 0x00000000
-	};
-	struct draw_info *draw;
-	float vertices[12] = {
-		   0.0,    0.0, 1.0, 1.0,
-		4096.0,    0.0, 1.0, 1.0,
-		   0.0, 4096.0, 1.0, 1.0,
-	};
-	unsigned int vertices_physical;
-	unsigned char indices[3] = {0x00, 0x01, 0x02};
-	unsigned int indices_physical;
-	int ret;
+	if (!list->recorded) {
+		printf("%s: Error: command list 0x%08X was not recorded\n",
+		       __func__, handle);
+		return -1;
+	}
 
-	if (!state->depth_buffer_clear_program) {
-		ret = limare_depth_buffer_clear_init(state);
-		if (ret)
-			return ret;
+	if (state->command_list_recording) {
+		printf("%s: Error: cannot replay while recording\n",
+		       __func__);
+		return -1;
 	}
 
-	if (frame->draw_count >= LIMARE_DRAW_COUNT) {
-		printf("%s: Error: too many draws already!\n", __func__);
+	if (list->program_deleted) {
+		printf("%s: Error: a program of command list 0x%08X was "
+		       "deleted\n", __func__, handle);
 		return -1;
 	}
 
-	if ((frame->mem_size - frame->mem_used) < 0x80) {
-		printf("%s: no space left!\n", __func__);
-		return -ENOMEM;
+	/* a second replay would overwrite the uniforms of the first */
+	if (list->uniform_count && (list->replay_frame[slot] == frame->id)) {
+		printf("%s: Error: command list 0x%08X with uniforms was "
+		       "replayed in this frame already\n", __func__, handle);
+		return -1;
 	}
+	list->replay_frame[slot] = frame->id;
 
-	vertices[2] = state->depth_clear_depth;
-	vertices[6] = state->depth_clear_depth;
-	vertices[10] = state->depth_clear_depth;
+	command_list_patches_apply(list, slot);
 
-	vertices_physical = frame->mem_physical + frame->mem_used;
-	memcpy(frame->mem_address + frame->mem_used, vertices,
-	       12 * sizeof(float));
+	if (vs_commands_copy(frame, list->frames[slot]) ||
+	    plbu_commands_copy(frame, list->frames[slot]))
+		return -1;
 
-	indices_physical = frame->mem_physical + frame->mem_used + 0x40;
-	memcpy(frame->mem_address + frame->mem_used + 0x40, indices, 3);
+	/* the list left the plbu in an unknown state. */
+	frame->plbu_shadow_valid = 0;
+	state->viewport_dirty = 1;
+	state->scissor_dirty = 1;
+	state->depth_dirty = 1;
 
-	frame->mem_used += 0x80;
+	return 0;
+}
 
-	draw = draw_create_new(state, frame, LIMA_DRAW_QUAD_DIRECT, 3, 0, 3);
-	frame->draws[frame->draw_count] = draw;
-	frame->draw_count++;
+/*
+ * Size the tile heap after what the plbu used of it. A stall or a nearly
+ * full heap grows it straight away, a mostly empty heap shrinks after
+ * TILE_HEAP_ADAPT_FRAMES. Frames rebuild their static area on a change.
+ */
+static void
+tile_heap_adapt(struct limare_state *state, struct limare_frame *frame)
+{
+	int used = frame->tile_heap_used;
+	int size;
 
-	plbu_info_attach_indices(draw, GL_UNSIGNED_BYTE, indices_physical);
+	if (frame->tile_heap_size != state->tile_heap_size)
+		return;
 
-	draw_render_state_create(frame, state->depth_buffer_clear_program, draw,
-				 &template);
-	plbu_commands_depth_buffer_clear_draw_add(state, frame, draw,
-						  vertices_physical);
+	if (state->tile_heap_peak < used)
+		state->tile_heap_peak = used;
+	state->tile_heap_frames++;
 
-	return 0;
+	if (frame->tile_heap_stalled || (4 * used > 3 * frame->tile_heap_size))
+		size = used + used / 2;
+	else if (state->tile_heap_frames >= TILE_HEAP_ADAPT_FRAMES) {
+		if (2 * state->tile_heap_peak < state->tile_heap_size)
+			size = state->tile_heap_peak + state->tile_heap_peak / 2;
+		else
+			size = state->tile_heap_size;
+	} else
+		return;
+
+	state->tile_heap_frames = 0;
+	state->tile_heap_peak = 0;
+
+	size = ALIGN(size, 0x10000);
+	if (size < TILE_HEAP_SIZE_MIN)
+		size = TILE_HEAP_SIZE_MIN;
+	else if (size > TILE_HEAP_SIZE_MAX)
+		size = TILE_HEAP_SIZE_MAX;
+
+	state->tile_heap_size = size;
 }
 
 int
@@ -1669,16 +4467,21 @@ limare_frame_new(struct limare_state *state)
 
 		state->frames[state->frame_current] = NULL;
 
-		limare_frame_destroy(frame);
+		if (state->plb_adaptive)
+			plb_adapt(state, frame);
+
+		tile_heap_adapt(state, frame);
 	}
 
 	state->frames[state->frame_current] =
-		limare_frame_create(state,
+		limare_frame_create(state, frame,
 				    FRAME_MEMORY_SIZE * state->frame_current,
 				    FRAME_MEMORY_SIZE);
 	if (!state->frames[state->frame_current])
 		return -1;
 
+	plb_retired_release(state);
+
 	state->frame_count++;
 
 #if 1
@@ -1701,6 +4504,105 @@ limare_buffer_swap(struct limare_state *state)
 	/* done as part of the render thread */
 }
 
+/*
+ * Let the plb block size follow the gp/pp balance, see plb_adapt().
+ */
+int
+limare_plb_adaptive_set(struct limare_state *state, int enable)
+{
+	state->plb_adaptive = enable;
+
+	state->plb_frames = 0;
+	state->plb_gp_time = 0;
+	state->plb_pp_time = 0;
+	state->plb_heap_used = 0;
+
+	return 0;
+}
+
+/*
+ * Switches the pp over to another tile order. Frames pick up the new plb
+ * as they get rebuilt.
+ */
+int
+limare_tile_order_set(struct limare_state *state, int order)
+{
+	struct plb_info *plb;
+
+	if ((order < 0) || (order >= LIMARE_TILE_ORDER_COUNT)) {
+		printf("%s: Error: unknown tile order %d\n", __func__, order);
+		return -1;
+	}
+
+	if (state->tile_order == order)
+		return 0;
+
+	/* not set up yet, limare_state_setup() will use it. */
+	if (!state->plb) {
+		state->tile_order = order;
+		return 0;
+	}
+
+	if (state->plb_retired) {
+		printf("%s: Error: previous plb is still in use\n", __func__);
+		return -1;
+	}
+
+	state->tile_order = order;
+
+	plb = plb_info_create(state, state->plb_block_limit);
+	if (!plb)
+		return -1;
+
+	state->plb_retired = state->plb;
+	state->plb = plb;
+
+	return 0;
+}
+
+/*
+ * Which pp performance counters to read out, -1 disables a counter.
+ */
+int
+limare_pp_perf_counters_set(struct limare_state *state,
+			    int source0, int source1)
+{
+	state->pp_perf_counter_source[0] = source0;
+	state->pp_perf_counter_source[1] = source1;
+
+	return 0;
+}
+
+/*
+ * Waits for all queued frames to be rendered, and then hands out the pp
+ * statistics gathered since the last reset.
+ */
+int
+limare_pp_stats_get(struct limare_state *state,
+		    struct limare_pp_stats *stats, int reset)
+{
+	int i;
+
+	for (i = 0; i < FRAME_COUNT; i++) {
+		struct limare_frame *frame = state->frames[i];
+
+		if (!frame)
+			continue;
+
+		pthread_mutex_lock(&frame->mutex);
+		while (frame->render_status == 1) {
+			pthread_mutex_unlock(&frame->mutex);
+			sched_yield();
+			pthread_mutex_lock(&frame->mutex);
+		}
+		pthread_mutex_unlock(&frame->mutex);
+	}
+
+	limare_pp_job_stats(stats, reset);
+
+	return 0;
+}
+
 int
 limare_enable(struct limare_state *state, int parameter)
 {
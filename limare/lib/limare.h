@@ -33,6 +33,36 @@ struct lima_cmd {
 	unsigned int cmd;
 };
 
+/* PLBU state commands which get shadowed, see plbu_state_emit(). */
+enum limare_plbu_shadow {
+	LIMARE_PLBU_SHADOW_PRIMITIVE_SETUP = 0,
+	LIMARE_PLBU_SHADOW_VIEWPORT_X,
+	LIMARE_PLBU_SHADOW_VIEWPORT_W,
+	LIMARE_PLBU_SHADOW_VIEWPORT_Y,
+	LIMARE_PLBU_SHADOW_VIEWPORT_H,
+	LIMARE_PLBU_SHADOW_SCISSORS,
+	LIMARE_PLBU_SHADOW_DEPTH_RANGE_NEAR,
+	LIMARE_PLBU_SHADOW_DEPTH_RANGE_FAR,
+	LIMARE_PLBU_SHADOW_COUNT
+};
+
+struct limare_render_state_entry {
+	unsigned int hash;
+	int offset;
+	int size; /* 0 when unused */
+	/* cpu side copy of the struct render_state, frame memory is slow */
+	unsigned int render[0x40 / 4];
+};
+
+/* in tiles, x1 and y1 are exclusive */
+#define LIMARE_DAMAGE_MAX 16
+struct limare_damage_rect {
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+};
+
 struct limare_frame {
 	int id;
 	int index;
@@ -49,10 +79,36 @@ struct limare_frame {
 
 	unsigned int tile_heap_offset;
 	int tile_heap_size;
-
-#define LIMARE_DRAW_COUNT 512
-	struct draw_info *draws[LIMARE_DRAW_COUNT];
+	/* given to the gp when it stalled on a full tile heap */
+	int tile_heap_stalled;
+	int tile_heap_extra;
+	unsigned int tile_heap_extend_start;
+	unsigned int tile_heap_extend_end;
+
+	/* filled in when rendered: job times in usec, tile heap bytes */
+	long long gp_time;
+	long long pp_time;
+	int tile_heap_used;
+	unsigned int pp_perf_counter[2];
+
+	/* render states emitted so far, for sharing identical ones */
+#define LIMARE_RENDER_STATE_HASH_SIZE 256
+	struct limare_render_state_entry
+		render_states[LIMARE_RENDER_STATE_HASH_SIZE];
+
+	/* set for the per frame slot copies held by a command list */
+	struct limare_command_list *command_list;
+	int command_list_slot;
+
+	/* grows as needed, there is no hard limit on draws per frame */
+	struct draw_info **draws;
 	int draw_count;
+	int draw_size;
+
+	/* draw_info storage, kept for the next frame in this slot */
+	struct draw_info_block *draw_blocks;
+	struct draw_info_block *draw_block;
+	int draw_block_used;
 
 	/* locations of our plb buffers and pointers in our frame memory */
 	/* holds the actual polygons */
@@ -61,18 +117,57 @@ struct limare_frame {
 	int plb_plbu_offset;
 	/* holds the coordinates and addresses of the polygons for the PP */
 	int plb_pp_offset[LIMA_PP_CORE_MAX];
+	/* first tile, in pp tile order, of each pp core */
+	int pp_tile_start[LIMA_PP_CORE_MAX];
+	int pp_core_active;
+	int pp_stream_partial; /* streams only hold the damaged tiles */
+
+	/* only render the tiles touched by damage[], see limare_frame_damage */
+	int damage_set;
+	int damage_count;
+	struct limare_damage_rect damage[LIMARE_DAMAGE_MAX];
 
 	struct pp_info *pp;
 
+	/*
+	 * Command queues are chains of chunks. _start is the first chunk,
+	 * the other members describe the chunk currently being filled.
+	 */
+	int vs_commands_start;
+	int vs_commands_chunk_size;
 	struct lima_cmd *vs_commands;
 	int vs_commands_physical;
 	int vs_commands_count;
 	int vs_commands_size;
 
+	int plbu_commands_start;
+	int plbu_commands_chunk_size;
+	/* last emitted value of each shadowed PLBU state command */
+	struct lima_cmd plbu_shadow[LIMARE_PLBU_SHADOW_COUNT];
+	unsigned int plbu_shadow_valid;
 	struct lima_cmd *plbu_commands;
 	int plbu_commands_physical;
 	int plbu_commands_count;
 	int plbu_commands_size;
+
+	/*
+	 * What stays valid for the next frame in this slot: the plb areas
+	 * and streams, the pp clear shader and render state, and the plbu
+	 * preamble at the start of its first chunk.
+	 */
+	struct limare_frame_skeleton {
+		struct plb_info *plb; /* built for, NULL when not built */
+		int width;
+		int height;
+		int pp_core_count;
+
+		int mem_used; /* end of the static area */
+		int vs_commands_size;
+		int plbu_commands_size;
+		int plbu_commands_count;
+		struct lima_cmd plbu_shadow[LIMARE_PLBU_SHADOW_COUNT];
+		unsigned int plbu_shadow_valid;
+	} skeleton;
 };
 
 enum limare_attrib_type {
@@ -90,6 +185,50 @@ enum limare_attrib_type {
 	LIMARE_ATTRIB_FIXED = 0x101
 };
 
+/* the order in which the pp walks the tiles, see plb.c */
+enum limare_tile_order {
+	LIMARE_TILE_ORDER_HILBERT = 0,
+	LIMARE_TILE_ORDER_MORTON,
+	LIMARE_TILE_ORDER_SERPENTINE,
+	LIMARE_TILE_ORDER_BLOCKS, /* all tiles of a plb block in one go */
+	LIMARE_TILE_ORDER_COUNT,
+};
+
+/*
+ * Mali-400 pp performance counter sources.
+ */
+#define LIMARE_PP_COUNTER_ACTIVE_CYCLES 0
+#define LIMARE_PP_COUNTER_POLYGON_LIST_READS 13
+#define LIMARE_PP_COUNTER_TEXTURE_CACHE_HIT 52
+#define LIMARE_PP_COUNTER_TEXTURE_CACHE_MISS 53
+
+/* what has been rendered since the last reset. */
+struct limare_pp_stats {
+	int frames;
+	long long time; /* usec */
+	long long counter[2];
+};
+
+/* what float data holds, decides which formats it may be quantised to. */
+enum limare_attrib_usage {
+	LIMARE_ATTRIB_USAGE_POSITION = 0, /* I8 or I16, with scale and bias */
+	LIMARE_ATTRIB_USAGE_NORMAL, /* I8N or I16N */
+	LIMARE_ATTRIB_USAGE_TEXCOORD, /* U16N */
+	LIMARE_ATTRIB_USAGE_COLOUR, /* U8N or U16N */
+};
+
+/*
+ * Result of a quantised upload. The shader sees the stored value, the
+ * original is stored * scale + bias per component, which the caller has
+ * to fold into a uniform for the non normalised formats.
+ */
+struct limare_attribute_quantisation {
+	enum limare_attrib_type type;
+	float scale[4];
+	float bias[4];
+	float error; /* largest absolute error of any component */
+};
+
 struct limare_attribute_buffer {
 	int handle;
 
@@ -101,6 +240,9 @@ struct limare_attribute_buffer {
 	/* in AUX space */
 	int mem_offset;
 	unsigned int mem_physical;
+
+	/* dynamic buffers have a region of this size for each frame slot */
+	int region_size;
 };
 
 struct limare_indices_buffer {
@@ -109,13 +251,154 @@ struct limare_indices_buffer {
 	int drawing_mode;
 	int indices_type;
 	int count;
+	/* lowest and highest index, only this range gets transformed. */
 	int start;
+	int end;
+	/* added to each index, for rebased 32 bit indices. */
+	int base;
 
 	unsigned int mem_physical;
+
+	/* further 16 bit batches of a split 32 bit index list. */
+	struct limare_indices_buffer *next;
+};
+
+/* mmapped shader bundle, as produced by mali_compile -b */
+struct limare_bundle {
+	int handle;
+
+	void *address;
+	int size;
+
+	const struct lima_bundle_header *header;
+	const struct lima_bundle_entry *entries;
+};
+
+/*
+ * Static cost estimate of a linked program, see shader_stats.h for how the
+ * cycles are weighed. The attribute prefetch is the number of attribute
+ * registers the gp loads per vertex, temporary stores and writes are
+ * values that did not fit in registers.
+ */
+struct limare_program_stats {
+	int vertex_instructions;
+	int vertex_cycles;
+	int vertex_attribute_prefetch;
+	int vertex_varying_stores;
+	int vertex_temporary_stores;
+	int vertex_branches;
+	int vertex_uniform_size;
+	int vertex_attribute_count;
+
+	int fragment_instructions;
+	int fragment_cycles;
+	int fragment_varying_fetches;
+	int fragment_texture_fetches;
+	int fragment_uniform_fetches;
+	int fragment_temporary_writes;
+	int fragment_branches;
+	int fragment_uniform_size;
+	int fragment_varying_count;
+};
+
+/*
+ * Named uniforms shared between programs, so that scene wide constants are
+ * set (and converted to half floats) once instead of once per program.
+ */
+struct limare_uniform_block {
+	int handle;
+	int serial; /* bumped on every update */
+
+#define LIMARE_UNIFORM_BLOCK_ENTRY_COUNT 16
+	struct limare_uniform_block_entry {
+		char *name;
+		int count;
+		float *data;
+		unsigned short *data_half; /* for mediump symbols */
+	} entries[LIMARE_UNIFORM_BLOCK_ENTRY_COUNT];
+	int entry_count;
+};
+
+/*
+ * A program compiled from shared sources with a specific set of #defines,
+ * keyed on the sources and the define block. The hashes only speed up the
+ * lookup.
+ */
+struct limare_program_variant {
+	unsigned int vertex_hash;
+	unsigned int fragment_hash;
+	char *vertex_source;
+	char *fragment_source;
+	char *defines;
+
+	int program_handle;
 };
 
 #define FRAME_COUNT 3
 
+/*
+ * Client side attribute arrays, keyed on pointer and size. Arrays drawn
+ * with identical contents for LIMARE_ATTRIBUTE_CACHE_PROMOTE frames in a
+ * row get a persistent copy in aux memory, which is then used directly.
+ */
+#define LIMARE_ATTRIBUTE_CACHE_PROMOTE 3
+
+struct limare_attribute_cache {
+	const void *data;
+	int size;
+	unsigned int hash;
+	int frame_seen; /* id of the last frame drawing these contents */
+	int frames; /* consecutive frames with identical contents */
+
+	int promoted;
+	/* aux memory, never released, reused for later contents */
+	int mem_offset;
+	int mem_size;
+	unsigned int mem_physical;
+	int frame_used; /* id of the last frame reading the aux copy */
+};
+
+/*
+ * A recorded sequence of draws, kept in aux memory. Every frame slot gets
+ * its own copy, so frames in flight never share varyings or uniforms.
+ * The uniforms listed here get patched into the copy on each replay, so
+ * such a list can only be replayed once per frame. Deleting one of the
+ * programs it draws with makes the list unusable.
+ */
+struct limare_command_list_patch {
+	struct symbol *symbol;
+	int uniform;
+	int offset; /* in the memory of the list frame */
+};
+
+struct limare_command_list {
+	int handle;
+	int recorded;
+
+	struct limare_frame *frames[FRAME_COUNT];
+
+#define LIMARE_COMMAND_LIST_UNIFORM_COUNT 8
+	struct limare_command_list_uniform {
+		char *name;
+		int count;
+		float *data;
+		unsigned short *data_half; /* for mediump symbols */
+	} uniforms[LIMARE_COMMAND_LIST_UNIFORM_COUNT];
+	int uniform_count;
+
+	struct limare_command_list_patch *patches[FRAME_COUNT];
+	int patch_count[FRAME_COUNT];
+	int patch_size[FRAME_COUNT];
+
+	int replay_frame[FRAME_COUNT]; /* id of the last frame replayed in */
+
+	/* handles of the programs drawn with */
+	int *programs;
+	int program_count;
+	int program_size;
+	int program_deleted;
+};
+
 struct limare_state {
 	int fd;
 	int kernel_version;
@@ -133,6 +416,33 @@ struct limare_state {
 	struct plb_info *plb;
 	struct render_state *render_state_template;
 
+	/*
+	 * Adaptive plb block sizing, see plb_adapt(). The retired plb is
+	 * kept until no frame slot uses it anymore.
+	 */
+	int plb_adaptive;
+	int plb_block_limit;
+	struct plb_info *plb_retired;
+	int plb_frames;
+	long long plb_gp_time;
+	long long plb_pp_time;
+	int plb_heap_used;
+
+	/* follows the tile heap use of rendered frames */
+	int tile_heap_size;
+	int tile_heap_frames;
+	int tile_heap_peak;
+
+	enum limare_tile_order tile_order;
+
+	/* damage of the last flushed frame, for the buffer before it */
+	int damage_last_set;
+	int damage_last_count;
+	struct limare_damage_rect damage_last[LIMARE_DAMAGE_MAX];
+
+	/* -1 when disabled */
+	int pp_perf_counter_source[2];
+
 	float viewport_transform[8];
 
 	float viewport_x;
@@ -192,6 +502,10 @@ struct limare_state {
 
 	struct limare_program *depth_buffer_clear_program;
 
+#define LIMARE_VARIANT_COUNT LIMARE_PROGRAM_COUNT
+#define LIMARE_VARIANT_DEFINE_COUNT 16
+	struct limare_program_variant *variants[LIMARE_VARIANT_COUNT];
+
 	/* space used for vertex buffers and textures */
 	void *aux_mem_address;
 	unsigned int aux_mem_physical;
@@ -207,11 +521,30 @@ struct limare_state {
 		attribute_buffers[LIMARE_ATTRIBUTE_BUFFER_COUNT];
 	int attribute_buffer_handles;
 
+#define LIMARE_ATTRIBUTE_CACHE_COUNT 32
+#define LIMARE_ATTRIBUTE_CACHE_MEMORY 0x400000
+	struct limare_attribute_cache
+		attribute_cache[LIMARE_ATTRIBUTE_CACHE_COUNT];
+	int attribute_cache_mem_used;
+
 #define LIMARE_INDICES_BUFFER_COUNT 4
 	struct limare_indices_buffer *
 	indices_buffers[LIMARE_INDICES_BUFFER_COUNT];
 	int indices_buffer_handles;
 
+#define LIMARE_UNIFORM_BLOCK_COUNT 8
+	struct limare_uniform_block *uniform_blocks[LIMARE_UNIFORM_BLOCK_COUNT];
+	int uniform_block_handles;
+
+#define LIMARE_BUNDLE_COUNT 4
+	struct limare_bundle *bundles[LIMARE_BUNDLE_COUNT];
+	int bundle_handles;
+
+#define LIMARE_COMMAND_LIST_COUNT 8
+	struct limare_command_list *command_lists[LIMARE_COMMAND_LIST_COUNT];
+	int command_list_handles;
+	struct limare_command_list *command_list_recording;
+
 	struct limare_fb *fb;
 };
 
@@ -232,6 +565,7 @@ int limare_state_setup(struct limare_state *state, int width, int height,
 
 int limare_program_new(struct limare_state *state);
 int limare_program_current(struct limare_state *state, int handle);
+int limare_program_delete(struct limare_state *state, int handle);
 
 int vertex_shader_attach(struct limare_state *state, int program_handle,
 			 const char *source);
@@ -246,6 +580,17 @@ int fragment_shader_attach_mbs_file(struct limare_state *state, int handle,
 int fragment_shader_attach_mbs_stream(struct limare_state *state, int handle,
 				      const void *stream, int size);
 int limare_link(struct limare_state *state);
+int limare_program_variant(struct limare_state *state,
+			   const char *vertex_source,
+			   const char *fragment_source,
+			   const char **defines, int define_count);
+int limare_program_stats(struct limare_state *state, int handle,
+			 struct limare_program_stats *stats);
+
+int limare_bundle_open(struct limare_state *state, const char *filename);
+int limare_bundle_close(struct limare_state *state, int handle);
+int limare_program_new_bundle(struct limare_state *state, int bundle_handle,
+			      const char *name);
 
 int limare_texture_upload(struct limare_state *state, const void *pixels,
 			  int width, int height, int format, int mipmap);
@@ -259,6 +604,10 @@ int limare_texture_attach(struct limare_state *state, char *uniform_name,
 
 int limare_uniform_attach(struct limare_state *state, char *name,
 			  int count, float *data);
+int limare_uniform_block_new(struct limare_state *state);
+int limare_uniform_block_set(struct limare_state *state, int handle,
+			     const char *name, int count, const float *data);
+int limare_uniform_block_bind(struct limare_state *state, int handle);
 int limare_attribute_pointer(struct limare_state *state, char *name,
 			     enum limare_attrib_type type, int component_count,
 			     int entry_stride, int entry_count, void *data);
@@ -266,22 +615,119 @@ int limare_attribute_buffer_upload(struct limare_state *state,
 				   enum limare_attrib_type type,
 				   int component_count, int entry_stride,
 				   int entry_count, void *data);
+/*
+ * Uploads float data in the smallest format for usage that keeps every
+ * component within max_error, falling back to float.
+ */
+int limare_attribute_buffer_upload_quantised(struct limare_state *state,
+		enum limare_attrib_usage usage, int component_count,
+		int entry_count, const float *data, float max_error,
+		struct limare_attribute_quantisation *quantisation);
 int limare_attribute_buffer_attach(struct limare_state *state, char *name,
 				   int buffer_handle);
 
+/*
+ * Dynamic buffers hold a region per frame slot, which the application
+ * writes directly. Map after limare_frame_new(): the region returned is
+ * then no longer read by the GPU, and holds the data for all draws of
+ * this frame. Write sequentially, and never read back.
+ */
+int limare_attribute_buffer_dynamic_new(struct limare_state *state,
+					enum limare_attrib_type type,
+					int component_count, int entry_stride,
+					int entry_count);
+void *limare_attribute_buffer_map(struct limare_state *state,
+				  int buffer_handle);
+/*
+ * Binds an attribute to an interleaved buffer: component_count values of
+ * type at offset within every stride bytes. A stride of 0 means the
+ * entry_stride the buffer was uploaded with.
+ */
+int limare_attribute_buffer_bind(struct limare_state *state, char *name,
+				 int buffer_handle, int offset, int stride,
+				 enum limare_attrib_type type,
+				 int component_count);
+
 int limare_elements_buffer_upload(struct limare_state *state, int mode,
 				  int type, int count, void *data);
 
+/*
+ * Upload flags: reorder triangles for vertex locality, and renumber the
+ * vertices in first use order. The latter permutes the given attribute
+ * buffers in place, so those must not be shared with other indices.
+ */
+#define LIMARE_ELEMENTS_VCACHE 0x01
+#define LIMARE_ELEMENTS_VERTEX_ORDER 0x02
+
+int limare_elements_buffer_upload_flags(struct limare_state *state, int mode,
+					int type, int count, void *data,
+					int flags, int *attribute_handles,
+					int attribute_count);
+
 int limare_draw_arrays(struct limare_state *state, int mode,
 		       int vertex_start, int vertex_count);
 int limare_draw_elements(struct limare_state *state, int mode, int count,
 			 void *indices, int indices_type);
 int limare_draw_elements_buffer(struct limare_state *state, int buffer_handle);
 
+/*
+ * Per instance or per draw uniform data: data holds count floats for each
+ * instance, stride floats apart. A stride of 0 means tightly packed.
+ */
+#define LIMARE_INSTANCE_UNIFORM_COUNT 8
+struct limare_instance_uniform {
+	char *name;
+	int count;
+	int stride;
+	float *data;
+};
+
+/*
+ * A draw of limare_draw_multi(). With indices_handle set, mode, start and
+ * count are taken from that elements buffer.
+ */
+struct limare_draw_desc {
+	int mode;
+	int start;
+	int count;
+	int indices_handle;
+};
+
+int limare_draw_arrays_instanced(struct limare_state *state, int mode,
+				 int vertex_start, int vertex_count,
+				 int instance_count,
+				 struct limare_instance_uniform *uniforms,
+				 int uniform_count);
+int limare_draw_elements_instanced(struct limare_state *state, int mode,
+				   int count, void *indices, int indices_type,
+				   int instance_count,
+				   struct limare_instance_uniform *uniforms,
+				   int uniform_count);
+int limare_draw_multi(struct limare_state *state,
+		      struct limare_draw_desc *descs, int desc_count,
+		      struct limare_instance_uniform *uniforms,
+		      int uniform_count);
+
 int limare_depth_buffer_clear(struct limare_state *state);
 
+int limare_command_list_new(struct limare_state *state, int size);
+int limare_command_list_uniform_set(struct limare_state *state, int handle,
+				    const char *name, int count,
+				    const float *data);
+int limare_command_list_begin(struct limare_state *state, int handle);
+int limare_command_list_end(struct limare_state *state);
+int limare_command_list_replay(struct limare_state *state, int handle);
+
 int limare_frame_new(struct limare_state *state);
 int limare_frame_flush(struct limare_state *state);
+int limare_plb_adaptive_set(struct limare_state *state, int enable);
+int limare_tile_order_set(struct limare_state *state, int order);
+int limare_frame_damage(struct limare_state *state, int count,
+			const int *rects);
+int limare_pp_perf_counters_set(struct limare_state *state,
+				int source0, int source1);
+int limare_pp_stats_get(struct limare_state *state,
+			struct limare_pp_stats *stats, int reset);
 
 void limare_buffer_clear(struct limare_state *state);
 void limare_buffer_swap(struct limare_state *state);
@@ -27,66 +27,66 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "limare.h"
 #include "plb.h"
 
+struct plb_tile {
+	int x;
+	int y;
+};
+
+/*
+ * Hilbert curve, walked with the Lam and Shapiro state table, which is
+ * packed into the constants below: two bits of d per level, from the top.
+ */
 static void
-hilbert_rotate(int n, int *x, int *y, int rx, int ry)
+tile_order_hilbert(int dim, unsigned int d, int *x, int *y)
 {
-	if (ry == 0) {
-		if (rx == 1) {
-			*x = n-1 - *x;
-			*y = n-1 - *y;
-		}
+	unsigned int state = 0, row;
+	int i;
 
-		/* Swap x and y */
-		int t  = *x;
-		*x = *y;
-		*y = t;
+	*x = *y = 0;
+
+	for (i = 2 * dim - 2; i >= 0; i -= 2) {
+		row = (4 * state) | ((d >> i) & 3);
+
+		*x = (*x << 1) | ((0x936C >> row) & 1);
+		*y = (*y << 1) | ((0x39C6 >> row) & 1);
+
+		state = (0x3E6B94C1 >> (2 * row)) & 3;
 	}
 }
 
+/* de-interleaves 4 bits of d: x in the low, y in the high 2 bits. */
+static const unsigned char morton_table[16] = {
+	0x00, 0x01, 0x04, 0x05, 0x02, 0x03, 0x06, 0x07,
+	0x08, 0x09, 0x0C, 0x0D, 0x0A, 0x0B, 0x0E, 0x0F,
+};
+
 static void
-hilbert_coords(int n, int d, int *x, int *y)
+tile_order_morton(int dim, unsigned int d, int *x, int *y)
 {
-	int rx, ry, i, t=d;
+	int i;
 
 	*x = *y = 0;
 
-	for (i = 0; (1 << i) < n; i++) {
-
-		rx = 1 & (t / 2);
-		ry = 1 & (t ^ rx);
-
-		hilbert_rotate(1 << i, x, y, rx, ry);
-
-		*x += rx << i;
-		*y += ry << i;
-
-		t /= 4;
+	for (i = 0; d; i += 2, d >>= 4) {
+		*x |= (morton_table[d & 0x0F] & 0x03) << i;
+		*y |= (morton_table[d & 0x0F] >> 2) << i;
 	}
 }
 
 /*
- * Pre-generate the PLB desciptors for the PP.
+ * Walk a space filling curve over the power of two square covering our
+ * tiles, and only keep the tiles that exist.
  */
-
-
-static void
-plb_pp_template_create(struct limare_state *state, struct plb_info *plb)
+static int
+tile_order_curve(struct plb_info *plb, struct plb_tile *tiles,
+		 void (*coords)(int dim, unsigned int d, int *x, int *y))
 {
-	struct pp_pattern {
-		int x;
-		int y;
-		unsigned int offset;
-	};
-	struct pp_pattern *pattern;
-	unsigned int *stream;
-	int size = plb->tiled_w * plb->tiled_h;
-	int max, dim, count, i, index, core;
-
-	pattern = calloc(size, sizeof(struct pp_pattern));
+	int max, dim, count, i, index;
 
 	if (plb->tiled_w < plb->tiled_h)
 		max = plb->tiled_h;
@@ -100,43 +100,173 @@ plb_pp_template_create(struct limare_state *state, struct plb_info *plb)
 	for (i = 0, index = 0; i < count; i++) {
 		int x, y;
 
-		hilbert_coords(max, i, &x, &y);
+		coords(dim, i, &x, &y);
 
 		if ((x < plb->tiled_w) && (y < plb->tiled_h)) {
-			pattern[index].x = x;
-			pattern[index].y = y;
-			pattern[index].offset =
-				((y >> plb->shift_h) * plb->block_w +
-				 (x >> plb->shift_w)) * plb->block_size;
-
+			tiles[index].x = x;
+			tiles[index].y = y;
 			index++;
 		}
 	}
 
-	plb->pp_size = size / state->pp_core_count;
-	for (core = 0; core < state->pp_core_count; core++) {
-		stream = calloc(plb->pp_size, 4 * sizeof(unsigned int));
+	return index;
+}
 
-		for (i = core, index = 0; i < size; i += state->pp_core_count) {
-			stream[index + 0] = 0;
-			stream[index + 1] = 0xB8000000 |
-				pattern[i].x | (pattern[i].y << 8);
-			stream[index + 2] = 0xE0000002 |
-				((pattern[i].offset >> 3) & ~0xE0000003);
-			stream[index + 3] = 0xB0000000;
+/* row by row, every other row backwards. */
+static int
+tile_order_serpentine(struct plb_info *plb, struct plb_tile *tiles)
+{
+	int x, y, index = 0;
+
+	for (y = 0; y < plb->tiled_h; y++) {
+		for (x = 0; x < plb->tiled_w; x++) {
+			if (y & 1)
+				tiles[index].x = plb->tiled_w - 1 - x;
+			else
+				tiles[index].x = x;
+			tiles[index].y = y;
+			index++;
+		}
+	}
 
-			index += 4;
+	return index;
+}
+
+/*
+ * Serpentine over the plb blocks, and finish all tiles of a block before
+ * moving on, so that a block its polygon list is only walked in one go.
+ */
+static int
+tile_order_blocks(struct plb_info *plb, struct plb_tile *tiles)
+{
+	int block_tiles_w = 1 << plb->shift_w;
+	int block_tiles_h = 1 << plb->shift_h;
+	int i, j, x, y, index = 0;
+
+	for (i = 0; i < plb->block_h; i++) {
+		for (j = 0; j < plb->block_w; j++) {
+			int block_x, block_y = i * block_tiles_h;
+
+			if (i & 1)
+				block_x = (plb->block_w - 1 - j) * block_tiles_w;
+			else
+				block_x = j * block_tiles_w;
+
+			for (y = block_y; y < (block_y + block_tiles_h); y++) {
+				if (y >= plb->tiled_h)
+					break;
+
+				for (x = block_x; x < (block_x + block_tiles_w);
+				     x++) {
+					if (x >= plb->tiled_w)
+						break;
+
+					tiles[index].x = x;
+					tiles[index].y = y;
+					index++;
+				}
+			}
 		}
+	}
+
+	return index;
+}
+
+/*
+ * Pre-generate the PLB desciptors for the PP, for all tiles, in the
+ * requested order. Each core then gets handed a contiguous range of these.
+ */
+static int
+plb_pp_template_create(struct plb_info *plb)
+{
+	struct plb_tile *tiles;
+	unsigned int *stream, offset;
+	int size = plb->tiled_w * plb->tiled_h;
+	int i, count;
+
+	tiles = calloc(size, sizeof(struct plb_tile));
+	if (!tiles)
+		return -1;
+
+	switch (plb->tile_order) {
+	case LIMARE_TILE_ORDER_MORTON:
+		count = tile_order_curve(plb, tiles, tile_order_morton);
+		break;
+	case LIMARE_TILE_ORDER_SERPENTINE:
+		count = tile_order_serpentine(plb, tiles);
+		break;
+	case LIMARE_TILE_ORDER_BLOCKS:
+		count = tile_order_blocks(plb, tiles);
+		break;
+	case LIMARE_TILE_ORDER_HILBERT:
+	default:
+		count = tile_order_curve(plb, tiles, tile_order_hilbert);
+		break;
+	}
+
+	if (count != size) {
+		printf("%s: Error: tile order %d produced %d/%d tiles\n",
+		       __func__, plb->tile_order, count, size);
+		free(tiles);
+		return -1;
+	}
 
-		plb->pp_template[core] = stream;
+	stream = calloc(size, 4 * sizeof(unsigned int));
+	if (!stream) {
+		free(tiles);
+		return -1;
 	}
+
+	for (i = 0; i < size; i++) {
+		offset = ((tiles[i].y >> plb->shift_h) * plb->block_w +
+			  (tiles[i].x >> plb->shift_w)) * plb->block_size;
+
+		stream[4 * i + 0] = 0;
+		stream[4 * i + 1] = 0xB8000000 |
+			tiles[i].x | (tiles[i].y << 8);
+		stream[4 * i + 2] = 0xE0000002 |
+			((offset >> 3) & ~0xE0000003);
+		stream[4 * i + 3] = 0xB0000000;
+	}
+
+	plb->pp_size = size;
+	plb->pp_template = stream;
+
+	free(tiles);
+	return 0;
 }
 
+/*
+ * For performance, 250 seems preferred on mali200.
+ * 300 is the hard limit for mali200.
+ * 512 is the hard limit for mali400.
+ */
+int
+plb_block_limit_default(struct limare_state *state)
+{
+	if (state->type == LIMARE_TYPE_M400)
+		return 500;
+	else
+		return 250;
+}
+
+static int
+plb_block_limit_max(struct limare_state *state)
+{
+	if (state->type == LIMARE_TYPE_M400)
+		return 512;
+	else
+		return 300;
+}
+
+/*
+ * block_limit limits the amount of plb's the gp has to generate.
+ */
 struct plb_info *
-plb_info_create(struct limare_state *state)
+plb_info_create(struct limare_state *state, int block_limit)
 {
 	struct plb_info *plb = calloc(1, sizeof(struct plb_info));
-	int width, height, limit;
+	int width, height;
 	int max;
 
 	width = ALIGN(state->width, 16) >> 4;
@@ -145,17 +275,11 @@ plb_info_create(struct limare_state *state)
 	plb->tiled_w = width;
 	plb->tiled_h = height;
 
-	/* limit the amount of plb's the gp has to generate */
-	/* For performance, 250 seems preferred on mali200.
-	 * 300 is the hard limit for mali200.
-	 * 512 is the hard limit for mali400.
-	 */
-	if (state->type == LIMARE_TYPE_M400)
-		limit = 500;
-	else
-		limit = 250;
+	if (block_limit > plb_block_limit_max(state))
+		block_limit = plb_block_limit_max(state);
+	plb->block_limit = block_limit;
 
-	while ((width * height) > limit) {
+	while ((width * height) > block_limit) {
 		if (width >= height) {
 			width = (width + 1) >> 1;
 			plb->shift_w++;
@@ -194,7 +318,13 @@ plb_info_create(struct limare_state *state)
 		/* fixed size on mali200 */
 		plb->plbu_size = 4 * 300;
 
-	plb_pp_template_create(state, plb);
+	plb->tile_order = state->tile_order;
+
+	plb->block_fill = calloc(plb->block_w * plb->block_h, 1);
+	if (!plb->block_fill || plb_pp_template_create(plb)) {
+		plb_info_destroy(plb);
+		return NULL;
+	}
 
 	return plb;
 }
@@ -202,9 +332,106 @@ plb_info_create(struct limare_state *state)
 void
 plb_info_destroy(struct plb_info *plb)
 {
+	free(plb->pp_template);
+	free(plb->block_fill);
 	free(plb);
 }
 
+/*
+ * Fewer, larger blocks mean less plbu work and tile heap, but each pp tile
+ * then has to wade through more primitives. So every PLB_ADAPT_FRAMES, we
+ * look at which of the gp or pp is the bottleneck, and how full the tile
+ * heap got, and halve or double the block count accordingly.
+ *
+ * The new plb is only created here, the frames pick it up when they get
+ * rebuilt, as their skeleton no longer matches.
+ */
+#define PLB_ADAPT_FRAMES 32
+
+void
+plb_adapt(struct limare_state *state, struct limare_frame *frame)
+{
+	struct plb_info *plb = state->plb;
+	int limit = state->plb_block_limit;
+	long long gp_time, pp_time;
+	int heap_used;
+
+	/* only count frames rendered with the current plb */
+	if (frame->skeleton.plb != plb)
+		return;
+
+	state->plb_gp_time += frame->gp_time;
+	state->plb_pp_time += frame->pp_time;
+	if (state->plb_heap_used < frame->tile_heap_used)
+		state->plb_heap_used = frame->tile_heap_used;
+
+	state->plb_frames++;
+	if (state->plb_frames < PLB_ADAPT_FRAMES)
+		return;
+
+	gp_time = state->plb_gp_time;
+	pp_time = state->plb_pp_time;
+	heap_used = state->plb_heap_used;
+
+	state->plb_frames = 0;
+	state->plb_gp_time = 0;
+	state->plb_pp_time = 0;
+	state->plb_heap_used = 0;
+
+	/* wait until all frames have let go of the previous plb */
+	if (state->plb_retired)
+		return;
+
+	if ((4 * gp_time > 5 * pp_time) ||
+	    (4 * heap_used > 3 * frame->tile_heap_size)) {
+		if (limit <= (plb_block_limit_max(state) / 16))
+			return;
+		limit /= 2;
+	} else if ((4 * pp_time > 5 * gp_time) &&
+		   (2 * heap_used < frame->tile_heap_size)) {
+		if (limit >= plb_block_limit_max(state))
+			return;
+		limit *= 2;
+	} else
+		return;
+
+	plb = plb_info_create(state, limit);
+	if (!plb)
+		return;
+
+	state->plb_block_limit = plb->block_limit;
+
+	/* the tiled dimensions are tiny, we might not have changed at all */
+	if ((plb->block_w == state->plb->block_w) &&
+	    (plb->block_h == state->plb->block_h)) {
+		plb_info_destroy(plb);
+		return;
+	}
+
+	state->plb_retired = state->plb;
+	state->plb = plb;
+}
+
+/*
+ * Free the previous plb, once no frame is using it anymore.
+ */
+void
+plb_retired_release(struct limare_state *state)
+{
+	int i;
+
+	if (!state->plb_retired)
+		return;
+
+	for (i = 0; i < FRAME_COUNT; i++)
+		if (state->frames[i] &&
+		    (state->frames[i]->skeleton.plb == state->plb_retired))
+			return;
+
+	plb_info_destroy(state->plb_retired);
+	state->plb_retired = NULL;
+}
+
 /*
  * Generate the plb address stream for the plbu.
  */
@@ -220,31 +447,70 @@ plb_plbu_stream_create(struct limare_frame *frame, struct plb_info *plb)
 }
 
 /*
- * Generate the PLB desciptors for the PP.
+ * Whether the pp has to render this tile, going by the damage of the frame.
+ * tile is the second word of its pp template entry.
+ */
+static int
+frame_tile_damaged(struct limare_frame *frame, unsigned int tile)
+{
+	int x = tile & 0xFF;
+	int y = (tile >> 8) & 0xFF;
+	int i;
+
+	if (!frame->damage_set)
+		return 1;
+
+	for (i = 0; i < frame->damage_count; i++) {
+		struct limare_damage_rect *rect = &frame->damage[i];
+
+		if ((x >= rect->x0) && (x < rect->x1) &&
+		    (y >= rect->y0) && (y < rect->y1))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Generate the PLB desciptors for the PP. The per core streams follow
+ * each other, each holding its range of damaged tiles and an end marker.
  */
 static void
-plb_pp_stream_create(struct limare_frame *frame, struct plb_info *plb, int core)
+plb_pp_stream_create(struct limare_frame *frame, struct plb_info *plb)
 {
 	unsigned int address = frame->mem_physical + frame->plb_offset;
-	unsigned int *stream = frame->mem_address + frame->plb_pp_offset[core];
-	int i;
-	unsigned int *p, *q;
+	unsigned int *stream = frame->mem_address + frame->plb_pp_offset[0];
+	unsigned int *p = stream;
+	unsigned int *q;
+	int i, end, core;
 
 	address >>= 3;
-	p = stream;
-	q = plb->pp_template[core];
 
-	for (i = 0; i < plb->pp_size; i++) {
+	for (core = 0; core < frame->pp_core_active; core++) {
+		frame->plb_pp_offset[core] = frame->plb_pp_offset[0] +
+			4 * (p - stream);
+
+		if (core == (frame->pp_core_active - 1))
+			end = plb->pp_size;
+		else
+			end = frame->pp_tile_start[core + 1];
+
+		q = plb->pp_template + 4 * frame->pp_tile_start[core];
+		for (i = frame->pp_tile_start[core]; i < end; i++, q += 4) {
+			if (!frame_tile_damaged(frame, q[1]))
+				continue;
+
+			p[0] = 0;
+			p[1] = q[1];
+			p[2] = q[2] + address;
+			p[3] = 0xB0000000;
+			p += 4;
+		}
+
 		p[0] = 0;
-		p[1] = q[1];
-		p[2] = q[2] + address;
-		p[3] = 0xB0000000;
+		p[1] = 0xBC000000;
 		p += 4;
-		q += 4;
 	}
-
-	p[0] = 0;
-	p[1] = 0xBC000000;
 }
 
 int
@@ -260,22 +526,180 @@ frame_plb_create(struct limare_state *state, struct limare_frame *frame)
 	frame->plb_plbu_offset = frame->mem_used + mem_used;
 	mem_used += ALIGN(plb->plbu_size, 0x40);
 
-	for (i = 0; i < state->pp_core_count; i++) {
-		frame->plb_pp_offset[i] = frame->mem_used + mem_used;
-		mem_used += ALIGN(0x10 * (plb->pp_size + 1), 0x40);
+	frame->plb_pp_offset[0] = frame->mem_used + mem_used;
+	mem_used += ALIGN(0x10 * (plb->pp_size + state->pp_core_count), 0x40);
 
-		if ((frame->mem_used + mem_used) > frame->mem_size) {
-			printf("%s: no space for the plb areas\n", __func__);
-			return -1;
-		}
-
-		frame->mem_used += mem_used;
+	if ((frame->mem_used + mem_used) > frame->mem_size) {
+		printf("%s: no space for the plb areas\n", __func__);
+		return -1;
 	}
 
+	frame->mem_used += mem_used;
+
+	/* the block fill levels are counted from a clean plb */
+	memset(frame->mem_address + frame->plb_offset, 0, plb->plb_size);
+
 	plb_plbu_stream_create(frame, plb);
 
+	/* start out evenly, plb_pp_balance() takes it from there */
 	for (i = 0; i < state->pp_core_count; i++)
-		plb_pp_stream_create(frame, plb, i);
+		frame->pp_tile_start[i] =
+			(plb->pp_size * i) / state->pp_core_count;
+	frame->pp_core_active = state->pp_core_count;
+	frame->pp_stream_partial = 0;
+
+	plb_pp_stream_create(frame, plb);
 
 	return 0;
 }
+
+/*
+ * The plb lives in uncached memory, so it only gets read back on every
+ * PLB_BALANCE_FRAMES-th frame of a slot. The frame before it in the same
+ * slot wipes the plb, so that the count only sees that frame's lists.
+ * Other frames balance with the last counts.
+ */
+#define PLB_BALANCE_FRAMES 8
+
+static int
+plb_balance_frame(int id)
+{
+	return !((id / FRAME_COUNT) % PLB_BALANCE_FRAMES);
+}
+
+/*
+ * Count the polygon list entries that the plbu wrote into each plb block.
+ * A full block has overflowed into the tile heap.
+ */
+static void
+plb_fill_count(struct limare_frame *frame, struct plb_info *plb)
+{
+	unsigned long long *block = frame->mem_address + frame->plb_offset;
+	int slots = plb->block_size / 8;
+	int i, j;
+
+	for (i = 0; i < (plb->block_w * plb->block_h); i++) {
+		for (j = 0; j < slots; j++)
+			if (!block[j])
+				break;
+
+		plb->block_fill[i] = j;
+		block += slots;
+	}
+}
+
+/*
+ * Every tile in a block walks the whole list of that block.
+ */
+#define PLB_PP_TILE_COST 4 /* clear and write back of an empty tile */
+
+static inline int
+plb_pp_tile_cost(struct plb_info *plb, int tile)
+{
+	unsigned int offset = (plb->pp_template[4 * tile + 2] & 0x1FFFFFFC) << 3;
+
+	return PLB_PP_TILE_COST + plb->block_fill[offset / plb->block_size];
+}
+
+/*
+ * Once the gp is done, split the ordered tiles that need rendering into
+ * contiguous ranges of about equal cost, so that all pp cores finish
+ * together. Run from the render thread.
+ *
+ * The kernel only reports a single render_time for a multi-core pp job,
+ * so the cost is estimated from the plb block fill levels instead.
+ *
+ * Returns the number of pp cores to run, 0 when nothing was damaged.
+ */
+int
+frame_plb_pp_balance(struct limare_state *state, struct limare_frame *frame)
+{
+	struct plb_info *plb = frame->skeleton.plb;
+	int core_count = frame->skeleton.pp_core_count;
+	int start[LIMA_PP_CORE_MAX];
+	long long total = 0, sum = 0;
+	int i, k, core, count = 0, active, moved = 0;
+
+	if ((core_count > 1) && plb_balance_frame(frame->id))
+		plb_fill_count(frame, plb);
+
+	for (i = 0; i < plb->pp_size; i++) {
+		if (!frame_tile_damaged(frame, plb->pp_template[4 * i + 1]))
+			continue;
+
+		total += plb_pp_tile_cost(plb, i);
+		count++;
+	}
+
+	active = core_count;
+	if (active > count)
+		active = count;
+
+	start[0] = 0;
+	for (i = 0, k = 0, core = 1; (i < plb->pp_size) && (core < active);
+	     i++) {
+		if (!frame_tile_damaged(frame, plb->pp_template[4 * i + 1]))
+			continue;
+
+		/* every active core gets at least one tile */
+		if ((k >= core) &&
+		    (((sum * active) >= (total * core)) ||
+		     ((count - k) <= (active - core))))
+			start[core++] = i;
+
+		sum += plb_pp_tile_cost(plb, i);
+		k++;
+	}
+
+	for (core = active; core < core_count; core++)
+		start[core] = plb->pp_size;
+
+	/* rewriting the streams is not free, ignore small shifts */
+	if ((active != frame->pp_core_active) || frame->damage_set ||
+	    frame->pp_stream_partial)
+		moved = 1;
+
+	for (core = 1; core < active; core++)
+		if (abs(start[core] - frame->pp_tile_start[core]) >
+		    (plb->pp_size / 64))
+			moved = 1;
+
+	if (!moved)
+		return active;
+
+	for (core = 0; core < core_count; core++)
+		frame->pp_tile_start[core] = start[core];
+	frame->pp_core_active = active;
+	frame->pp_stream_partial = frame->damage_set;
+
+	plb_pp_stream_create(frame, plb);
+
+	return active;
+}
+
+/*
+ * Once the pp is done, wipe what the plbu wrote when the next frame in
+ * this slot gets counted. Lists of the frames in between are left, they
+ * only ever extend from the start of a block, so we stop at the first
+ * empty entry.
+ */
+void
+frame_plb_fill_clear(struct limare_state *state, struct limare_frame *frame)
+{
+	struct plb_info *plb = frame->skeleton.plb;
+	unsigned long long *block = frame->mem_address + frame->plb_offset;
+	int slots = plb->block_size / 8;
+	int i, j;
+
+	if (frame->skeleton.pp_core_count < 2)
+		return;
+
+	if (!plb_balance_frame(frame->id + FRAME_COUNT))
+		return;
+
+	for (i = 0; i < (plb->block_w * plb->block_h); i++) {
+		for (j = 0; (j < slots) && block[j]; j++)
+			block[j] = 0;
+		block += slots;
+	}
+}
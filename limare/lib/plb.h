@@ -34,6 +34,8 @@
  */
 struct plb_info {
 	int block_size; /* 0x200 */
+	int block_limit; /* max block_w * block_h */
+	enum limare_tile_order tile_order;
 
 	int tiled_w;
 	int tiled_h;
@@ -52,12 +54,24 @@ struct plb_info {
 	int plbu_size; /* 4 * width * height */
 
 	/* holds the coordinates and addresses of the primitives for the PP */
-	int pp_size;
-	unsigned int *pp_template[LIMA_PP_CORE_MAX];
+	int pp_size; /* tile count */
+	unsigned int *pp_template; /* hilbert order */
+
+	/* polygon list entries per block, as counted in the render thread */
+	unsigned char *block_fill;
 };
 
-struct plb_info *plb_info_create(struct limare_state *state);
+int plb_block_limit_default(struct limare_state *state);
+struct plb_info *plb_info_create(struct limare_state *state, int block_limit);
 int frame_plb_create(struct limare_state *state, struct limare_frame *frame);
-void plb_destroy(struct plb_info *plb);
+void plb_info_destroy(struct plb_info *plb);
+
+void plb_adapt(struct limare_state *state, struct limare_frame *frame);
+void plb_retired_release(struct limare_state *state);
+
+int frame_plb_pp_balance(struct limare_state *state,
+			 struct limare_frame *frame);
+void frame_plb_fill_clear(struct limare_state *state,
+			  struct limare_frame *frame);
 
 #endif /* LIMARE_PLB_H */
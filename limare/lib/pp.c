@@ -47,9 +47,11 @@
  * This actually creates a separate render_state and fragment shader
  * which are responsible for clearing the FB. It is ran on empty pixels
  * by the pp.
+ *
+ * The pp_info itself is kept by the frame slot, and only gets cleared.
  */
-struct pp_info *
-pp_info_create(struct limare_state *state, struct limare_frame *frame)
+int
+pp_info_setup(struct limare_state *state, struct limare_frame *frame)
 {
 	struct plb_info *plb;
 	struct pp_info *info;
@@ -60,18 +62,22 @@ pp_info_create(struct limare_state *state, struct limare_frame *frame)
 
 	if (!state->plb) {
 		printf("%s: Error: member plb not assigned yet!\n", __func__);
-		return NULL;
+		return -1;
 	}
 	plb = state->plb;
 
 	if ((frame->mem_size - frame->mem_used) < 0x80) {
 		printf("%s: no space for the pp\n", __func__);
-		return NULL;
+		return -1;
 	}
 
-	info = calloc(1, sizeof(struct pp_info));
-	if (!info)
-		return NULL;
+	if (!frame->pp) {
+		frame->pp = calloc(1, sizeof(struct pp_info));
+		if (!frame->pp)
+			return -1;
+	} else
+		memset(frame->pp, 0, sizeof(struct pp_info));
+	info = frame->pp;
 
 	info->width = state->width;
 	info->height = state->height;
@@ -102,7 +108,7 @@ pp_info_create(struct limare_state *state, struct limare_frame *frame)
 	render->shader_address = info->shader_physical | (shader[0] & 0x1F);
 	render->unknown34 = 0x100;
 
-	return info;
+	return 0;
 }
 
 void
@@ -186,7 +192,8 @@ limare_m400_pp_job_start(struct limare_state *state, struct limare_frame *frame)
 	struct lima_m400_pp_frame_registers frame_regs = { 0 };
 	struct lima_pp_wb_registers wb_regs = { 0 };
 	struct pp_info *info = frame->pp;
-	struct plb_info *plb = state->plb;
+	/* the plb this frame was built with, state->plb may have moved on */
+	struct plb_info *plb = frame->skeleton.plb;
 	struct limare_fb *fb = state->fb;
 	int supersampling = 1;
 
@@ -273,11 +280,11 @@ limare_m400_pp_job_start(struct limare_state *state, struct limare_frame *frame)
 		int i;
 
 		if (frame) {
-			for (i = 1; i < state->pp_core_count; i++)
+			for (i = 1; i < frame->pp_core_active; i++)
 				frame_addr[i - 1] = frame->mem_physical +
 					frame->plb_pp_offset[i];
 
-			for (i = 1; i < state->pp_core_count; i++) {
+			for (i = 1; i < frame->pp_core_active; i++) {
 				if ((frame->mem_size - frame->mem_used) >
 				    0x400) {
 					stack_addr[i - 1] =
@@ -48,8 +48,7 @@ struct pp_info
 	int render_size;
 };
 
-struct pp_info *pp_info_create(struct limare_state *state,
-			       struct limare_frame *frame);
+int pp_info_setup(struct limare_state *state, struct limare_frame *frame);
 void pp_info_destroy(struct pp_info *pp);
 
 int limare_pp_job_start(struct limare_state *state, struct limare_frame *frame);
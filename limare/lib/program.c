@@ -147,33 +147,12 @@ struct stream_uniform_init {
 };
 
 struct stream_uniform {
-	struct stream_uniform *next;
-
 	const struct stream_uniform_start *start;
 	const struct stream_string *string;
 	const struct stream_uniform_data *data;
 	const struct stream_uniform_init *init;
 };
 
-struct stream_uniform_table {
-	const struct stream_uniform_table_start *start;
-
-	struct stream_uniform *uniforms;
-};
-
-static int
-stream_uniform_table_start_read(const void *stream,
-				struct stream_uniform_table *table)
-{
-	const struct stream_uniform_table_start *start = stream;
-
-	if (start->tag != STREAM_TAG_SUNI)
-		return 0;
-
-	table->start = start;
-	return sizeof(struct stream_uniform_table_start);
-}
-
 static int
 stream_uniform_table_size_read(const void *stream, int *size)
 {
@@ -253,72 +232,96 @@ stream_uniform_skip(const void *stream)
 	}
 }
 
+/*
+ * All symbols of a shader, their pointer tables, names and initial uniform
+ * values live in a single allocation. The stream tables are walked twice:
+ * first without an address to size the arena, then to fill it in.
+ */
+struct symbol_arena {
+	void *address;
+	int used;
+};
+
+static void *
+symbol_arena_get(struct symbol_arena *arena, int size)
+{
+	void *address = arena->address + arena->used;
+
+	arena->used += ALIGN(size, 8);
+
+	return address;
+}
+
+static const char *
+symbol_arena_string(struct symbol_arena *arena, const char *string)
+{
+	int size = strlen(string) + 1;
+	char *copy = symbol_arena_get(arena, size);
+
+	if (arena->address)
+		memcpy(copy, string, size);
+
+	return copy;
+}
+
+/* symbols are expected in the reverse order of the stream tables. */
 static void
-stream_uniform_table_destroy(struct stream_uniform_table *table)
+symbols_reverse(struct symbol **symbols, int count)
 {
-	if (table) {
-		while (table->uniforms) {
-			struct stream_uniform *uniform = table->uniforms;
+	int i;
 
-			table->uniforms = uniform->next;
-			free(uniform);
-		}
+	for (i = 0; i < (count / 2); i++) {
+		struct symbol *tmp = symbols[i];
 
-		free(table);
+		symbols[i] = symbols[count - 1 - i];
+		symbols[count - 1 - i] = tmp;
 	}
 }
 
-static struct stream_uniform_table *
-stream_uniform_table_create(const void *stream, int size)
+static int
+stream_uniform_table_symbols_read(const void *stream, int size,
+				  struct symbol_arena *arena,
+				  struct symbol ***symbols_ret,
+				  int *count_ret, int *size_ret)
 {
-	struct stream_uniform_table *table;
-	struct stream_uniform *uniform;
+	const struct stream_uniform_table_start *start = stream;
+	struct symbol **symbols;
 	int offset = 0;
 	int i;
 
 	if (!stream || !size)
-		return NULL;
-
-	table = calloc(1, sizeof(struct stream_uniform_table));
-	if (!table) {
-		printf("%s: failed to allocate table\n", __func__);
-		return NULL;
-	}
+		return 0;
 
-	offset += stream_uniform_table_start_read(stream + offset, table);
-	if (!table->start) {
+	if (start->tag != STREAM_TAG_SUNI) {
 		printf("%s: Error: missing table start at 0x%x\n",
 		       __func__, offset);
-		goto corrupt;
+		return -1;
 	}
+	offset += sizeof(struct stream_uniform_table_start);
 
-	for (i = 0; i < table->start->count; i++) {
-		uniform = calloc(1, sizeof(struct stream_uniform));
-		if (!table) {
-			printf("%s: failed to allocate uniform\n", __func__);
-			goto oom;
-		}
+	symbols = symbol_arena_get(arena,
+				   start->count * sizeof(struct symbol *));
 
-		offset += stream_uniform_start_read(stream + offset, uniform);
-		if (!uniform->start) {
+	for (i = 0; i < start->count; i++) {
+		struct stream_uniform uniform = { 0 };
+		struct symbol symbol, *new;
+		const char *name;
+
+		offset += stream_uniform_start_read(stream + offset, &uniform);
+		if (!uniform.start) {
 			printf("%s: Error: missing uniform start at 0x%x\n",
 			       __func__, offset);
-			goto corrupt;
+			return -1;
 		}
 
-		offset += stream_string_read(stream + offset, &uniform->string);
-		if (!uniform->string) {
+		offset += stream_string_read(stream + offset, &uniform.string);
+		if (!uniform.string) {
 			printf("%s: Error: missing string at 0x%x\n",
 			       __func__, offset);
-			goto corrupt;
+			return -1;
 		}
 
-		offset += stream_uniform_data_read(stream + offset, uniform);
-		if (!uniform->data) {
-			printf("%s: Error: missing uniform data at 0x%x\n",
-			       __func__, offset);
-			goto corrupt;
-		}
+		offset += stream_uniform_data_read(stream + offset, &uniform);
 
 		/* skip some tags that might be there */
 		if (offset < size)
@@ -332,120 +335,42 @@ stream_uniform_table_create(const void *stream, int size)
 
 		if (offset < size)
 			offset += stream_uniform_init_read(stream + offset,
-							   uniform);
+							   &uniform);
 		/* it is legal to not have an init block */
 
-		uniform->next = table->uniforms;
-		table->uniforms = uniform;
-	}
-
-	return table;
- oom:
-	stream_uniform_table_destroy(table);
-	return NULL;
- corrupt:
-	stream_uniform_table_destroy(table);
-	return NULL;
-}
-
-#if 0
-void
-stream_uniform_table_print(struct stream_uniform_table *table)
-{
-	struct stream_uniform *uniform;
-
-	printf("%s: Uniform space needed: 0x%x\n",
-	       __func__, table->start->space_needed);
-	uniform = table->uniforms;
-	while (uniform) {
-		printf("uniform \"%s\" = {\n", uniform->string->string);
-		printf("\t type 0x%04x, component_count 0x%04x\n",
-		       uniform->data->type, uniform->data->component_count);
-		printf("\t component_size 0x%04x, entry_count 0x%04x\n",
-		       uniform->data->component_size, uniform->data->entry_count);
-		printf("\t src_stride 0x%04x, dst_stride 0x%02x, precision 0x%02x\n",
-		       uniform->data->src_stride, uniform->data->dst_stride,
-		       uniform->data->precision);
-		printf("\t unknown0C 0x%04x, unknown0E 0x%04x\n",
-		       uniform->data->unknown0C, uniform->data->unknown0E);
-		printf("\t offset 0x%04x, index 0x%04x\n",
-		       uniform->data->offset, uniform->data->index);
-		printf("}\n");
-		uniform = uniform->next;
-	}
-}
-#endif
-
-static struct symbol **
-stream_uniform_table_to_symbols(struct stream_uniform_table *table,
-				int *count, int *size)
-{
-	struct stream_uniform *uniform;
-	struct symbol **symbols;
-	int i;
-
-	if (!table || !count || !size)
-		return NULL;
-
-	*count = table->start->count;
-	*size = table->start->space_needed;
-
-	if (!table->start->count)
-		return NULL;
-
-	symbols = calloc(*count, sizeof(struct symbol *));
-	if (!symbols) {
-		printf("%s: Error: failed to allocate symbols: %s\n",
-		       __func__, strerror(errno));
-		goto error;
-	}
-
-	for (i = 0, uniform = table->uniforms;
-	     (i < table->start->count) && uniform;
-	     i++, uniform = uniform->next) {
-		if (uniform->init)
-			symbols[i] =
-				symbol_create(uniform->string->string, SYMBOL_UNIFORM,
-					      uniform->data->type,
-					      uniform->data->precision,
-					      uniform->data->component_count,
-					      uniform->data->entry_count,
-					      uniform->data->src_stride,
-					      uniform->data->dst_stride,
-					      uniform->init->data, 1, 0);
-		else
-			symbols[i] =
-				symbol_create(uniform->string->string, SYMBOL_UNIFORM,
-					      uniform->data->type,
-					      uniform->data->precision,
-					      uniform->data->component_count,
-					      uniform->data->entry_count,
-					      uniform->data->src_stride,
-					      uniform->data->dst_stride,
-					      NULL, 0, 0);
-
-		if (!symbols[i]) {
-			printf("%s: Error: failed to create symbol %s: %s\n",
-			       __func__, uniform->string->string, strerror(errno));
-			goto error;
+		new = symbol_arena_get(arena, sizeof(struct symbol));
+		name = symbol_arena_string(arena, uniform.string->string);
+
+		symbol_init(&symbol, name, SYMBOL_UNIFORM,
+			    uniform.data->type, uniform.data->precision,
+			    uniform.data->component_count,
+			    uniform.data->entry_count,
+			    uniform.data->src_stride,
+			    uniform.data->dst_stride, 0);
+		symbol.offset = uniform.data->offset;
+
+		if (uniform.init) {
+			symbol.data = symbol_arena_get(arena, symbol.size);
+			if (arena->address)
+				memcpy(symbol.data, uniform.init->data,
+				       symbol.size);
 		}
 
-		symbols[i]->offset = uniform->data->offset;
+		if (arena->address) {
+			*new = symbol;
+			symbols[i] = new;
+		}
 	}
 
-	return symbols;
- error:
-	if (symbols) {
-		for (i = 0; i < *count; i++)
-			if (symbols[i])
-				symbol_destroy(symbols[i]);
-	}
-	free(symbols);
+	if (arena->address) {
+		symbols_reverse(symbols, start->count);
 
-	*count = 0;
-	*size = 0;
+		*symbols_ret = start->count ? symbols : NULL;
+		*count_ret = start->count;
+		*size_ret = start->space_needed;
+	}
 
-	return NULL;
+	return 0;
 }
 
 /*
@@ -476,33 +401,11 @@ struct stream_attribute_data { /* 0x14 */
 };
 
 struct stream_attribute {
-	struct stream_attribute *next;
-
 	const struct stream_attribute_start *start;
 	const struct stream_string *string;
 	const struct stream_attribute_data *data;
 };
 
-struct stream_attribute_table {
-	const struct stream_attribute_table_start *start;
-
-	struct stream_attribute *attributes;
-};
-
-static int
-stream_attribute_table_start_read(const void *stream,
-				  struct stream_attribute_table *table)
-{
-	const struct stream_attribute_table_start *start = stream;
-
-	if (start->tag != STREAM_TAG_SATT)
-		return 0;
-
-	table->start = start;
-	return sizeof(struct stream_attribute_table_start);
-}
-
-
 static int
 stream_attribute_table_size_read(const void *stream, int *size)
 {
@@ -538,168 +441,77 @@ stream_attribute_data_read(const void *stream,
 	return sizeof(struct stream_attribute_data);
 }
 
-static void
-stream_attribute_table_destroy(struct stream_attribute_table *table)
-{
-	if (table) {
-		while (table->attributes) {
-			struct stream_attribute *attribute = table->attributes;
-
-			table->attributes = attribute->next;
-			free(attribute);
-		}
-
-		free(table);
-	}
-}
-
-static struct stream_attribute_table *
-stream_attribute_table_create(const void *stream, int size)
+static int
+stream_attribute_table_symbols_read(const void *stream, int size,
+				    struct symbol_arena *arena,
+				    struct symbol ***symbols_ret,
+				    int *count_ret)
 {
-	struct stream_attribute_table *table;
-	struct stream_attribute *attribute;
+	const struct stream_attribute_table_start *start = stream;
+	struct symbol **symbols;
 	int offset = 0;
 	int i;
 
 	if (!stream || !size)
-		return NULL;
-
-	table = calloc(1, sizeof(struct stream_attribute_table));
-	if (!table) {
-		printf("%s: failed to allocate table\n", __func__);
-		return NULL;
-	}
+		return 0;
 
-	offset += stream_attribute_table_start_read(stream + offset, table);
-	if (!table->start) {
+	if (start->tag != STREAM_TAG_SATT) {
 		printf("%s: Error: missing table start at 0x%x\n",
 		       __func__, offset);
-		goto corrupt;
+		return -1;
 	}
+	offset += sizeof(struct stream_attribute_table_start);
 
-	for (i = 0; i < table->start->count; i++) {
-		attribute = calloc(1, sizeof(struct stream_attribute));
-		if (!table) {
-			printf("%s: failed to allocate attribute\n", __func__);
-			goto oom;
-		}
+	symbols = symbol_arena_get(arena,
+				   start->count * sizeof(struct symbol *));
+
+	for (i = 0; i < start->count; i++) {
+		struct stream_attribute attribute = { 0 };
+		struct symbol *symbol;
+		const char *name;
 
-		offset += stream_attribute_start_read(stream + offset, attribute);
-		if (!attribute->start) {
+		offset += stream_attribute_start_read(stream + offset,
+						      &attribute);
+		if (!attribute.start) {
 			printf("%s: Error: missing attribute start at 0x%x\n",
 			       __func__, offset);
-			goto corrupt;
+			return -1;
 		}
 
-		offset += stream_string_read(stream + offset, &attribute->string);
-		if (!attribute->string) {
+		offset += stream_string_read(stream + offset,
+					     &attribute.string);
+		if (!attribute.string) {
 			printf("%s: Error: missing string at 0x%x\n",
 			       __func__, offset);
-			goto corrupt;
-		}
-
-		offset += stream_attribute_data_read(stream + offset, attribute);
-		if (!attribute->data) {
-			printf("%s: Error: missing attribute data at 0x%x\n",
-			       __func__, offset);
-			goto corrupt;
+			return -1;
 		}
 
-		attribute->next = table->attributes;
-		table->attributes = attribute;
-	}
+		offset += stream_attribute_data_read(stream + offset,
+						     &attribute);
 
-	return table;
- oom:
-	stream_attribute_table_destroy(table);
-	return NULL;
- corrupt:
-	stream_attribute_table_destroy(table);
-	return NULL;
-}
+		symbol = symbol_arena_get(arena, sizeof(struct symbol));
+		name = symbol_arena_string(arena, attribute.string->string);
 
-#if 0
-static void
-stream_attribute_table_print(struct stream_attribute_table *table)
-{
-	struct stream_attribute *attribute;
-
-	attribute = table->attributes;
-	while (attribute) {
-		printf("attribute \"%s\" = {\n", attribute->string->string);
-		printf("\t type 0x%02x, component_count 0x%04x\n",
-		       attribute->data->type, attribute->data->component_count);
-		printf("\t component_size 0x%04x, entry_count 0x%04x\n",
-		       attribute->data->component_size, attribute->data->entry_count);
-		printf("\t stride 0x%04x, unknown0A 0x%02x, precision 0x%02x\n",
-		       attribute->data->stride, attribute->data->unknown0A,
-		       attribute->data->precision);
-		printf("\t unknown0C 0x%04x, offset 0x%04x\n",
-		       attribute->data->unknown0C, attribute->data->offset);
-		printf("}\n");
-		attribute = attribute->next;
-	}
-}
-#endif
-
-static struct symbol **
-stream_attribute_table_to_symbols(struct stream_attribute_table *table,
-				int *count)
-{
-	struct stream_attribute *attribute;
-	struct symbol **symbols;
-	int i, j = 0;
-
-	if (!table || !count)
-		return NULL;
-
-	*count = table->start->count;
+		if (!arena->address)
+			continue;
 
-	if (!table->start->count)
-		return NULL;
+		symbol_init(symbol, name, SYMBOL_ATTRIBUTE,
+			    attribute.data->type, attribute.data->precision,
+			    attribute.data->component_count,
+			    attribute.data->entry_count, 0, 0, 0);
+		symbol->offset = attribute.data->offset;
 
-	symbols = calloc(*count, sizeof(struct symbol *));
-	if (!symbols) {
-		printf("%s: Error: failed to allocate symbols: %s\n",
-		       __func__, strerror(errno));
-		goto error;
+		symbols[i] = symbol;
 	}
 
-	for (i = 0, attribute = table->attributes;
-	     (i < table->start->count) && attribute;
-	     i++, attribute = attribute->next) {
-		struct symbol *symbol;
-		symbol =
-			symbol_create(attribute->string->string, SYMBOL_ATTRIBUTE,
-				      attribute->data->type,
-				      attribute->data->precision,
-				      attribute->data->component_count,
-				      attribute->data->entry_count,
-				      0, 0, NULL, 0, 0);
-		if (!symbol) {
-			printf("%s: Error: failed to create symbol %s: %s\n",
-			       __func__, attribute->string->string, strerror(errno));
-			goto error;
-		}
-
-		symbol->offset = attribute->data->offset;
+	if (arena->address) {
+		symbols_reverse(symbols, start->count);
 
-		symbols[j] = symbol;
-		j++;
+		*symbols_ret = start->count ? symbols : NULL;
+		*count_ret = start->count;
 	}
 
-	return symbols;
- error:
-	if (symbols) {
-		for (i = 0; i < *count; i++)
-			if (symbols[i])
-				symbol_destroy(symbols[i]);
-	}
-	free(symbols);
-
-	*count = 0;
-
-	return NULL;
+	return 0;
 }
 
 /*
@@ -735,32 +547,11 @@ struct stream_varying_data { /* 0x14 */
 };
 
 struct stream_varying {
-	struct stream_varying *next;
-
 	const struct stream_varying_start *start;
 	const struct stream_string *string;
 	const struct stream_varying_data *data;
 };
 
-struct stream_varying_table {
-	const struct stream_varying_table_start *start;
-
-	struct stream_varying *varyings;
-};
-
-static int
-stream_varying_table_start_read(const void *stream,
-				struct stream_varying_table *table)
-{
-	const struct stream_varying_table_start *start = stream;
-
-	if (start->tag != STREAM_TAG_SVAR)
-		return 0;
-
-	table->start = start;
-	return sizeof(struct stream_varying_table_start);
-}
-
 static int
 stream_varying_table_size_read(const void *stream, int *size)
 {
@@ -793,179 +584,87 @@ stream_varying_data_read(const void *stream, struct stream_varying *varying)
 	return sizeof(struct stream_varying_data);
 }
 
-static void
-stream_varying_table_destroy(struct stream_varying_table *table)
-{
-	if (table) {
-		while (table->varyings) {
-			struct stream_varying *varying = table->varyings;
-
-			table->varyings = varying->next;
-			free(varying);
-		}
-
-		free(table);
-	}
-}
-
-static struct stream_varying_table *
-stream_varying_table_create(const void *stream, int size)
+/*
+ * Varyings which the compiler did not assign an offset to are dropped.
+ */
+static int
+stream_varying_table_symbols_read(const void *stream, int size,
+				  struct symbol_arena *arena,
+				  struct symbol ***symbols_ret,
+				  int *count_ret)
 {
-	struct stream_varying_table *table;
-	struct stream_varying *varying;
+	const struct stream_varying_table_start *start = stream;
+	struct symbol **symbols;
 	int offset = 0;
-	int i;
+	int i, count = 0;
 
 	if (!stream || !size)
-		return NULL;
-
-	table = calloc(1, sizeof(struct stream_varying_table));
-	if (!table) {
-		printf("%s: failed to allocate table\n", __func__);
-		return NULL;
-	}
+		return 0;
 
-	offset += stream_varying_table_start_read(stream + offset, table);
-	if (!table->start) {
+	if (start->tag != STREAM_TAG_SVAR) {
 		printf("%s: Error: missing table start at 0x%x\n",
 		       __func__, offset);
-		goto corrupt;
+		return -1;
 	}
+	offset += sizeof(struct stream_varying_table_start);
 
-	for (i = 0; i < table->start->count; i++) {
-		varying = calloc(1, sizeof(struct stream_varying));
-		if (!table) {
-			printf("%s: failed to allocate varying\n", __func__);
-			goto oom;
-		}
+	symbols = symbol_arena_get(arena,
+				   start->count * sizeof(struct symbol *));
 
-		offset += stream_varying_start_read(stream + offset, varying);
-		if (!varying->start) {
+	for (i = 0; i < start->count; i++) {
+		struct stream_varying varying = { 0 };
+		struct symbol *symbol;
+		const char *name;
+		int flag;
+
+		offset += stream_varying_start_read(stream + offset, &varying);
+		if (!varying.start) {
 			printf("%s: Error: missing varying start at 0x%x\n",
 			       __func__, offset);
-			goto corrupt;
+			return -1;
 		}
 
-		offset += stream_string_read(stream + offset, &varying->string);
-		if (!varying->string) {
+		offset += stream_string_read(stream + offset, &varying.string);
+		if (!varying.string) {
 			printf("%s: Error: missing string at 0x%x\n",
 			       __func__, offset);
-			goto corrupt;
-		}
-
-		offset += stream_varying_data_read(stream + offset, varying);
-		if (!varying->data) {
-			printf("%s: Error: missing varying data at 0x%x\n",
-			       __func__, offset);
-			goto corrupt;
+			return -1;
 		}
 
-		varying->next = table->varyings;
-		table->varyings = varying;
-	}
-
-	return table;
- oom:
-	stream_varying_table_destroy(table);
-	return NULL;
- corrupt:
-	stream_varying_table_destroy(table);
-	return NULL;
-}
-
-#if 0
-static void
-stream_varying_table_print(struct stream_varying_table *table)
-{
-	struct stream_varying *varying;
-
-	varying = table->varyings;
-	while (varying) {
-		printf("varying \"%s\" = {\n", varying->string->string);
-		printf("\t type 0x%02x, component_count 0x%04x\n",
-		       varying->data->type, varying->data->component_count);
-		printf("\t component_size 0x%04x, entry_count 0x%04x\n",
-		       varying->data->stride0, varying->data->entry_count);
-		printf("\t stride 0x%04x, ranking 0x%02x, precision 0x%02x\n",
-		       varying->data->stride1, varying->data->ranking,
-		       varying->data->precision);
-		printf("\t flag 0x%04x, offset 0x%04x\n",
-		       varying->data->flag, varying->data->offset);
-		printf("}\n");
-		varying = varying->next;
-	}
-}
-#endif
+		offset += stream_varying_data_read(stream + offset, &varying);
 
-static struct symbol **
-stream_varying_table_to_symbols(struct stream_varying_table *table,
-				int *count)
-{
-	struct stream_varying *varying;
-	struct symbol **symbols;
-	int i, j;
-
-	if (!table || !count)
-		return NULL;
-
-	*count = table->start->count;
-
-	if (!table->start->count)
-		return NULL;
-
-	symbols = calloc(*count, sizeof(struct symbol *));
-	if (!symbols) {
-		printf("%s: Error: failed to allocate symbols: %s\n",
-		       __func__, strerror(errno));
-		goto error;
-	}
-
-	for (i = 0, j = 0, varying = table->varyings;
-	     (i < table->start->count) && varying;
-	     i++, varying = varying->next) {
-		struct symbol *symbol;
-		int flag;
+		if (varying.data->offset == 0xFFFF)
+			continue;
 
-		if (varying->data->flags & 0x08)
+		if (varying.data->flags & 0x08)
 			flag = SYMBOL_USE_VERTEX_SIZE;
 		else
 			flag = 0;
 
-		if (varying->data->offset == 0xFFFF) {
-			(*count)--;
-			continue;
-		}
+		symbol = symbol_arena_get(arena, sizeof(struct symbol));
+		name = symbol_arena_string(arena, varying.string->string);
 
-		symbol = symbol_create(varying->string->string, SYMBOL_VARYING,
-				       varying->data->type,
-				       varying->data->precision,
-				       varying->data->component_count,
-				       varying->data->entry_count,
-				       0, 0, NULL, 0, flag);
-		if (!symbol) {
-			printf("%s: Error: failed to create symbol %s: %s\n",
-			       __func__, varying->string->string, strerror(errno));
-			goto error;
-		}
+		if (!arena->address)
+			continue;
 
-		symbol->offset = varying->data->offset;
+		symbol_init(symbol, name, SYMBOL_VARYING,
+			    varying.data->type, varying.data->precision,
+			    varying.data->component_count,
+			    varying.data->entry_count, 0, 0, flag);
+		symbol->offset = varying.data->offset;
 
-		symbols[j] = symbol;
-		j++;
+		symbols[count] = symbol;
+		count++;
 	}
 
-	return symbols;
- error:
-	if (symbols) {
-		for (i = 0; i < *count; i++)
-			if (symbols[i])
-				symbol_destroy(symbols[i]);
-	}
-	free(symbols);
+	if (arena->address) {
+		symbols_reverse(symbols, count);
 
-	*count = 0;
+		*symbols_ret = count ? symbols : NULL;
+		*count_ret = count;
+	}
 
-	return NULL;
+	return 0;
 }
 
 #if 0
@@ -1166,46 +865,96 @@ limare_shader_compile(struct limare_state *state, int type, const char *source)
 	return binary;
 }
 
+static int
+program_vertex_shader_symbols_read(struct limare_program *program,
+				   struct lima_shader_binary *binary,
+				   struct symbol_arena *arena)
+{
+	if (stream_uniform_table_symbols_read(binary->uniform_stream,
+					      binary->uniform_stream_size,
+					      arena,
+					      &program->vertex_uniforms,
+					      &program->vertex_uniform_count,
+					      &program->vertex_uniform_size))
+		return -1;
+
+	if (stream_attribute_table_symbols_read(binary->attribute_stream,
+						binary->attribute_stream_size,
+						arena,
+						&program->vertex_attributes,
+						&program->vertex_attribute_count))
+		return -1;
+
+	if (stream_varying_table_symbols_read(binary->varying_stream,
+					      binary->varying_stream_size,
+					      arena,
+					      &program->vertex_varyings,
+					      &program->vertex_varying_count))
+		return -1;
+
+	return 0;
+}
+
+static void
+symbols_data_free(struct symbol **symbols, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (symbols[i]->data_allocated) {
+			free(symbols[i]->data);
+			symbols[i]->data = NULL;
+			symbols[i]->data_allocated = 0;
+		}
+}
+
+static void
+program_vertex_shader_symbols_free(struct limare_program *program)
+{
+	symbols_data_free(program->vertex_uniforms,
+			  program->vertex_uniform_count);
+	symbols_data_free(program->vertex_attributes,
+			  program->vertex_attribute_count);
+	symbols_data_free(program->vertex_varyings,
+			  program->vertex_varying_count);
+
+	free(program->vertex_symbol_arena);
+	program->vertex_symbol_arena = NULL;
+
+	program->vertex_uniforms = NULL;
+	program->vertex_uniform_count = 0;
+	program->vertex_uniform_size = 0;
+	program->vertex_attributes = NULL;
+	program->vertex_attribute_count = 0;
+	program->vertex_varyings = NULL;
+	program->vertex_varying_count = 0;
+}
+
 static int
 program_vertex_shader_symbols_attach(struct limare_program *program,
 				     struct lima_shader_binary *binary)
 {
-	struct stream_uniform_table *uniform_table;
-	struct stream_attribute_table *attribute_table;
-	struct stream_varying_table *varying_table;
-
-	uniform_table =
-		stream_uniform_table_create(binary->uniform_stream,
-					    binary->uniform_stream_size);
-	if (uniform_table) {
-		program->vertex_uniforms =
-			stream_uniform_table_to_symbols(uniform_table,
-							&program->vertex_uniform_count,
-							&program->vertex_uniform_size);
-		stream_uniform_table_destroy(uniform_table);
-	}
+	struct symbol_arena arena = { 0 };
 
-	attribute_table =
-		stream_attribute_table_create(binary->attribute_stream,
-					      binary->attribute_stream_size);
-	if (attribute_table) {
-		program->vertex_attributes =
-			stream_attribute_table_to_symbols(attribute_table,
-							  &program->vertex_attribute_count);
-		stream_attribute_table_destroy(attribute_table);
-	}
+	program_vertex_shader_symbols_free(program);
+
+	if (program_vertex_shader_symbols_read(program, binary, &arena))
+		return -1;
+
+	if (!arena.used)
+		return 0;
 
-	varying_table =
-		stream_varying_table_create(binary->varying_stream,
-					    binary->varying_stream_size);
-	if (varying_table) {
-		program->vertex_varyings =
-			stream_varying_table_to_symbols(varying_table,
-							&program->vertex_varying_count);
-		stream_varying_table_destroy(varying_table);
+	arena.address = malloc(arena.used);
+	if (!arena.address) {
+		printf("%s: Error: failed to allocate symbols: %s\n",
+		       __func__, strerror(errno));
+		return -1;
 	}
+	arena.used = 0;
 
-	return 0;
+	program->vertex_symbol_arena = arena.address;
+
+	return program_vertex_shader_symbols_read(program, binary, &arena);
 }
 
 int
@@ -1239,35 +988,72 @@ limare_program_vertex_shader_attach(struct limare_state *state,
 	return 0;
 }
 
+static int
+program_fragment_shader_symbols_read(struct limare_program *program,
+				     struct lima_shader_binary *binary,
+				     struct symbol_arena *arena)
+{
+	if (stream_uniform_table_symbols_read(binary->uniform_stream,
+					      binary->uniform_stream_size,
+					      arena,
+					      &program->fragment_uniforms,
+					      &program->fragment_uniform_count,
+					      &program->fragment_uniform_size))
+		return -1;
+
+	if (stream_varying_table_symbols_read(binary->varying_stream,
+					      binary->varying_stream_size,
+					      arena,
+					      &program->fragment_varyings,
+					      &program->fragment_varying_count))
+		return -1;
+
+	return 0;
+}
+
+static void
+program_fragment_shader_symbols_free(struct limare_program *program)
+{
+	symbols_data_free(program->fragment_uniforms,
+			  program->fragment_uniform_count);
+	symbols_data_free(program->fragment_varyings,
+			  program->fragment_varying_count);
+
+	free(program->fragment_symbol_arena);
+	program->fragment_symbol_arena = NULL;
+
+	program->fragment_uniforms = NULL;
+	program->fragment_uniform_count = 0;
+	program->fragment_uniform_size = 0;
+	program->fragment_varyings = NULL;
+	program->fragment_varying_count = 0;
+}
+
 static int
 program_fragment_shader_symbols_attach(struct limare_program *program,
 				       struct lima_shader_binary *binary)
 {
-	struct stream_uniform_table *uniform_table;
-	struct stream_varying_table *varying_table;
-
-	uniform_table =
-		stream_uniform_table_create(binary->uniform_stream,
-					    binary->uniform_stream_size);
-	if (uniform_table) {
-		program->fragment_uniforms =
-			stream_uniform_table_to_symbols(uniform_table,
-							&program->fragment_uniform_count,
-							&program->fragment_uniform_size);
-		stream_uniform_table_destroy(uniform_table);
-	}
+	struct symbol_arena arena = { 0 };
 
-	varying_table =
-		stream_varying_table_create(binary->varying_stream,
-					    binary->varying_stream_size);
-	if (varying_table) {
-		program->fragment_varyings =
-			stream_varying_table_to_symbols(varying_table,
-							&program->fragment_varying_count);
-		stream_varying_table_destroy(varying_table);
+	program_fragment_shader_symbols_free(program);
+
+	if (program_fragment_shader_symbols_read(program, binary, &arena))
+		return -1;
+
+	if (!arena.used)
+		return 0;
+
+	arena.address = malloc(arena.used);
+	if (!arena.address) {
+		printf("%s: Error: failed to allocate symbols: %s\n",
+		       __func__, strerror(errno));
+		return -1;
 	}
+	arena.used = 0;
 
-	return 0;
+	program->fragment_symbol_arena = arena.address;
+
+	return program_fragment_shader_symbols_read(program, binary, &arena);
 }
 
 int
@@ -2155,6 +1941,21 @@ limare_program_create(void *address, unsigned int physical,
 	return program;
 }
 
+/*
+ * Only the symbol arenas, the shader copies and any uniform data which
+ * was converted on attach need freeing.
+ */
+void
+limare_program_destroy(struct limare_program *program)
+{
+	program_vertex_shader_symbols_free(program);
+	program_fragment_shader_symbols_free(program);
+
+	free(program->vertex_shader);
+	free(program->fragment_shader);
+	free(program);
+}
+
 /*
  * Do half the linking work ourselves instead of using standard
  * infrastructure.
@@ -57,6 +57,9 @@ struct limare_program {
 	struct symbol **vertex_varyings;
 	int vertex_varying_count;
 
+	/* holds all of the above vertex symbols */
+	void *vertex_symbol_arena;
+
 	void *fragment_shader;
 	int fragment_shader_size;
 	int fragment_first_instruction_size;
@@ -71,17 +74,27 @@ struct limare_program {
 	struct symbol **fragment_varyings;
 	int fragment_varying_count;
 
+	/* holds all of the above fragment symbols */
+	void *fragment_symbol_arena;
+
 	struct symbol *gl_Position;
 	struct symbol *gl_PointSize;
 
 	struct varying_map varying_map[12];
 	int varying_map_count;
 	int varying_map_size;
+
+#define LIMARE_PROGRAM_UNIFORM_BLOCK_COUNT 4
+	struct limare_uniform_block *
+		uniform_blocks[LIMARE_PROGRAM_UNIFORM_BLOCK_COUNT];
+	int uniform_block_serials[LIMARE_PROGRAM_UNIFORM_BLOCK_COUNT];
+	int uniform_block_count;
 };
 
 struct limare_program *
 limare_program_create(void *address, unsigned int physical,
 		      int offset, int size);
+void limare_program_destroy(struct limare_program *program);
 
 int
 limare_program_vertex_shader_attach(struct limare_state *state,
@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2013 Luc Verhaegen <libv@skynet.be>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Float attributes get tried against ever larger formats, and the first
+ * one which reproduces every value within the given error is used.
+ *
+ * Normalised formats follow the GLES2 conversion rules: c / (2^b - 1)
+ * for unsigned, (2c + 1) / (2^b - 1) for signed. Plain integer formats
+ * store (value - bias) / scale per component, and the vertex shader has
+ * to apply scale and bias again, usually through a uniform.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "limare.h"
+#include "quantise.h"
+
+struct quantise_format {
+	enum limare_attrib_type type;
+	int size;
+	int is_signed;
+	int normalised;
+	int max; /* largest positive value */
+};
+
+static const struct quantise_format quantise_formats[] = {
+	{LIMARE_ATTRIB_I8,   1, 1, 0, 0x7F},
+	{LIMARE_ATTRIB_I16,  2, 1, 0, 0x7FFF},
+	{LIMARE_ATTRIB_I8N,  1, 1, 1, 0x7F},
+	{LIMARE_ATTRIB_I16N, 2, 1, 1, 0x7FFF},
+	{LIMARE_ATTRIB_U8N,  1, 0, 1, 0xFF},
+	{LIMARE_ATTRIB_U16N, 2, 0, 1, 0xFFFF},
+	{0, 0, 0, 0, 0},
+};
+
+/* candidates per usage, smallest first. float is the final fallback. */
+static const enum limare_attrib_type quantise_candidates[][3] = {
+	[LIMARE_ATTRIB_USAGE_POSITION] = {
+		LIMARE_ATTRIB_I8, LIMARE_ATTRIB_I16, LIMARE_ATTRIB_FLOAT},
+	[LIMARE_ATTRIB_USAGE_NORMAL] = {
+		LIMARE_ATTRIB_I8N, LIMARE_ATTRIB_I16N, LIMARE_ATTRIB_FLOAT},
+	[LIMARE_ATTRIB_USAGE_TEXCOORD] = {
+		LIMARE_ATTRIB_U16N, LIMARE_ATTRIB_FLOAT, LIMARE_ATTRIB_FLOAT},
+	[LIMARE_ATTRIB_USAGE_COLOUR] = {
+		LIMARE_ATTRIB_U8N, LIMARE_ATTRIB_U16N, LIMARE_ATTRIB_FLOAT},
+};
+
+static int
+quantise_round(float value)
+{
+	if (value >= 0.0)
+		return (int) (value + 0.5);
+	else
+		return -((int) (-value + 0.5));
+}
+
+static int
+quantise_encode(const struct quantise_format *format, float value,
+		float scale, float bias)
+{
+	int min = format->is_signed ? -format->max - 1 : 0;
+	int quantised;
+
+	if (!format->normalised)
+		quantised = quantise_round((value - bias) / scale);
+	else if (format->is_signed)
+		quantised = quantise_round((value * (2 * format->max + 1) - 1)
+					   / 2);
+	else
+		quantised = quantise_round(value * format->max);
+
+	if (quantised < min)
+		return min;
+	if (quantised > format->max)
+		return format->max;
+	return quantised;
+}
+
+static float
+quantise_decode(const struct quantise_format *format, int quantised,
+		float scale, float bias)
+{
+	if (!format->normalised)
+		return quantised * scale + bias;
+	else if (format->is_signed)
+		return (2.0 * quantised + 1) / (2 * format->max + 1);
+	else
+		return (float) quantised / format->max;
+}
+
+/*
+ * Converts into converted, when non-NULL, and returns the largest error.
+ */
+static float
+quantise_convert(const struct quantise_format *format, const float *data,
+		 int component_count, int entry_count, int entry_stride,
+		 const float *scale, const float *bias, void *converted)
+{
+	float error = 0.0, diff;
+	int i, j, quantised;
+
+	for (i = 0; i < entry_count; i++) {
+		for (j = 0; j < component_count; j++) {
+			float value = data[i * component_count + j];
+
+			quantised = quantise_encode(format, value, scale[j],
+						    bias[j]);
+
+			diff = quantise_decode(format, quantised, scale[j],
+					       bias[j]) - value;
+			if (diff < 0.0)
+				diff = -diff;
+			if (diff > error)
+				error = diff;
+
+			if (!converted)
+				continue;
+
+			if (format->size == 1)
+				((unsigned char *) converted)
+					[i * entry_stride + j] = quantised;
+			else
+				((unsigned short *) (converted +
+						     i * entry_stride))[j] =
+					quantised;
+		}
+	}
+
+	return error;
+}
+
+/*
+ * Picks the smallest format for usage which stays within max_error, and
+ * returns the data converted to it, padded out to a 0x40 multiple.
+ */
+void *
+attribute_quantise(enum limare_attrib_usage usage, const float *data,
+		   int component_count, int entry_count, float max_error,
+		   int *entry_stride,
+		   struct limare_attribute_quantisation *quantisation)
+{
+	const struct quantise_format *format = NULL;
+	void *converted;
+	int i, j, size;
+
+	if ((usage < LIMARE_ATTRIB_USAGE_POSITION) ||
+	    (usage > LIMARE_ATTRIB_USAGE_COLOUR)) {
+		printf("%s: Error: unknown usage %d\n", __func__, usage);
+		return NULL;
+	}
+
+	if ((component_count < 1) || (component_count > 4)) {
+		printf("%s: Error: invalid component count %d\n", __func__,
+		       component_count);
+		return NULL;
+	}
+
+	for (i = 0; i < 3; i++) {
+		enum limare_attrib_type type = quantise_candidates[usage][i];
+
+		quantisation->type = type;
+
+		for (j = 0; j < 4; j++) {
+			quantisation->scale[j] = 1.0;
+			quantisation->bias[j] = 0.0;
+		}
+
+		if (type == LIMARE_ATTRIB_FLOAT) {
+			format = NULL;
+			quantisation->error = 0.0;
+			break;
+		}
+
+		for (j = 0; quantise_formats[j].size; j++)
+			if (quantise_formats[j].type == type)
+				break;
+		format = &quantise_formats[j];
+
+		/* fit the component range onto the integer range */
+		if (!format->normalised && entry_count) {
+			for (j = 0; j < component_count; j++) {
+				float min = data[j], max = data[j];
+				int k;
+
+				for (k = 1; k < entry_count; k++) {
+					float value =
+						data[k * component_count + j];
+
+					if (value < min)
+						min = value;
+					if (value > max)
+						max = value;
+				}
+
+				quantisation->bias[j] = (min + max) / 2;
+				if (max > min)
+					quantisation->scale[j] =
+						(max - min) / (2 * format->max);
+			}
+		}
+
+		quantisation->error =
+			quantise_convert(format, data, component_count,
+					 entry_count, 0, quantisation->scale,
+					 quantisation->bias, NULL);
+		if (quantisation->error <= max_error)
+			break;
+	}
+
+	if (format)
+		*entry_stride = ALIGN(format->size * component_count, 4);
+	else
+		*entry_stride = 4 * component_count;
+
+	size = ALIGN(*entry_stride * entry_count, 0x40);
+
+	converted = calloc(1, size ? size : 0x40);
+	if (!converted) {
+		printf("%s: Error: failed to allocate: %s\n", __func__,
+		       strerror(errno));
+		return NULL;
+	}
+
+	if (format)
+		quantise_convert(format, data, component_count, entry_count,
+				 *entry_stride, quantisation->scale,
+				 quantisation->bias, converted);
+	else
+		memcpy(converted, data, *entry_stride * entry_count);
+
+	return converted;
+}
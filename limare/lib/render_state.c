@@ -28,6 +28,7 @@
 
 #include <GLES2/gl2.h>
 
+#include "fnv.h"
 #include "limare.h"
 #include "gp.h"
 #include "compiler.h"
@@ -76,6 +77,52 @@ limare_render_state_template(void)
 }
 
 
+/*
+ * Identical render states are emitted only once per frame. Varyings and
+ * fragment uniforms live in per draw buffers, so in practice only draws
+ * without either share. Returns the frame memory offset of the render
+ * state, or -1 when out of space.
+ */
+static int
+render_state_emit(struct limare_frame *frame, struct render_state *render)
+{
+	unsigned int hash = lima_fnv_hash(LIMA_FNV_OFFSET, render,
+					  sizeof(struct render_state));
+	int size = ALIGN(sizeof(struct render_state), 0x40);
+	int i, slot, offset;
+
+	for (i = 0; i < LIMARE_RENDER_STATE_HASH_SIZE; i++) {
+		slot = (hash + i) & (LIMARE_RENDER_STATE_HASH_SIZE - 1);
+
+		if (!frame->render_states[slot].size)
+			break;
+
+		if ((frame->render_states[slot].hash == hash) &&
+		    !memcmp(frame->render_states[slot].render, render,
+			    sizeof(struct render_state)))
+			return frame->render_states[slot].offset;
+	}
+
+	if (size > (frame->mem_size - frame->mem_used))
+		return -1;
+
+	offset = frame->mem_used;
+	memcpy(frame->mem_address + offset, render,
+	       sizeof(struct render_state));
+	frame->mem_used += size;
+
+	/* a full table only loses sharing, never correctness. */
+	if (i < LIMARE_RENDER_STATE_HASH_SIZE) {
+		frame->render_states[slot].hash = hash;
+		frame->render_states[slot].offset = offset;
+		frame->render_states[slot].size = size;
+		memcpy(frame->render_states[slot].render, render,
+		       sizeof(struct render_state));
+	}
+
+	return offset;
+}
+
 int
 draw_render_state_create(struct limare_frame *frame,
 			 struct limare_program *program,
@@ -84,36 +131,16 @@ draw_render_state_create(struct limare_frame *frame,
 {
 	struct plbu_info *plbu = draw->plbu;
 	struct vs_info *vs = draw->vs;
-	struct render_state *render;
-	int size, i;
+	struct render_state render[1];
+	int offset, i;
 
 	if (plbu->render_state) {
 		printf("%s: render_state already assigned\n", __func__);
 		return -1;
 	}
 
-	size = ALIGN(sizeof(struct render_state), 0x40);
-	if (size > (frame->mem_size - frame->mem_used)) {
-		printf("%s: no more space\n", __func__);
-		return -2;
-	}
-
-	plbu->render_state = frame->mem_address + frame->mem_used;
-	plbu->render_state_offset = frame->mem_used;
-	plbu->render_state_size = size;
-	frame->mem_used += size;
-
-	render = plbu->render_state;
-
-	render->unknown00 = template->unknown00;
-	render->unknown04 = template->unknown04;
-	render->unknown08 = template->unknown08;
-	render->unknown0C = template->unknown0C;
-	render->depth_range = template->depth_range;
-	render->unknown14 = template->unknown14;
-	render->unknown18 = template->unknown18;
-	render->unknown1C = template->unknown1C;
-	render->unknown20 = template->unknown20;
+	/* every word gets hashed and compared, none may be left unset. */
+	*render = *template;
 
 	render->shader_address = program->fragment_first_instruction_size |
 		(program->mem_physical + program->fragment_mem_offset);
@@ -121,9 +148,6 @@ draw_render_state_create(struct limare_frame *frame,
 	render->uniforms_address = 0;
 	render->textures_address = 0;
 
-	render->unknown34 = template->unknown34;
-	render->unknown38 = template->unknown38;
-
 	if (vs->varying_size) {
 		render->varyings_address = frame->mem_physical +
 			vs->varying_offset;
@@ -176,6 +200,16 @@ draw_render_state_create(struct limare_frame *frame,
 		render->unknown34 |= 0x20;
 	}
 
+	offset = render_state_emit(frame, render);
+	if (offset < 0) {
+		printf("%s: no more space\n", __func__);
+		return -2;
+	}
+
+	plbu->render_state = frame->mem_address + offset;
+	plbu->render_state_offset = offset;
+	plbu->render_state_size = ALIGN(sizeof(struct render_state), 0x40);
+
 	return 0;
 }
 
@@ -31,15 +31,17 @@
 
 #include "symbols.h"
 
-struct symbol *
-symbol_create(const char *name, enum symbol_type type,
-	      enum symbol_value_type value_type,
-	      int precision, int component_count,
-	      int entry_count, int src_stride, int dst_stride,
-	      const void *data, int copy, int flag)
+/*
+ * Fills in a symbol in place, without allocating, so that program loading
+ * can lay symbols out in its own arena.
+ */
+void
+symbol_init(struct symbol *symbol, const char *name, enum symbol_type type,
+	    enum symbol_value_type value_type, int precision,
+	    int component_count, int entry_count, int src_stride,
+	    int dst_stride, int flag)
 {
-	struct symbol *symbol;
-	int size, component_size;
+	int component_size;
 
 	if (!entry_count)
 		entry_count = 1;
@@ -49,26 +51,9 @@ symbol_create(const char *name, enum symbol_type type,
 
 	component_size = 1 << (precision - 1);
 
-	size = component_size * component_count * entry_count;
-
-	symbol = calloc(1, sizeof(struct symbol));
-	if (!symbol) {
-		printf("%s: failed to allocate: %s\n", __func__, strerror(errno));
-		return NULL;
-	}
-
-	if (copy) {
-		symbol->data = malloc(size);
-		if (!symbol->data) {
-			printf("%s: failed to allocate data: %s\n",
-			       __func__, strerror(errno));
-			free(symbol);
-			return NULL;
-		}
-		symbol->data_allocated = 1;
-	}
+	memset(symbol, 0, sizeof(struct symbol));
 
-	strncpy(symbol->name, name, SYMBOL_STRING_SIZE);
+	symbol->name = name;
 	symbol->type = type;
 	symbol->flag = flag;
 	symbol->value_type = value_type;
@@ -83,49 +68,7 @@ symbol_create(const char *name, enum symbol_type type,
 		symbol->dst_stride = dst_stride;
 	}
 
-	symbol->size = size;
-
-	if (copy)
-		memcpy(symbol->data, data, size);
-	else
-		symbol->data = (void *) data;
-
-	return symbol;
-}
-
-struct symbol *
-symbol_copy(struct symbol *original, int start, int count)
-{
-	struct symbol *symbol;
-
-	symbol = malloc(sizeof(struct symbol));
-	if (!symbol) {
-		printf("%s: failed to allocate: %s\n", __func__, strerror(errno));
-		return NULL;
-	}
-
-	memcpy(symbol, original, sizeof(struct symbol));
-
-	symbol->entry_count = count;
-	symbol->size = symbol->component_size * symbol->component_count *
-		symbol->entry_count;
-
-	symbol->data_allocated = 0;
-
-	if (original->data)
-		symbol->data = original->data +
-			symbol->component_size * symbol->component_count * start;
-
-	return symbol;
-}
-
-
-void
-symbol_destroy(struct symbol *symbol)
-{
-	if (symbol->data_allocated)
-		free(symbol->data);
-	free(symbol);
+	symbol->size = component_size * component_count * entry_count;
 }
 
 void
@@ -144,6 +87,9 @@ symbol_print(struct symbol *symbol)
 	case SYMBOL_VARYING:
 		type = "varying";
 		break;
+	default:
+		type = "unknown";
+		break;
 	}
 
 	printf("Symbol %s (%s) = {\n", symbol->name, type);
@@ -42,9 +42,8 @@ enum symbol_value_type {
 };
 
 struct symbol {
-#define SYMBOL_STRING_SIZE 64
 	/* as referenced by the shaders and shader compiler binary streams */
-	char name[SYMBOL_STRING_SIZE + 1];
+	const char *name;
 
 	enum symbol_type type;
 	enum symbol_value_type value_type;
@@ -75,17 +74,14 @@ struct symbol {
 	int data_allocated;
 	/* Or can be a handle */
 	int data_handle;
+	int data_offset; /* into the attribute buffer behind data_handle */
 };
 
-struct symbol *symbol_create(const char *name, enum symbol_type type,
-			     enum symbol_value_type value_type,
-			     int precision, int component_count,
-			     int entry_count, int src_stride, int dst_stride,
-			     const void *data, int copy, int flag);
+void symbol_init(struct symbol *symbol, const char *name,
+		 enum symbol_type type, enum symbol_value_type value_type,
+		 int precision, int component_count, int entry_count,
+		 int src_stride, int dst_stride, int flag);
 
-struct symbol *symbol_copy(struct symbol *original, int start, int count);
-
-void symbol_destroy(struct symbol *symbol);
 void symbol_print(struct symbol *symbol);
 
 #endif /* LIMARE_SYMBOLS_H */
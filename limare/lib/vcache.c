@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2013 Luc Verhaegen <libv@skynet.be>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Triangle reordering after Tom Forsyth's "Linear-Speed Vertex Cache
+ * Optimisation".
+ *
+ * The GP shades every vertex in the index range exactly once, so there
+ * is no re-shading to save within a single draw. What locality buys us
+ * here is the PLBU fetching transformed positions in order, and tight
+ * index ranges when 32 bit indices get split into 16 bit batches, as
+ * vertices shared between batches do get shaded once per batch.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "vcache.h"
+
+/*
+ * 0.75 for the vertices of the last triangle, then
+ * (1 - (i - 3) / (VCACHE_SIZE - 3)) ^ 1.5
+ */
+static const float vcache_position_score[VCACHE_SIZE] = {
+	0.7500, 0.7500, 0.7500, 1.0000, 0.8869, 0.7783, 0.6747, 0.5760,
+	0.4827, 0.3951, 0.3136, 0.2385, 0.1707, 0.1109, 0.0603, 0.0213,
+};
+
+/* 2 * remaining ^ -0.5, favours finishing off lonely vertices. */
+#define VCACHE_VALENCE_MAX 32
+static const float vcache_valence_score[VCACHE_VALENCE_MAX] = {
+	0.0000, 2.0000, 1.4142, 1.1547, 1.0000, 0.8944, 0.8165, 0.7559,
+	0.7071, 0.6667, 0.6325, 0.6030, 0.5774, 0.5547, 0.5345, 0.5164,
+	0.5000, 0.4851, 0.4714, 0.4588, 0.4472, 0.4364, 0.4264, 0.4170,
+	0.4082, 0.4000, 0.3922, 0.3849, 0.3780, 0.3714, 0.3651, 0.3592,
+};
+
+struct vcache_vertex {
+	int position; /* in the cache, -1 when not cached */
+	int remaining; /* triangles not emitted yet */
+	int offset; /* of our list in the triangles array */
+	float score;
+};
+
+static float
+vcache_vertex_score(struct vcache_vertex *vertex)
+{
+	float score = 0.0;
+
+	if (!vertex->remaining)
+		return -1.0;
+
+	if (vertex->position >= 0)
+		score = vcache_position_score[vertex->position];
+
+	if (vertex->remaining < VCACHE_VALENCE_MAX)
+		score += vcache_valence_score[vertex->remaining];
+	else
+		score += vcache_valence_score[VCACHE_VALENCE_MAX - 1];
+
+	return score;
+}
+
+/*
+ * Emits the triangle, updates the cache and the scores, and returns the
+ * best scoring triangle among the cached vertices, or -1.
+ */
+static int
+vcache_triangle_emit(const unsigned int *indices, int triangle,
+		     struct vcache_vertex *vertices, int *triangles,
+		     float *scores, int *cache, int *cache_count)
+{
+	int new[VCACHE_SIZE + 3];
+	int count = 0, best = -1;
+	float best_score = 0.0;
+	int i, j;
+
+	scores[triangle] = -1.0;
+
+	for (i = 0; i < 3; i++) {
+		unsigned int index = indices[3 * triangle + i];
+		struct vcache_vertex *vertex = &vertices[index];
+		int *list = &triangles[vertex->offset];
+
+		for (j = 0; list[j] != triangle; j++)
+			;
+		list[j] = list[vertex->remaining - 1];
+		vertex->remaining--;
+
+		for (j = 0; j < count; j++)
+			if (new[j] == index)
+				break;
+		if (j == count)
+			new[count++] = index;
+	}
+
+	for (i = 0; i < *cache_count; i++) {
+		for (j = 0; j < 3; j++)
+			if (cache[i] == indices[3 * triangle + j])
+				break;
+		if (j == 3)
+			new[count++] = cache[i];
+	}
+
+	for (i = 0; i < count; i++) {
+		struct vcache_vertex *vertex = &vertices[new[i]];
+		float score;
+
+		if (i < VCACHE_SIZE) {
+			vertex->position = i;
+			cache[i] = new[i];
+		} else
+			vertex->position = -1;
+
+		score = vcache_vertex_score(vertex);
+		for (j = 0; j < vertex->remaining; j++)
+			scores[triangles[vertex->offset + j]] +=
+				score - vertex->score;
+		vertex->score = score;
+	}
+
+	if (count > VCACHE_SIZE)
+		count = VCACHE_SIZE;
+	*cache_count = count;
+
+	for (i = 0; i < count; i++) {
+		struct vcache_vertex *vertex = &vertices[cache[i]];
+
+		for (j = 0; j < vertex->remaining; j++) {
+			int candidate = triangles[vertex->offset + j];
+
+			if (scores[candidate] > best_score) {
+				best = candidate;
+				best_score = scores[candidate];
+			}
+		}
+	}
+
+	return best;
+}
+
+/*
+ * Reorders a triangle list in place.
+ */
+int
+vcache_triangles_reorder(unsigned int *indices, int count, int vertex_count)
+{
+	int triangle_count = count / 3;
+	struct vcache_vertex *vertices;
+	unsigned int *output;
+	int *triangles;
+	float *scores;
+	int cache[VCACHE_SIZE];
+	int cache_count = 0, cursor = 0, best = -1, ret = -1;
+	float best_score = 0.0;
+	int i, j;
+
+	if (count % 3) {
+		printf("%s: Error: %d indices is not a triangle list\n",
+		       __func__, count);
+		return -1;
+	}
+
+	vertices = calloc(vertex_count, sizeof(struct vcache_vertex));
+	triangles = malloc(count * sizeof(int));
+	scores = malloc(triangle_count * sizeof(float));
+	output = malloc(count * sizeof(unsigned int));
+	if (!vertices || !triangles || !scores || !output) {
+		printf("%s: Error: failed to allocate: %s\n", __func__,
+		       strerror(errno));
+		goto out;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (indices[i] >= vertex_count) {
+			printf("%s: Error: index %u is beyond vertex count "
+			       "%d\n", __func__, indices[i], vertex_count);
+			goto out;
+		}
+		vertices[indices[i]].remaining++;
+	}
+
+	for (i = 0, j = 0; i < vertex_count; i++) {
+		vertices[i].position = -1;
+		vertices[i].offset = j;
+		j += vertices[i].remaining;
+		vertices[i].remaining = 0;
+	}
+
+	for (i = 0; i < count; i++) {
+		struct vcache_vertex *vertex = &vertices[indices[i]];
+
+		triangles[vertex->offset + vertex->remaining] = i / 3;
+		vertex->remaining++;
+	}
+
+	for (i = 0; i < vertex_count; i++)
+		vertices[i].score = vcache_vertex_score(&vertices[i]);
+
+	for (i = 0; i < triangle_count; i++) {
+		scores[i] = vertices[indices[3 * i]].score +
+			vertices[indices[3 * i + 1]].score +
+			vertices[indices[3 * i + 2]].score;
+
+		if (scores[i] > best_score) {
+			best = i;
+			best_score = scores[i];
+		}
+	}
+
+	for (i = 0; i < triangle_count; i++) {
+		/* nothing left around the cache, take the next one */
+		if (best < 0) {
+			while (scores[cursor] < 0.0)
+				cursor++;
+			best = cursor;
+		}
+
+		memcpy(&output[3 * i], &indices[3 * best],
+		       3 * sizeof(unsigned int));
+
+		best = vcache_triangle_emit(indices, best, vertices,
+					    triangles, scores, cache,
+					    &cache_count);
+	}
+
+	memcpy(indices, output, count * sizeof(unsigned int));
+	ret = 0;
+ out:
+	free(output);
+	free(scores);
+	free(triangles);
+	free(vertices);
+
+	return ret;
+}
+
+/*
+ * Renumbers vertices in the order of first use, so attribute fetches run
+ * linearly. remap[old] gets the new position of each of vertex_count
+ * vertices, unused vertices go at the end. Returns the number of used
+ * vertices.
+ */
+int
+vcache_vertices_reorder(unsigned int *indices, int count, int vertex_count,
+			unsigned int *remap)
+{
+	int i, used = 0;
+
+	for (i = 0; i < vertex_count; i++)
+		remap[i] = -1;
+
+	for (i = 0; i < count; i++) {
+		if (indices[i] >= vertex_count) {
+			printf("%s: Error: index %u is beyond vertex count "
+			       "%d\n", __func__, indices[i], vertex_count);
+			return -1;
+		}
+
+		if (remap[indices[i]] == -1)
+			remap[indices[i]] = used++;
+		indices[i] = remap[indices[i]];
+	}
+
+	for (i = 0, count = used; i < vertex_count; i++)
+		if (remap[i] == -1)
+			remap[i] = count++;
+
+	return used;
+}
+
+void
+vcache_attributes_remap(void *dst, const void *src, int stride,
+			int vertex_count, const unsigned int *remap)
+{
+	int i;
+
+	for (i = 0; i < vertex_count; i++)
+		memcpy(dst + remap[i] * stride, src + i * stride, stride);
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2013 Luc Verhaegen <libv@skynet.be>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Index and vertex reordering for vertex locality. Shared between
+ * liblimare and the offline mali_mesh tool.
+ */
+#ifndef LIMARE_VCACHE_H
+#define LIMARE_VCACHE_H 1
+
+/* entries in the modelled cache of transformed vertices. */
+#define VCACHE_SIZE 16
+
+int vcache_triangles_reorder(unsigned int *indices, int count,
+			     int vertex_count);
+int vcache_vertices_reorder(unsigned int *indices, int count,
+			    int vertex_count, unsigned int *remap);
+void vcache_attributes_remap(void *dst, const void *src, int stride,
+			     int vertex_count, const unsigned int *remap);
+
+#endif /* LIMARE_VCACHE_H */
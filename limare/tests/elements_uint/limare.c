@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2013 Luc Verhaegen <libv@skynet.be>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <GLES2/gl2.h>
+
+#include "limare.h"
+
+/* 264 * 250 vertices, more than a 16 bit index can address. */
+#define GRID_WIDTH 264
+#define GRID_HEIGHT 250
+
+int
+main(int argc, char *argv[])
+{
+	struct limare_state *state;
+	float *vertices;
+	unsigned int *indices;
+	int x, y, count = 0;
+	int ret;
+
+	const char *vertex_shader_source =
+		"attribute vec4 aPosition;    \n"
+		"                             \n"
+		"varying vec4 vColor;         \n"
+		"                             \n"
+		"void main()                  \n"
+		"{                            \n"
+		"    vColor = vec4(0.5 * aPosition.xy + 0.5, 0.0, 1.0);\n"
+		"    gl_Position = aPosition; \n"
+		"}                            \n";
+	const char *fragment_shader_source =
+		"precision mediump float;     \n"
+		"                             \n"
+		"varying vec4 vColor;         \n"
+		"                             \n"
+		"void main()                  \n"
+		"{                            \n"
+		"    gl_FragColor = vColor;   \n"
+		"}                            \n";
+
+	vertices = malloc(2 * GRID_WIDTH * GRID_HEIGHT * sizeof(float));
+	indices = malloc(3 * (GRID_WIDTH - 1) * (GRID_HEIGHT - 1) *
+			 sizeof(unsigned int));
+	if (!vertices || !indices) {
+		printf("Error: failed to allocate grid\n");
+		return -1;
+	}
+
+	for (y = 0; y < GRID_HEIGHT; y++)
+		for (x = 0; x < GRID_WIDTH; x++) {
+			float *vertex = &vertices[2 * (y * GRID_WIDTH + x)];
+
+			vertex[0] = 1.8 * x / (GRID_WIDTH - 1) - 0.9;
+			vertex[1] = 1.8 * y / (GRID_HEIGHT - 1) - 0.9;
+		}
+
+	/* one triangle in every other cell */
+	for (y = 0; y < (GRID_HEIGHT - 1); y++)
+		for (x = (y & 1); x < (GRID_WIDTH - 1); x += 2) {
+			unsigned int index = y * GRID_WIDTH + x;
+
+			indices[count++] = index;
+			indices[count++] = index + 1;
+			indices[count++] = index + GRID_WIDTH;
+		}
+
+	state = limare_init();
+	if (!state)
+		return -1;
+
+	limare_buffer_clear(state);
+
+	ret = limare_state_setup(state, 0, 0, 0xFF505050);
+	if (ret)
+		return ret;
+
+	int program = limare_program_new(state);
+	vertex_shader_attach(state, program, vertex_shader_source);
+	fragment_shader_attach(state, program, fragment_shader_source);
+
+	limare_link(state);
+
+	limare_attribute_pointer(state, "aPosition", LIMARE_ATTRIB_FLOAT,
+				 2, 0, GRID_WIDTH * GRID_HEIGHT, vertices);
+
+	limare_frame_new(state);
+
+	ret = limare_draw_elements(state, GL_TRIANGLES, count, indices,
+				   GL_UNSIGNED_INT);
+	if (ret)
+		return ret;
+
+	ret = limare_frame_flush(state);
+	if (ret)
+		return ret;
+
+	limare_buffer_swap(state);
+
+	limare_finish(state);
+
+	free(indices);
+	free(vertices);
+
+	return 0;
+}
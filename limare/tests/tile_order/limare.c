@@ -0,0 +1,460 @@
+/*
+ * Copyright (c) 2013 Luc Verhaegen <libv@skynet.be>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Renders a few standard scenes with each pp tile order, and reports the
+ * pp time and the texture cache efficiency as seen by the pp performance
+ * counters.
+ *
+ * usage: limare_tile_order [width height [frames]]
+ *
+ * The resolution defaults to that of the framebuffer, run it at several
+ * to get numbers per resolution.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <GLES2/gl2.h>
+
+#include "limare.h"
+#include "formats.h"
+
+#include "esUtil.h"
+#include "cube_mesh.h"
+#include "companion.h"
+#include "texture_milkyway.h"
+
+static const char *tile_order_names[LIMARE_TILE_ORDER_COUNT] = {
+	[LIMARE_TILE_ORDER_HILBERT] = "hilbert",
+	[LIMARE_TILE_ORDER_MORTON] = "morton",
+	[LIMARE_TILE_ORDER_SERPENTINE] = "serpentine",
+	[LIMARE_TILE_ORDER_BLOCKS] = "blocks",
+};
+
+struct scene {
+	const char *name;
+	int (*setup)(struct limare_state *state, struct scene *scene);
+	int (*draw)(struct limare_state *state, struct scene *scene, int i);
+
+	int program;
+	int texture;
+	int elements;
+	float aspect;
+};
+
+static const char *textured_vertex_shader_source =
+	"attribute vec4 in_vertex;\n"
+	"attribute vec2 in_coord;\n"
+	"varying vec2 coord;\n"
+	"void main()\n"
+	"{\n"
+	"    gl_Position = in_vertex;\n"
+	"    coord = in_coord;\n"
+	"}\n";
+
+static const char *textured_fragment_shader_source =
+	"precision mediump float;\n"
+	"varying vec2 coord;\n"
+	"uniform sampler2D in_texture;\n"
+	"void main()\n"
+	"{\n"
+	"    gl_FragColor = texture2D(in_texture, coord);\n"
+	"}\n";
+
+static const char *lit_vertex_shader_source =
+	"uniform mat4 modelviewMatrix;\n"
+	"uniform mat4 modelviewprojectionMatrix;\n"
+	"uniform mat3 normalMatrix;\n"
+	"\n"
+	"attribute vec4 in_position;\n"
+	"attribute vec3 in_normal;\n"
+	"attribute vec2 in_coord;\n"
+	"\n"
+	"vec4 lightSource = vec4(10.0, 20.0, 40.0, 0.0);\n"
+	"\n"
+	"varying vec4 vVaryingColor;\n"
+	"varying vec2 coord;\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"    gl_Position = modelviewprojectionMatrix * in_position;\n"
+	"    vec3 vEyeNormal = normalMatrix * in_normal;\n"
+	"    vec4 vPosition4 = modelviewMatrix * in_position;\n"
+	"    vec3 vPosition3 = vPosition4.xyz / vPosition4.w;\n"
+	"    vec3 vLightDir = normalize(lightSource.xyz - vPosition3);\n"
+	"    float diff = max(0.0, dot(vEyeNormal, vLightDir));\n"
+	"    vVaryingColor = vec4(diff * vec3(1.0, 1.0, 1.0), 1.0);\n"
+	"    coord = in_coord;\n"
+	"}\n";
+
+static const char *lit_fragment_shader_source =
+	"precision mediump float;\n"
+	"\n"
+	"varying vec4 vVaryingColor;\n"
+	"varying vec2 coord;\n"
+	"\n"
+	"uniform sampler2D in_texture;\n"
+	"\n"
+	"void main()\n"
+	"{\n"
+	"    gl_FragColor = vVaryingColor * texture2D(in_texture, coord);\n"
+	"}\n";
+
+static int
+program_create(struct limare_state *state, const char *vertex_source,
+	       const char *fragment_source)
+{
+	int program = limare_program_new(state);
+
+	if (program < 0)
+		return program;
+
+	vertex_shader_attach(state, program, vertex_source);
+	fragment_shader_attach(state, program, fragment_source);
+
+	if (limare_link(state))
+		return -1;
+
+	return program;
+}
+
+/*
+ * A user interface: a full screen background, with a heavy, layered top
+ * bar on top.
+ */
+#define UI_BAR_LAYERS 8
+
+static float ui_vertices[] = {
+	/* background */
+	-1.0, -1.0, 0.5,   1.0, -1.0, 0.5,  -1.0,  1.0, 0.5,
+	 1.0, -1.0, 0.5,   1.0,  1.0, 0.5,  -1.0,  1.0, 0.5,
+	/* top bar */
+	-1.0,  0.7, 0.5,   1.0,  0.7, 0.5,  -1.0,  1.0, 0.5,
+	 1.0,  0.7, 0.5,   1.0,  1.0, 0.5,  -1.0,  1.0, 0.5,
+};
+
+static float ui_coords[] = {
+	0.0, 0.0,  1.0, 0.0,  0.0, 1.0,
+	1.0, 0.0,  1.0, 1.0,  0.0, 1.0,
+
+	0.0, 0.0,  1.0, 0.0,  0.0, 1.0,
+	1.0, 0.0,  1.0, 1.0,  0.0, 1.0,
+};
+
+static int
+ui_setup(struct limare_state *state, struct scene *scene)
+{
+	scene->program = program_create(state, textured_vertex_shader_source,
+					textured_fragment_shader_source);
+	if (scene->program < 0)
+		return -1;
+
+	limare_attribute_pointer(state, "in_vertex", LIMARE_ATTRIB_FLOAT,
+				 3, 0, 12, ui_vertices);
+	limare_attribute_pointer(state, "in_coord", LIMARE_ATTRIB_FLOAT,
+				 2, 0, 12, ui_coords);
+
+	scene->texture =
+		limare_texture_upload(state, texture_milkyway,
+				      TEXTURE_MILKYWAY_WIDTH,
+				      TEXTURE_MILKYWAY_HEIGHT,
+				      TEXTURE_MILKYWAY_FORMAT, 0);
+	limare_texture_attach(state, "in_texture", scene->texture);
+
+	return 0;
+}
+
+static int
+ui_draw(struct limare_state *state, struct scene *scene, int i)
+{
+	int ret, layer;
+
+	limare_disable(state, GL_DEPTH_TEST);
+	limare_disable(state, GL_CULL_FACE);
+
+	ret = limare_draw_arrays(state, GL_TRIANGLES, 0, 6);
+	if (ret)
+		return ret;
+
+	for (layer = 0; layer < UI_BAR_LAYERS; layer++) {
+		ret = limare_draw_arrays(state, GL_TRIANGLES, 6, 6);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static void
+lit_uniforms_attach(struct limare_state *state, struct scene *scene,
+		    float distance, float angle)
+{
+	ESMatrix modelview;
+	esMatrixLoadIdentity(&modelview);
+	esTranslate(&modelview, 0.0, 0.0, distance);
+	esRotate(&modelview, angle * 0.97, 1.0, 0.0, 0.0);
+	esRotate(&modelview, angle * 1.13, 0.0, 1.0, 0.0);
+	esRotate(&modelview, angle * 0.73, 0.0, 0.0, 1.0);
+
+	ESMatrix projection;
+	esMatrixLoadIdentity(&projection);
+	esFrustum(&projection, -1.0, +1.0, -1.0 * scene->aspect,
+		  +1.0 * scene->aspect, 1.0, 10.0);
+
+	ESMatrix modelviewprojection;
+	esMatrixLoadIdentity(&modelviewprojection);
+	esMatrixMultiply(&modelviewprojection, &modelview, &projection);
+
+	float normal[9];
+	normal[0] = modelview.m[0][0];
+	normal[1] = modelview.m[0][1];
+	normal[2] = modelview.m[0][2];
+	normal[3] = modelview.m[1][0];
+	normal[4] = modelview.m[1][1];
+	normal[5] = modelview.m[1][2];
+	normal[6] = modelview.m[2][0];
+	normal[7] = modelview.m[2][1];
+	normal[8] = modelview.m[2][2];
+
+	limare_uniform_attach(state, "modelviewMatrix", 16,
+			      &modelview.m[0][0]);
+	limare_uniform_attach(state, "modelviewprojectionMatrix", 16,
+			      &modelviewprojection.m[0][0]);
+	limare_uniform_attach(state, "normalMatrix", 9, normal);
+}
+
+/*
+ * A spinning textured cube, filling most of the screen.
+ */
+static int
+cube_setup(struct limare_state *state, struct scene *scene)
+{
+	scene->program = program_create(state, lit_vertex_shader_source,
+					lit_fragment_shader_source);
+	if (scene->program < 0)
+		return -1;
+
+	limare_attribute_pointer(state, "in_position", LIMARE_ATTRIB_FLOAT,
+				 3, 0, CUBE_VERTEX_COUNT, cube_vertices);
+	limare_attribute_pointer(state, "in_coord", LIMARE_ATTRIB_FLOAT,
+				 2, 0, CUBE_VERTEX_COUNT,
+				 cube_texture_coordinates);
+	limare_attribute_pointer(state, "in_normal", LIMARE_ATTRIB_FLOAT,
+				 3, 0, CUBE_VERTEX_COUNT, cube_normals);
+
+	scene->texture = limare_texture_upload(state, companion_texture_flat,
+					       COMPANION_TEXTURE_WIDTH,
+					       COMPANION_TEXTURE_HEIGHT,
+					       COMPANION_TEXTURE_FORMAT, 0);
+	limare_texture_attach(state, "in_texture", scene->texture);
+
+	return 0;
+}
+
+static int
+cube_draw(struct limare_state *state, struct scene *scene, int i)
+{
+	limare_enable(state, GL_DEPTH_TEST);
+	limare_enable(state, GL_CULL_FACE);
+	limare_depth_mask(state, 1);
+
+	lit_uniforms_attach(state, scene, -3.0, 0.5 * i);
+
+	return limare_draw_elements(state, GL_TRIANGLES, CUBE_INDEX_COUNT,
+				    &cube_indices, GL_UNSIGNED_BYTE);
+}
+
+/*
+ * The spinning companion cube, lots of small triangles.
+ */
+static int
+companion_setup(struct limare_state *state, struct scene *scene)
+{
+	int vertices, coords, normals;
+
+	scene->program = program_create(state, lit_vertex_shader_source,
+					lit_fragment_shader_source);
+	if (scene->program < 0)
+		return -1;
+
+	vertices = limare_attribute_buffer_upload(state, LIMARE_ATTRIB_FLOAT,
+						  3, 0, COMPANION_VERTEX_COUNT,
+						  companion_vertices);
+	coords = limare_attribute_buffer_upload(state, LIMARE_ATTRIB_FLOAT,
+						2, 0, COMPANION_VERTEX_COUNT,
+						companion_texture_coordinates);
+	normals = limare_attribute_buffer_upload(state, LIMARE_ATTRIB_FLOAT,
+						 3, 0, COMPANION_VERTEX_COUNT,
+						 companion_normals);
+	if ((vertices < 0) || (coords < 0) || (normals < 0))
+		return -1;
+
+	limare_attribute_buffer_attach(state, "in_position", vertices);
+	limare_attribute_buffer_attach(state, "in_coord", coords);
+	limare_attribute_buffer_attach(state, "in_normal", normals);
+
+	scene->elements =
+		limare_elements_buffer_upload(state, GL_TRIANGLES,
+					      GL_UNSIGNED_SHORT,
+					      COMPANION_INDEX_COUNT,
+					      companion_triangles);
+	if (scene->elements < 0)
+		return -1;
+
+	scene->texture = limare_texture_upload(state, companion_texture,
+					       COMPANION_TEXTURE_WIDTH,
+					       COMPANION_TEXTURE_HEIGHT,
+					       COMPANION_TEXTURE_FORMAT, 0);
+	limare_texture_attach(state, "in_texture", scene->texture);
+
+	return 0;
+}
+
+static int
+companion_draw(struct limare_state *state, struct scene *scene, int i)
+{
+	limare_enable(state, GL_DEPTH_TEST);
+	limare_enable(state, GL_CULL_FACE);
+	limare_depth_mask(state, 1);
+
+	lit_uniforms_attach(state, scene, -4.0, 0.5 * i);
+
+	return limare_draw_elements_buffer(state, scene->elements);
+}
+
+static struct scene scenes[] = {
+	{ .name = "ui", .setup = ui_setup, .draw = ui_draw },
+	{ .name = "cube", .setup = cube_setup, .draw = cube_draw },
+	{ .name = "companion", .setup = companion_setup,
+	  .draw = companion_draw },
+};
+
+#define SCENE_COUNT (sizeof(scenes) / sizeof(scenes[0]))
+
+static int
+frames_render(struct limare_state *state, struct scene *scene,
+	      int start, int count)
+{
+	int i, ret;
+
+	for (i = start; i < (start + count); i++) {
+		ret = limare_frame_new(state);
+		if (ret)
+			return ret;
+
+		ret = scene->draw(state, scene, i);
+		if (ret)
+			return ret;
+
+		ret = limare_frame_flush(state);
+		if (ret)
+			return ret;
+
+		limare_buffer_swap(state);
+	}
+
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct limare_state *state;
+	struct limare_pp_stats stats;
+	int ret, width = 0, height = 0, frames = 256;
+	int i, order;
+
+	if (argc > 2) {
+		width = atoi(argv[1]);
+		height = atoi(argv[2]);
+	}
+	if (argc > 3)
+		frames = atoi(argv[3]);
+
+	state = limare_init();
+	if (!state)
+		return -1;
+
+	ret = limare_state_setup(state, width, height, 0xFF505050);
+	if (ret)
+		return ret;
+
+	limare_buffer_size(state, &width, &height);
+
+	limare_pp_perf_counters_set(state,
+				    LIMARE_PP_COUNTER_TEXTURE_CACHE_HIT,
+				    LIMARE_PP_COUNTER_TEXTURE_CACHE_MISS);
+
+	printf("%-10s %-10s %9s %8s %12s %12s %6s\n", "scene", "order",
+	       "size", "pp (us)", "tex hit", "tex miss", "hit %");
+
+	for (i = 0; i < SCENE_COUNT; i++) {
+		struct scene *scene = &scenes[i];
+
+		scene->aspect = (float) height / width;
+
+		ret = scene->setup(state, scene);
+		if (ret) {
+			printf("Error: failed to set up scene %s\n",
+			       scene->name);
+			return ret;
+		}
+
+		for (order = 0; order < LIMARE_TILE_ORDER_COUNT; order++) {
+			long long total;
+
+			ret = limare_tile_order_set(state, order);
+			if (ret)
+				return ret;
+
+			/* let all frame slots pick up the new order */
+			ret = frames_render(state, scene, 0, 4);
+			if (ret)
+				return ret;
+			limare_pp_stats_get(state, &stats, 1);
+
+			ret = frames_render(state, scene, 0, frames);
+			if (ret)
+				return ret;
+			limare_pp_stats_get(state, &stats, 1);
+
+			if (!stats.frames)
+				continue;
+
+			total = stats.counter[0] + stats.counter[1];
+
+			printf("%-10s %-10s %4dx%-4d %8lld %12lld %12lld "
+			       "%6.2f\n", scene->name,
+			       tile_order_names[order], width, height,
+			       stats.time / stats.frames,
+			       stats.counter[0] / stats.frames,
+			       stats.counter[1] / stats.frames,
+			       total ? (100.0 * stats.counter[0]) / total : 0.0);
+		}
+	}
+
+	limare_finish(state);
+
+	return 0;
+}
@@ -0,0 +1,535 @@
+/*
+ * Copyright (c) 2011-2013 Luc Verhaegen <libv@skynet.be>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ *
+ * Offline batch compilation of vertex/fragment pairs into a single
+ * shader bundle, so that limare never needs to invoke the compiler.
+ *
+ * The manifest holds one program per line:
+ *
+ *	name vertex_shader.txt fragment_shader.txt
+ *
+ * Empty lines and lines starting with # are ignored.
+ *
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+
+#include "compiler.h"
+#include "bundle.h"
+#include "shader_stats.h"
+#include "compile.h"
+
+#define ALIGN(x, y) (((x) + ((y) - 1)) & ~((y) - 1))
+
+#define BUNDLE_STRING_SIZE 1024
+
+struct bundle_program {
+	char *name;
+	char *vertex;
+	char *fragment;
+
+	struct lima_bundle_entry entry;
+	void *vertex_stream;
+	void *fragment_stream;
+};
+
+static void
+bundle_programs_free(struct bundle_program *programs, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		free(programs[i].name);
+		free(programs[i].vertex);
+		free(programs[i].fragment);
+		free(programs[i].vertex_stream);
+		free(programs[i].fragment_stream);
+	}
+
+	free(programs);
+}
+
+static int
+manifest_read(const char *filename, struct bundle_program **programs_ret,
+	      int *count_ret)
+{
+	struct bundle_program *programs = NULL;
+	char line[3 * BUNDLE_STRING_SIZE];
+	char name[BUNDLE_STRING_SIZE];
+	char vertex[BUNDLE_STRING_SIZE];
+	char fragment[BUNDLE_STRING_SIZE];
+	int count = 0, size = 0, number = 0;
+	FILE *file;
+
+	file = fopen(filename, "r");
+	if (!file) {
+		printf("Error: failed to open %s: %s\n",
+		       filename, strerror(errno));
+		return errno;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		int ret;
+
+		number++;
+
+		ret = sscanf(line, "%1023s %1023s %1023s",
+			     name, vertex, fragment);
+		if ((ret <= 0) || (name[0] == '#'))
+			continue;
+
+		if (ret != 3) {
+			printf("Error: %s:%d: expected \"name vertex "
+			       "fragment\"\n", filename, number);
+			goto error;
+		}
+
+		if (count == size) {
+			struct bundle_program *new;
+
+			size = size ? (2 * size) : 16;
+			new = realloc(programs,
+				      size * sizeof(struct bundle_program));
+			if (!new) {
+				printf("Error: failed to allocate programs: "
+				       "%s\n", strerror(errno));
+				goto error;
+			}
+			programs = new;
+		}
+
+		memset(&programs[count], 0, sizeof(struct bundle_program));
+		programs[count].name = strdup(name);
+		programs[count].vertex = strdup(vertex);
+		programs[count].fragment = strdup(fragment);
+		count++;
+
+		if (!programs[count - 1].name ||
+		    !programs[count - 1].vertex ||
+		    !programs[count - 1].fragment) {
+			printf("Error: failed to allocate strings: %s\n",
+			       strerror(errno));
+			goto error;
+		}
+	}
+
+	fclose(file);
+
+	if (!count) {
+		printf("Error: %s does not list any programs.\n", filename);
+		free(programs);
+		return EINVAL;
+	}
+
+	*programs_ret = programs;
+	*count_ret = count;
+
+	return 0;
+ error:
+	fclose(file);
+	bundle_programs_free(programs, count);
+	return EINVAL;
+}
+
+static int
+binary_mbs_check(const char *filename, struct lima_shader_binary_r3p2 *binary)
+{
+	if (!binary->mbs_stream || !binary->mbs_stream_size ||
+	    (((unsigned int *) binary->mbs_stream)[0] != STREAM_TAG_MBS1)) {
+		printf("Error: %s: compiler did not produce an MBS stream.\n",
+		       filename);
+		return EINVAL;
+	}
+
+	return 0;
+}
+
+static int
+file_write(int fd, const void *data, int size)
+{
+	while (size) {
+		int ret = write(fd, data, size);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+
+		data += ret;
+		size -= ret;
+	}
+
+	return 0;
+}
+
+static int
+file_read(int fd, void *data, int size)
+{
+	while (size) {
+		int ret = read(fd, data, size);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+
+		if (!ret)
+			return EIO;
+
+		data += ret;
+		size -= ret;
+	}
+
+	return 0;
+}
+
+static void
+bundle_temp_name(char *name, int size, const char *output, int index)
+{
+	snprintf(name, size, "%s.%d.tmp", output, index);
+}
+
+/*
+ * Runs inside a worker. Compiles both shaders and writes the entry and
+ * both MBS streams to a temporary file for the parent to pick up.
+ */
+static int
+bundle_program_compile(struct bundle_program *program, const char *tempname)
+{
+	struct lima_shader_binary_r3p2 vertex = { 0 };
+	struct lima_shader_binary_r3p2 fragment = { 0 };
+	struct lima_bundle_entry *entry = &program->entry;
+	int fd, ret;
+
+	ret = shader_compile(program->vertex, LIMA_SHADER_VERTEX, &vertex);
+	if (ret)
+		return ret;
+
+	ret = binary_mbs_check(program->vertex, &vertex);
+	if (ret)
+		return ret;
+
+	ret = shader_compile(program->fragment, LIMA_SHADER_FRAGMENT,
+			     &fragment);
+	if (ret)
+		return ret;
+
+	ret = binary_mbs_check(program->fragment, &fragment);
+	if (ret)
+		return ret;
+
+	entry->hash = lima_bundle_hash(program->name);
+	entry->vertex_size = vertex.mbs_stream_size;
+	entry->fragment_size = fragment.mbs_stream_size;
+	entry->vertex_shader_size = vertex.shader_size;
+	entry->vertex_attribute_prefetch = binary_attribute_prefetch(&vertex);
+	entry->fragment_shader_size = fragment.shader_size;
+	entry->fragment_first_instruction_size =
+		((unsigned int *) fragment.shader)[0] & 0x1F;
+
+	{
+		struct lima_vertex_shader_stats vertex_stats;
+		struct lima_fragment_shader_stats fragment_stats;
+
+		lima_vertex_shader_stats(vertex.shader, vertex.shader_size,
+					 entry->vertex_attribute_prefetch,
+					 &vertex_stats);
+		vertex_shader_stats_print(program->name, &vertex_stats);
+
+		lima_fragment_shader_stats(fragment.shader,
+					   fragment.shader_size,
+					   &fragment_stats);
+		fragment_shader_stats_print(program->name, &fragment_stats);
+	}
+
+	fd = open(tempname, O_WRONLY | O_CREAT | O_TRUNC, 00600);
+	if (fd < 0) {
+		printf("Error: failed to open %s: %s\n",
+		       tempname, strerror(errno));
+		return errno;
+	}
+
+	ret = file_write(fd, entry, sizeof(struct lima_bundle_entry));
+	if (!ret)
+		ret = file_write(fd, vertex.mbs_stream, vertex.mbs_stream_size);
+	if (!ret)
+		ret = file_write(fd, fragment.mbs_stream,
+				 fragment.mbs_stream_size);
+	if (ret)
+		printf("Error: failed to write %s: %s\n",
+		       tempname, strerror(ret));
+
+	close(fd);
+
+	return ret;
+}
+
+static int
+bundle_program_collect(struct bundle_program *program, const char *tempname)
+{
+	int fd, ret;
+
+	fd = open(tempname, O_RDONLY);
+	if (fd < 0) {
+		printf("Error: failed to open %s: %s\n",
+		       tempname, strerror(errno));
+		return errno;
+	}
+
+	ret = file_read(fd, &program->entry, sizeof(struct lima_bundle_entry));
+	if (ret)
+		goto end;
+
+	program->vertex_stream = malloc(program->entry.vertex_size);
+	program->fragment_stream = malloc(program->entry.fragment_size);
+	if (!program->vertex_stream || !program->fragment_stream) {
+		ret = ENOMEM;
+		goto end;
+	}
+
+	ret = file_read(fd, program->vertex_stream,
+			program->entry.vertex_size);
+	if (ret)
+		goto end;
+
+	ret = file_read(fd, program->fragment_stream,
+			program->entry.fragment_size);
+ end:
+	if (ret)
+		printf("Error: failed to read %s: %s\n",
+		       tempname, strerror(ret));
+	close(fd);
+	unlink(tempname);
+
+	return ret;
+}
+
+/*
+ * Worker processes take every jobs'th program, so that the compiler,
+ * which is neither thread safe nor particularly fast, runs once per cpu.
+ */
+static int
+bundle_programs_compile(struct bundle_program *programs, int count,
+			const char *output, int jobs)
+{
+	char tempname[BUNDLE_STRING_SIZE + 32];
+	pid_t pids[64];
+	int i, j, ret = 0;
+
+	if (jobs <= 0)
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs <= 0)
+		jobs = 1;
+	if (jobs > 64)
+		jobs = 64;
+	if (jobs > count)
+		jobs = count;
+
+	/* workers leave through _exit(), so keep stdio buffers in sync */
+	fflush(stdout);
+
+	for (i = 0; i < jobs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			printf("Error: failed to fork: %s\n", strerror(errno));
+			ret = errno;
+			break;
+		}
+
+		if (!pids[i]) {
+			for (j = i; j < count; j += jobs) {
+				bundle_temp_name(tempname, sizeof(tempname),
+						 output, j);
+				if (bundle_program_compile(&programs[j],
+							   tempname)) {
+					fflush(stdout);
+					_exit(1);
+				}
+			}
+			fflush(stdout);
+			_exit(0);
+		}
+	}
+
+	for (j = 0; j < i; j++) {
+		int status;
+
+		if ((waitpid(pids[j], &status, 0) < 0) ||
+		    !WIFEXITED(status) || WEXITSTATUS(status))
+			ret = EINVAL;
+	}
+
+	for (j = 0; j < count; j++) {
+		bundle_temp_name(tempname, sizeof(tempname), output, j);
+
+		if (!ret)
+			ret = bundle_program_collect(&programs[j], tempname);
+		else
+			unlink(tempname);
+	}
+
+	return ret;
+}
+
+static int
+bundle_program_compare(const void *a, const void *b)
+{
+	const struct bundle_program *program_a = a;
+	const struct bundle_program *program_b = b;
+
+	if (program_a->entry.hash < program_b->entry.hash)
+		return -1;
+	if (program_a->entry.hash > program_b->entry.hash)
+		return 1;
+	return strcmp(program_a->name, program_b->name);
+}
+
+static int
+bundle_write(struct bundle_program *programs, int count, const char *output)
+{
+	struct lima_bundle_header header = { 0 };
+	static const char padding[0x10] = { 0 };
+	int i, fd, ret, offset, strings_size = 0;
+
+	qsort(programs, count, sizeof(struct bundle_program),
+	      bundle_program_compare);
+
+	for (i = 0; i < count; i++) {
+		if (i && !strcmp(programs[i - 1].name, programs[i].name)) {
+			printf("Error: program %s is listed twice.\n",
+			       programs[i].name);
+			return EINVAL;
+		}
+
+		strings_size += strlen(programs[i].name) + 1;
+	}
+
+	/* lay out the file */
+	offset = sizeof(struct lima_bundle_header) +
+		count * sizeof(struct lima_bundle_entry);
+
+	for (i = 0; i < count; i++) {
+		programs[i].entry.name_offset = offset;
+		offset += strlen(programs[i].name) + 1;
+	}
+
+	for (i = 0; i < count; i++) {
+		struct lima_bundle_entry *entry = &programs[i].entry;
+
+		offset = ALIGN(offset, 0x10);
+		entry->vertex_offset = offset;
+		offset += entry->vertex_size;
+
+		offset = ALIGN(offset, 0x10);
+		entry->fragment_offset = offset;
+		offset += entry->fragment_size;
+	}
+
+	header.magic = LIMA_BUNDLE_MAGIC;
+	header.version = LIMA_BUNDLE_VERSION;
+	header.count = count;
+	header.size = offset;
+
+	fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 00644);
+	if (fd < 0) {
+		printf("Error: failed to open %s: %s\n",
+		       output, strerror(errno));
+		return errno;
+	}
+
+	ret = file_write(fd, &header, sizeof(struct lima_bundle_header));
+	for (i = 0; !ret && (i < count); i++)
+		ret = file_write(fd, &programs[i].entry,
+				 sizeof(struct lima_bundle_entry));
+	for (i = 0; !ret && (i < count); i++)
+		ret = file_write(fd, programs[i].name,
+				 strlen(programs[i].name) + 1);
+
+	offset = sizeof(struct lima_bundle_header) +
+		count * sizeof(struct lima_bundle_entry) + strings_size;
+
+	for (i = 0; !ret && (i < count); i++) {
+		struct lima_bundle_entry *entry = &programs[i].entry;
+
+		ret = file_write(fd, padding, entry->vertex_offset - offset);
+		if (!ret)
+			ret = file_write(fd, programs[i].vertex_stream,
+					 entry->vertex_size);
+		offset = entry->vertex_offset + entry->vertex_size;
+
+		if (!ret)
+			ret = file_write(fd, padding,
+					 entry->fragment_offset - offset);
+		if (!ret)
+			ret = file_write(fd, programs[i].fragment_stream,
+					 entry->fragment_size);
+		offset = entry->fragment_offset + entry->fragment_size;
+	}
+
+	if (ret) {
+		printf("Error: failed to write %s: %s\n",
+		       output, strerror(ret));
+		close(fd);
+		unlink(output);
+		return ret;
+	}
+
+	close(fd);
+
+	printf("Wrote %d programs to %s (%d bytes).\n",
+	       count, output, header.size);
+
+	return 0;
+}
+
+int
+bundle_compile(const char *manifest, const char *output, int jobs)
+{
+	struct bundle_program *programs;
+	int count, ret;
+
+	ret = manifest_read(manifest, &programs, &count);
+	if (ret)
+		return ret;
+
+	ret = bundle_programs_compile(programs, count, output, jobs);
+	if (!ret)
+		ret = bundle_write(programs, count, output);
+
+	bundle_programs_free(programs, count);
+
+	return ret;
+}
@@ -34,20 +34,22 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <ctype.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include "compiler.h"
-
-#define STREAM_TAG_MBS1 0x3153424d
+#include "shader_stats.h"
+#include "compile.h"
 
 void
 usage(char *name)
 {
 	printf("usage: %s -[fv] shader.txt\n", name);
+	printf("       %s -b manifest.txt shaders.bundle [jobs]\n", name);
 	printf("\n");
 	printf("\t-f : fragment shader\n");
 	printf("\t-v : vertex shader\n");
+	printf("\t-b : compile all programs listed in the manifest into a"
+	       " bundle\n");
 
 	exit(EINVAL);
 }
@@ -262,30 +264,58 @@ dump_shader_mbs(const char *filename, struct lima_shader_binary_r3p2 *binary)
 	}
 }
 
+/*
+ * The different compiler versions return differently laid out binaries,
+ * so pick the vertex parameters out of the right one.
+ */
 int
-main(int argc, char *argv[])
+binary_attribute_prefetch(struct lima_shader_binary_r3p2 *binary)
 {
-	struct lima_shader_binary_r3p2 binary = { 0 };
-	char *filename, *source;
-	int type, fd, size, length, ret;
-
-	if (argc != 3) {
-		printf("Error: Wrong number of arguments\n");
-		usage(argv[0]);
-	}
+	if (!binary->mbs_stream_size ||
+	    (((unsigned int *) binary->mbs_stream)[0] != STREAM_TAG_MBS1))
+		return ((struct lima_shader_binary *) binary)->
+			parameters.vertex.attribute_prefetch;
+	else if (((unsigned int) binary->something_stream) >= 0x100)
+		return binary->parameters.vertex.attribute_prefetch;
+	else
+		return ((struct lima_shader_binary_mbs *) binary)->
+			parameters.vertex.attribute_prefetch;
+}
 
-	if ((argv[1][0] != '-') ||
-	    ((argv[1][1] != 'f') && (argv[1][1] != 'v'))) {
-		printf("Error: Wrong shader type\n");
-		usage(argv[0]);
-	}
+void
+vertex_shader_stats_print(const char *name,
+			  struct lima_vertex_shader_stats *stats)
+{
+	printf("%s: vertex: %d instructions, ~%d cycles/vertex, "
+	       "%d attribute registers, %d varying stores, "
+	       "%d temporary stores, %d branches\n", name,
+	       stats->instructions, stats->cycles, stats->attribute_prefetch,
+	       stats->varying_stores, stats->temporary_stores,
+	       stats->branches);
+}
 
-	if (argv[1][1] == 'f')
-		type = LIMA_SHADER_FRAGMENT;
-	else
-		type = LIMA_SHADER_VERTEX;
+void
+fragment_shader_stats_print(const char *name,
+			    struct lima_fragment_shader_stats *stats)
+{
+	printf("%s: fragment: %d instructions, ~%d cycles/fragment, "
+	       "%d varying fetches, %d texture fetches, %d uniform fetches, "
+	       "%d temporary writes, %d branches, %d syncs\n", name,
+	       stats->instructions, stats->cycles, stats->varying_fetches,
+	       stats->texture_fetches, stats->uniform_fetches,
+	       stats->temporary_writes, stats->branches, stats->syncs);
+}
 
-	filename = argv[2];
+/*
+ * Reads and compiles a single shader source file. The source is read into
+ * a zero terminated buffer, as the compiler insists on a string.
+ */
+int
+shader_compile(const char *filename, int type,
+	       struct lima_shader_binary_r3p2 *binary)
+{
+	char *source;
+	int fd, size, length, ret;
 
 	fd = open(filename, O_RDONLY);
 	if (fd < 0) {
@@ -297,41 +327,98 @@ main(int argc, char *argv[])
 	{
 		struct stat buf;
 
-		if (stat(filename, &buf)) {
+		if (fstat(fd, &buf)) {
 			printf("Error: failed to fstat %s: %s\n",
 			       filename, strerror(errno));
+			close(fd);
 			return errno;
 		}
 
 		size = buf.st_size;
 		if (!size) {
 			fprintf(stderr, "Error: %s is empty.\n", filename);
-			return 0;
+			close(fd);
+			return EINVAL;
 		}
 	}
 
-	source = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
-	if (source == MAP_FAILED) {
-		printf("Error: failed to mmap %s: %s\n",
+	source = malloc(size + 1);
+	if (!source) {
+		printf("Error: failed to allocate source for %s: %s\n",
 		       filename, strerror(errno));
-		return errno;
+		close(fd);
+		return ENOMEM;
+	}
+
+	length = read(fd, source, size);
+	close(fd);
+	if (length != size) {
+		printf("Error: failed to read %s: %s\n",
+		       filename, strerror(errno));
+		free(source);
+		return EIO;
 	}
+	source[size] = 0;
 
 	length = strlen(source);
 
-	ret = __mali_compile_essl_shader((struct lima_shader_binary *) &binary,
+	ret = __mali_compile_essl_shader((struct lima_shader_binary *) binary,
 					 type, source, &length, 1);
+	free(source);
 	if (ret) {
-		if (binary.error_log)
+		if (binary->error_log)
 			printf("%s: compilation failed: %s\n",
-			       __func__, binary.error_log);
+			       filename, binary->error_log);
 		else
 			printf("%s: compilation failed: %s\n",
-			       __func__, binary.oom_log);
+			       filename, binary->oom_log);
+	}
 
-		return ret;
+	return ret;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct lima_shader_binary_r3p2 binary = { 0 };
+	char *filename;
+	int type, ret;
+
+	if ((argc >= 4) && !strcmp(argv[1], "-b")) {
+		int jobs = 0;
+
+		if (argc == 5)
+			jobs = atoi(argv[4]);
+		else if (argc != 4) {
+			printf("Error: Wrong number of arguments\n");
+			usage(argv[0]);
+		}
+
+		return bundle_compile(argv[2], argv[3], jobs);
+	}
+
+	if (argc != 3) {
+		printf("Error: Wrong number of arguments\n");
+		usage(argv[0]);
+	}
+
+	if ((argv[1][0] != '-') ||
+	    ((argv[1][1] != 'f') && (argv[1][1] != 'v'))) {
+		printf("Error: Wrong shader type\n");
+		usage(argv[0]);
 	}
 
+	if (argv[1][1] == 'f')
+		type = LIMA_SHADER_FRAGMENT;
+	else
+		type = LIMA_SHADER_VERTEX;
+
+	filename = argv[2];
+
+	ret = shader_compile(filename, type, &binary);
+	if (ret)
+		return ret;
+
 	if ((((unsigned int *) binary.mbs_stream)[0]) == STREAM_TAG_MBS1) {
 		if (((unsigned int) binary.something_stream) >= 0x100)
 			dump_shader_binary_r3p2(&binary, type);
@@ -341,5 +428,20 @@ main(int argc, char *argv[])
 	} else
 		dump_shader_binary((struct lima_shader_binary *) &binary, type);
 
+	if (type == LIMA_SHADER_VERTEX) {
+		struct lima_vertex_shader_stats stats;
+
+		lima_vertex_shader_stats(binary.shader, binary.shader_size,
+					 binary_attribute_prefetch(&binary),
+					 &stats);
+		vertex_shader_stats_print(filename, &stats);
+	} else {
+		struct lima_fragment_shader_stats stats;
+
+		lima_fragment_shader_stats(binary.shader, binary.shader_size,
+					   &stats);
+		fragment_shader_stats_print(filename, &stats);
+	}
+
 	return 0;
 }
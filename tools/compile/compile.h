@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2011-2013 Luc Verhaegen <libv@skynet.be>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef LIMA_COMPILE_H
+#define LIMA_COMPILE_H 1
+
+#define STREAM_TAG_MBS1 0x3153424d
+
+/* from compile.c */
+int shader_compile(const char *filename, int type,
+		   struct lima_shader_binary_r3p2 *binary);
+int binary_attribute_prefetch(struct lima_shader_binary_r3p2 *binary);
+void vertex_shader_stats_print(const char *name,
+			       struct lima_vertex_shader_stats *stats);
+void fragment_shader_stats_print(const char *name,
+				 struct lima_fragment_shader_stats *stats);
+
+/* from bundle.c */
+int bundle_compile(const char *manifest, const char *output, int jobs);
+
+#endif /* LIMA_COMPILE_H */
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2013 Luc Verhaegen <libv@skynet.be>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Offline mesh conversion: reorders a triangle list for vertex locality,
+ * renumbers the vertices in first use order and rewrites the attribute
+ * files to match, as limare_elements_buffer_upload_flags() does at
+ * upload time.
+ *
+ * All files are raw arrays, as they get handed to limare.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "vcache.h"
+
+static void
+usage(char *name)
+{
+	printf("usage: %s [-n] -[bsi] indices_in indices_out "
+	       "[stride attributes_in attributes_out]...\n", name);
+	printf("\n");
+	printf("\t-n : keep the vertex numbering, only reorder triangles\n");
+	printf("\t-b : byte indices\n");
+	printf("\t-s : short indices\n");
+	printf("\t-i : int indices\n");
+
+	exit(EINVAL);
+}
+
+static void *
+file_load(const char *filename, int *size)
+{
+	FILE *file;
+	void *data;
+
+	file = fopen(filename, "r");
+	if (!file) {
+		printf("Error: failed to open %s: %s\n", filename,
+		       strerror(errno));
+		return NULL;
+	}
+
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data = malloc(*size + 1);
+	if (!data) {
+		printf("Error: failed to allocate %d bytes\n", *size);
+		fclose(file);
+		return NULL;
+	}
+
+	if (fread(data, 1, *size, file) != *size) {
+		printf("Error: failed to read %s\n", filename);
+		free(data);
+		fclose(file);
+		return NULL;
+	}
+
+	fclose(file);
+	return data;
+}
+
+static int
+file_save(const char *filename, const void *data, int size)
+{
+	FILE *file;
+
+	file = fopen(filename, "w");
+	if (!file) {
+		printf("Error: failed to open %s: %s\n", filename,
+		       strerror(errno));
+		return -1;
+	}
+
+	if (fwrite(data, 1, size, file) != size) {
+		printf("Error: failed to write %s\n", filename);
+		fclose(file);
+		return -1;
+	}
+
+	fclose(file);
+	return 0;
+}
+
+static int
+attributes_convert(int stride, const char *input, const char *output,
+		   int vertex_count, const unsigned int *remap)
+{
+	void *data, *converted;
+	int size, ret;
+
+	data = file_load(input, &size);
+	if (!data)
+		return -1;
+
+	if ((stride <= 0) || (size < (vertex_count * stride))) {
+		printf("Error: %s holds fewer than %d vertices of %d bytes\n",
+		       input, vertex_count, stride);
+		free(data);
+		return -1;
+	}
+
+	converted = malloc(size);
+	if (!converted) {
+		printf("Error: failed to allocate %d bytes\n", size);
+		free(data);
+		return -1;
+	}
+
+	/* vertices beyond the highest index are passed on unchanged */
+	memcpy(converted, data, size);
+	vcache_attributes_remap(converted, data, stride, vertex_count, remap);
+
+	ret = file_save(output, converted, size);
+
+	free(converted);
+	free(data);
+	return ret;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned int *indices, *remap;
+	unsigned int max = 0;
+	void *data;
+	int renumber = 1, index_size, size, count, used, i, j;
+
+	i = 1;
+	if ((argc > 1) && !strcmp(argv[i], "-n")) {
+		renumber = 0;
+		i++;
+	}
+
+	if ((argc - i) < 3) {
+		printf("Error: Wrong number of arguments\n");
+		usage(argv[0]);
+	}
+
+	if (!strcmp(argv[i], "-b"))
+		index_size = 1;
+	else if (!strcmp(argv[i], "-s"))
+		index_size = 2;
+	else if (!strcmp(argv[i], "-i"))
+		index_size = 4;
+	else {
+		printf("Error: Wrong index type\n");
+		usage(argv[0]);
+	}
+	i++;
+
+	if ((argc - i - 2) % 3) {
+		printf("Error: Wrong number of attribute arguments\n");
+		usage(argv[0]);
+	}
+
+	if (!renumber && (argc - i - 2)) {
+		printf("Error: attributes only change when renumbering\n");
+		usage(argv[0]);
+	}
+
+	data = file_load(argv[i], &size);
+	if (!data)
+		return -1;
+
+	count = size / index_size;
+
+	indices = malloc(count * sizeof(unsigned int));
+	if (!indices) {
+		printf("Error: failed to allocate indices\n");
+		return -1;
+	}
+
+	for (j = 0; j < count; j++) {
+		if (index_size == 1)
+			indices[j] = ((unsigned char *) data)[j];
+		else if (index_size == 2)
+			indices[j] = ((unsigned short *) data)[j];
+		else
+			indices[j] = ((unsigned int *) data)[j];
+
+		if (indices[j] > max)
+			max = indices[j];
+	}
+
+	if (vcache_triangles_reorder(indices, count, max + 1))
+		return -1;
+
+	remap = malloc((max + 1) * sizeof(unsigned int));
+	if (!remap) {
+		printf("Error: failed to allocate remap\n");
+		return -1;
+	}
+
+	if (renumber) {
+		used = vcache_vertices_reorder(indices, count, max + 1, remap);
+		if (used < 0)
+			return -1;
+
+		printf("%d triangles, %d of %d vertices used\n", count / 3,
+		       used, max + 1);
+	} else
+		printf("%d triangles\n", count / 3);
+
+	for (j = 0; j < count; j++) {
+		if (index_size == 1)
+			((unsigned char *) data)[j] = indices[j];
+		else if (index_size == 2)
+			((unsigned short *) data)[j] = indices[j];
+		else
+			((unsigned int *) data)[j] = indices[j];
+	}
+
+	if (file_save(argv[i + 1], data, count * index_size))
+		return -1;
+
+	for (i += 2; i < argc; i += 3)
+		if (attributes_convert(atoi(argv[i]), argv[i + 1],
+				       argv[i + 2], max + 1, remap))
+			return -1;
+
+	return 0;
+}